@@ -0,0 +1,135 @@
+#ifndef REGINA_BENCH_H_INCLUDED
+#define REGINA_BENCH_H_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "trace_ref_t.h"
+
+/*
+ * Helpers shared by the microbenchmarks. They run without DynamoRIO on
+ * synthetic data and print one line per case:
+ *   <case>|<records>|<records/s>|<ns/record>
+ */
+
+#ifdef _WIN32
+#define BENCH_NULL_DEVICE "NUL"
+#else
+#define BENCH_NULL_DEVICE "/dev/null"
+#endif
+
+#define BENCH_BATCH 10000   //< MAX_TRACE_STORAGE_SIZE of the client
+
+
+class BenchTimer {
+public:
+    inline BenchTimer(void) : start(std::chrono::steady_clock::now()) { }
+
+    inline double Seconds(void) const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+
+inline void bench_header(void) {
+    std::printf("# case|records|records/s|ns/record\n");
+}
+
+
+inline void bench_report(const char *name, const uint64_t records, const double seconds) {
+    std::printf("%s|%llu|%.0f|%.2f\n", name, static_cast<unsigned long long>(records),
+        records / seconds, seconds * 1e9 / records);
+    std::fflush(stdout);
+}
+
+
+/*
+ * Makes value observable, so the compiler cannot drop the loop that
+ * produces it (e.g. for the null backend, whose Print does nothing).
+ */
+template<class T>
+inline void bench_escape(T &value) {
+#ifdef _MSC_VER
+    static volatile const void *sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "g"(&value) : "memory");
+#endif
+}
+
+
+/* Indices in [0, n), either uniform or Zipf distributed with exponent s. */
+inline void bench_indices(std::vector<size_t> &out, const size_t count, const size_t n, const double s,
+    const unsigned int seed = 42) {
+    std::mt19937_64 rng(seed);
+    out.resize(count);
+    if (s <= 0.0) {
+        std::uniform_int_distribution<size_t> dist(0, n - 1);
+        for (size_t i = 0; i < count; i++) {
+            out[i] = dist(rng);
+        }
+        return;
+    }
+
+    std::vector<double> cdf(n);
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+        cdf[i] = sum;
+    }
+    std::uniform_real_distribution<double> dist(0.0, sum);
+    for (size_t i = 0; i < count; i++) {
+        out[i] = std::min(static_cast<size_t>(std::lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin()), n - 1);
+    }
+}
+
+
+/*
+ * Synthetic trace: memref_share of the records are loads/stores (a third
+ * of them writes), the rest calls and returns. Instructions are drawn from
+ * pcs distinct addresses with Zipf exponent s.
+ */
+inline void bench_trace(thr_trc_str &trace, const size_t count, const double memref_share,
+    const size_t pcs, const double s) {
+    std::vector<size_t> idx;
+    bench_indices(idx, count, pcs, s);
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+    trace.resize(count);
+    uint64_t data = 0x10000000;
+    for (size_t i = 0; i < count; i++) {
+        trace_ref_t &r = trace[i];
+        r.instr_addr = reinterpret_cast<unsigned char *>(0x400000 + idx[i] * 16);
+        r.target_addr = NULL;
+        r.data_addr = NULL;
+        r.size = 0;
+        r.is_write = r.is_call = r.is_ind = 0;
+        if (coin(rng) < memref_share) {
+            r.is_mem_ref = 1;
+            r.is_write = (i % 3) == 0;
+            r.size = 8;
+            data += 8;
+            r.data_addr = reinterpret_cast<void *>(data);
+        } else {
+            r.is_mem_ref = 0;
+            r.is_call = (i & 1);
+            r.is_ind = (i % 8) == 1;
+            r.target_addr = reinterpret_cast<unsigned char *>(0x400000 + idx[count - 1 - i] * 16);
+        }
+    }
+}
+
+#endif // end ifndef REGINA_BENCH_H_INCLUDED
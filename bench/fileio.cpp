@@ -0,0 +1,85 @@
+/*
+ * Throughput of the output backends (binary, text, compressed and null),
+ * on streams of only memory references and only calls/returns.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "fileio.h"
+
+
+template<class FileIOType, class Output>
+static void bench_mem(const char *name, FileIOType &filer, Output *out, const size_t count) {
+    typename FileIOType::Super::MemRef_t mrt;
+    mrt.instrSym = "app.exe#compute";
+    mrt.symIdx = 17;
+    mrt.instr = reinterpret_cast<void *>(0x401000);
+
+    BenchTimer timer;
+    for (size_t i = 0; i < count; i++) {
+        mrt.is_write = (i & 3) == 0;
+        mrt.size = 8;
+        mrt.data = reinterpret_cast<void *>(0x10000000 + i * 8);
+        filer.Print(out, FileIOType::Super::RefType::MemRef, &mrt);
+        bench_escape(mrt);
+    }
+    bench_report(name, count, timer.Seconds());
+}
+
+
+template<class FileIOType, class Output>
+static void bench_callret(const char *name, FileIOType &filer, Output *out, const size_t count) {
+    typename FileIOType::Super::CallRetRef_t crt;
+    crt.instrSym = "app.exe#main";
+    crt.targetSym = "app.exe#compute";
+    crt.instrSymIdx = 3;
+    crt.targetSymIdx = 17;
+
+    BenchTimer timer;
+    for (size_t i = 0; i < count; i++) {
+        crt.instr = reinterpret_cast<void *>(0x401000 + (i & 0xff));
+        crt.target = reinterpret_cast<void *>(0x402000 + (i & 0xff));
+        filer.Print(out, (i & 1) ? FileIOType::Super::RefType::CallRef : FileIOType::Super::RefType::RetRef, &crt);
+        bench_escape(crt);
+    }
+    bench_report(name, count, timer.Seconds());
+}
+
+
+int main(int argc, char **argv) {
+    const size_t count = argc > 1 ? std::stoull(argv[1]) : 10000000;
+
+    FileIO<true, true> binary;
+    FileIO<true, false> text;
+
+    bench_header();
+
+    FILE *f = std::fopen(BENCH_NULL_DEVICE, "wb");
+    bench_mem("binary_file_mem", binary, f, count);
+    bench_callret("binary_file_callret", binary, f, count);
+    bench_mem("text_file_mem", text, f, count / 10);
+    bench_callret("text_file_callret", text, f, count / 10);
+    std::fclose(f);
+
+    // Through ChunkedFile, i.e. including the chunk index.
+    ChunkedFile chunked;
+    chunked.Open(BENCH_NULL_DEVICE, 0, 0);
+    bench_mem("binary_chunked_mem", binary, &chunked, count);
+    bench_callret("binary_chunked_callret", binary, &chunked, count);
+    chunked.Close();
+
+    CompressedFileIO compressed;
+    chunked.Open(BENCH_NULL_DEVICE, 0, 0, MMTRD_DEFAULT_CHUNK_SIZE, MMTRD_CHUNK_DELTA);
+    bench_mem("compressed_chunked_mem", compressed, &chunked, count);
+    bench_callret("compressed_chunked_callret", compressed, &chunked, count);
+    chunked.Close();
+
+    NullFileIO null;
+    bench_mem("null_mem", null, &chunked, count);
+    bench_callret("null_callret", null, &chunked, count);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * The batch flush of cb_mem_ref (trace_flush) on synthetic traces: record
+ * conversion, symbol interning and binary output through ChunkedFile. The
+ * symbolizer is replaced by a table lookup, so drsyms is not measured.
+ */
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "fileio.h"
+#include "symbol_table.h"
+#include "trace_flush.h"
+
+
+static std::unordered_map<unsigned char *, std::string> pc_names;
+static SymbolTable symbols;
+
+
+static size_t intern(unsigned char *pc, std::string *name) {
+    auto it = pc_names.find(pc);
+    if (it == pc_names.end()) {
+        it = pc_names.insert(std::make_pair(pc, "app.exe#func_" + std::to_string(pc_names.size()))).first;
+    }
+    if (name != NULL) {
+        *name = it->second;
+    }
+    bool inserted;
+    return symbols.Intern(it->second, inserted);
+}
+
+
+static void bench_flush(const char *name, const thr_trc_str &trace) {
+    FileIO<true, true> filer;
+    ChunkedFile out;
+    out.Open(BENCH_NULL_DEVICE, 0, 0);
+
+    FlushBatch flush;
+    thr_trc_str batch;
+    batch.reserve(BENCH_BATCH);
+    BenchTimer timer;
+    for (size_t i = 0; i < trace.size(); i += BENCH_BATCH) {
+        const size_t end = std::min(trace.size(), i + BENCH_BATCH);
+        batch.assign(trace.begin() + i, trace.begin() + end);
+        out.BeginBatch(i);
+        trace_flush(batch, filer, &out, intern, flush);
+        out.EndBatch();
+    }
+    bench_report(name, trace.size(), timer.Seconds());
+    out.Close();
+}
+
+
+int main(int argc, char **argv) {
+    const size_t count = argc > 1 ? std::stoull(argv[1]) : 5000000;
+
+    bench_header();
+
+    thr_trc_str trace;
+    bench_trace(trace, count, 1.0, 1024, 1.1);
+    bench_flush("flush_mem_zipf", trace);
+    bench_trace(trace, count, 0.9, 1024, 1.1);
+    bench_flush("flush_mixed_zipf", trace);
+    bench_trace(trace, count, 0.9, 65536, 0.0);
+    bench_flush("flush_mixed_uniform", trace);
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Slowdown of regina over thread counts: runs a workload natively and under
+ * drrun with 1, 2, 4 ... threads (the workload takes the thread count as its
+ * first argument, see test/) and prints one line per count:
+ *   <threads>|<native s>|<regina s>|<slowdown>|<speedup>|<output bytes>|<output MB/s>
+ * speedup is the regina run with 1 thread over the run with n threads; where
+ * it stops growing while the native run still scales, the client is the
+ * bottleneck. Times are the best of -runs runs. Each count writes to a
+ * directory regina_scaling.<n> of its own.
+ *
+ * Usage: bench_scaling [-threads <max>] [-runs <n>] <drrun> <regina.dll> <workload> [regina option...]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "bench.h"
+
+
+static double run(const std::string &cmd, const size_t runs) {
+#ifdef _WIN32
+    // cmd.exe strips the outer quotes of the whole line.
+    const std::string line = "\"" + cmd + " > NUL\"";
+#else
+    const std::string line = cmd + " > " BENCH_NULL_DEVICE;
+#endif
+    double best = -1.0;
+    for (size_t r = 0; r < runs; r++) {
+        BenchTimer timer;
+        if (std::system(line.c_str()) != 0) {
+            std::fprintf(stderr, "Failed: %s\n", cmd.c_str());
+            return -1.0;
+        }
+        const double seconds = timer.Seconds();
+        best = (best < 0.0 || seconds < best) ? seconds : best;
+    }
+    return best;
+}
+
+
+static uint64_t file_size(const std::string &path) {
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    std::fseek(f, 0, SEEK_END);
+    const long size = std::ftell(f);
+    std::fclose(f);
+    return (size > 0) ? static_cast<uint64_t>(size) : 0;
+}
+
+
+/* Bytes of the traces of a run: container, per-thread files and symbols. */
+static uint64_t output_bytes(const std::string &dir) {
+    uint64_t bytes = file_size(dir + "/regina.mmtrd") + file_size(dir + "/regina.0.mmtrd.txt");
+    char name[64];
+    for (int t = 0; ; t++) {
+        std::snprintf(name, sizeof(name), "/regina.%d.mmtrd", t);
+        uint64_t size = file_size(dir + name);
+        std::snprintf(name, sizeof(name), "/regina.%d.txt", t);
+        size += file_size(dir + name);
+        if (size == 0) {
+            return bytes;
+        }
+        bytes += size;
+    }
+}
+
+
+int main(int argc, char **argv) {
+    size_t max_threads = std::thread::hardware_concurrency();
+    size_t runs = 3;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if (std::strcmp(argv[arg], "-threads") == 0) {
+            max_threads = std::strtoul(argv[arg + 1], NULL, 0);
+        } else if (std::strcmp(argv[arg], "-runs") == 0) {
+            runs = std::strtoul(argv[arg + 1], NULL, 0);
+        } else {
+            break;
+        }
+    }
+    if (argc - arg < 3 || max_threads == 0 || runs == 0) {
+        std::fprintf(stderr, "Usage: %s [-threads <max>] [-runs <n>] <drrun> <regina.dll> <workload> [regina option...]\n", argv[0]);
+        return 1;
+    }
+    const std::string drrun = argv[arg], client = argv[arg + 1], workload = argv[arg + 2];
+    std::string options;
+    for (arg += 3; arg < argc; arg++) {
+        options += std::string(" ") + argv[arg];
+    }
+
+    std::vector<size_t> counts;
+    for (size_t t = 1; t < max_threads; t *= 2) {
+        counts.push_back(t);
+    }
+    counts.push_back(max_threads);
+
+    std::printf("# threads|native s|regina s|slowdown|speedup|output bytes|output MB/s\n");
+    double first = 0.0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        const std::string n = std::to_string(counts[i]);
+        const std::string dir = "regina_scaling." + n;
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+        const double native = run("\"" + workload + "\" " + n, runs);
+        const double regina = run("\"" + drrun + "\" -c \"" + client + "\" -out_dir " + dir + options
+            + " -- \"" + workload + "\" " + n, runs);
+        if (native <= 0.0 || regina <= 0.0) {
+            return 1;
+        }
+        first = (i == 0) ? regina : first;
+        const uint64_t bytes = output_bytes(dir);
+        std::printf("%llu|%.3f|%.3f|%.1f|%.2f|%llu|%.1f\n", static_cast<unsigned long long>(counts[i]),
+            native, regina, regina / native, first / regina, static_cast<unsigned long long>(bytes),
+            bytes / regina / (1024.0 * 1024.0));
+        std::fflush(stdout);
+    }
+    return 0;
+}
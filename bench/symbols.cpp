@@ -0,0 +1,104 @@
+/*
+ * Cost of resolving symbol indices for uniform and skewed distributions:
+ * interning the names (SymbolTable, the path taken with -lines) and the
+ * cached lookup in the symbol ranges of a module (SymbolRanges).
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "symbol_ranges.h"
+#include "symbol_table.h"
+
+
+static void bench_intern(const char *name, const std::vector<std::string> &names,
+    const std::vector<size_t> &idx) {
+    SymbolTable table;
+    bool inserted;
+    size_t sum = 0;
+
+    BenchTimer timer;
+    for (size_t i = 0; i < idx.size(); i++) {
+        sum += table.Intern(names[idx[i]], inserted);
+    }
+    const double seconds = timer.Seconds();
+
+    bench_report(name, idx.size(), seconds);
+    if (sum == 0) {
+        std::printf("# %llu symbols\n", static_cast<unsigned long long>(table.Size()));
+    }
+}
+
+
+static void bench_ranges(const char *name, const std::vector<std::string> &names,
+    const std::vector<size_t> &idx) {
+    SymbolRanges ranges;
+    for (size_t i = 0; i < names.size(); i++) {
+        ranges.Add(i * 256, names[i].c_str());
+    }
+    ranges.Finalize();
+
+    // Offsets within the functions, precomputed like the trace would be.
+    std::vector<size_t> offs(idx.size());
+    for (size_t i = 0; i < idx.size(); i++) {
+        offs[i] = idx[i] * 256 + (i & 0xff);
+    }
+
+    SymbolTable table;
+    bool inserted;
+    size_t sum = 0;
+
+    BenchTimer timer;
+    for (size_t i = 0; i < offs.size(); i++) {
+        SymbolRanges::symbol_entry_t *entry = ranges.Lookup(offs[i]);
+        if (entry->id == SYMBOL_ID_NONE) {
+            entry->id = table.Intern(std::string("application.exe#") + ranges.Name(entry), inserted);
+        }
+        sum += entry->id;
+    }
+    const double seconds = timer.Seconds();
+
+    bench_report(name, offs.size(), seconds);
+    if (sum == 0) {
+        std::printf("# %llu symbols\n", static_cast<unsigned long long>(table.Size()));
+    }
+}
+
+
+int main(int argc, char **argv) {
+    const size_t count = argc > 1 ? std::stoull(argv[1]) : 10000000;
+    const size_t symbols[] = { 64, 4096, 262144 };
+
+    bench_header();
+
+    std::vector<size_t> idx;
+    for (size_t s = 0; s < sizeof(symbols) / sizeof(symbols[0]); s++) {
+        // Names as produced by translate_addr with -lines.
+        std::vector<std::string> names(symbols[s]);
+        for (size_t i = 0; i < names.size(); i++) {
+            names[i] = "application.exe#namespace::Class<T>::method_" + std::to_string(i) +
+                "#c:\\src\\file_" + std::to_string(i % 97) + ".cpp:" + std::to_string(i % 1000);
+        }
+
+        char name[64];
+        bench_indices(idx, count, names.size(), 0.0);
+        std::snprintf(name, sizeof(name), "intern_uniform_%llu", static_cast<unsigned long long>(names.size()));
+        bench_intern(name, names, idx);
+
+        bench_indices(idx, count, names.size(), 1.1);
+        std::snprintf(name, sizeof(name), "intern_zipf_%llu", static_cast<unsigned long long>(names.size()));
+        bench_intern(name, names, idx);
+
+        bench_indices(idx, count, names.size(), 0.0);
+        std::snprintf(name, sizeof(name), "ranges_uniform_%llu", static_cast<unsigned long long>(names.size()));
+        bench_ranges(name, names, idx);
+
+        bench_indices(idx, count, names.size(), 1.1);
+        std::snprintf(name, sizeof(name), "ranges_zipf_%llu", static_cast<unsigned long long>(names.size()));
+        bench_ranges(name, names, idx);
+    }
+
+    return 0;
+}
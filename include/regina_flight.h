@@ -0,0 +1,41 @@
+#ifndef REGINA_FLIGHT_H_INCLUDED
+#define REGINA_FLIGHT_H_INCLUDED
+
+/*
+ * Marker for regina's -flight option, included by the traced application.
+ * regina_flight() dumps the last records of all threads, reason ends up in
+ * regina.flight.txt (at most 63 characters). Without regina the call does
+ * nothing.
+ *
+ * Define REGINA_FLIGHT_IMPLEMENTATION in exactly one source file before
+ * including this header. regina looks the marker up in the export table,
+ * otherwise in the symbols of the module. Shared libraries export it, and
+ * so do executables built with MSVC; link executables with -rdynamic on
+ * gcc and clang, or do not strip them.
+ */
+
+#if defined(_MSC_VER)
+#define REGINA_FLIGHT_API __declspec(dllexport) __declspec(noinline)
+#else
+#define REGINA_FLIGHT_API __attribute__((visibility("default"), noinline))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+REGINA_FLIGHT_API void regina_flight(const char *reason);
+
+#ifdef REGINA_FLIGHT_IMPLEMENTATION
+volatile const char *regina_flight_last;
+
+REGINA_FLIGHT_API void regina_flight(const char *reason) {
+    regina_flight_last = reason;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // end ifndef REGINA_FLIGHT_H_INCLUDED
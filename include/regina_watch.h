@@ -0,0 +1,51 @@
+#ifndef REGINA_WATCH_H_INCLUDED
+#define REGINA_WATCH_H_INCLUDED
+
+#include <stddef.h>
+
+/*
+ * Markers for regina's -watch_marker option, included by the traced
+ * application. regina_watch() registers [addr, addr + size) as watch range,
+ * regina_unwatch() removes the range starting at addr. Without regina the
+ * calls do nothing.
+ *
+ * Define REGINA_WATCH_IMPLEMENTATION in exactly one source file before
+ * including this header. regina looks the markers up in the export table,
+ * otherwise in the symbols of the module. Shared libraries export them, and
+ * so do executables built with MSVC; link executables with -rdynamic on
+ * gcc and clang, or do not strip them.
+ */
+
+#if defined(_MSC_VER)
+#define REGINA_WATCH_API __declspec(dllexport) __declspec(noinline)
+#else
+#define REGINA_WATCH_API __attribute__((visibility("default"), noinline))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+REGINA_WATCH_API void regina_watch(const void *addr, size_t size);
+REGINA_WATCH_API void regina_unwatch(const void *addr);
+
+#ifdef REGINA_WATCH_IMPLEMENTATION
+/* Distinct bodies, so the linker cannot fold both markers into one. */
+volatile const void *regina_watch_last;
+volatile const void *regina_unwatch_last;
+
+REGINA_WATCH_API void regina_watch(const void *addr, size_t size) {
+    (void)size;
+    regina_watch_last = addr;
+}
+
+REGINA_WATCH_API void regina_unwatch(const void *addr) {
+    regina_unwatch_last = addr;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // end ifndef REGINA_WATCH_H_INCLUDED
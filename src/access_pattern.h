@@ -0,0 +1,259 @@
+#ifndef REGINA_ACCESS_PATTERN_H_INCLUDED
+#define REGINA_ACCESS_PATTERN_H_INCLUDED
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#define PATTERN_STRIDES 4
+#define PATTERN_CONFIDENCE 0.8
+#define PATTERN_SMALL_FOOTPRINT 256
+#define PATTERN_STREAMS 8
+#define PATTERN_STREAM_NEAR 0x1000
+#define PATTERN_STREAM_FAR 0x10000
+
+typedef enum _pattern_class_t {
+    PATTERN_SINGLE,         //< executed once
+    PATTERN_SEQUENTIAL,     //< stride equals the access size
+    PATTERN_STRIDED,        //< other constant stride
+    PATTERN_REUSE,          //< no dominant stride, small footprint
+    PATTERN_IRREGULAR
+} pattern_class_t;
+
+
+inline const char *pattern_class_name(const pattern_class_t c) {
+    switch (c) {
+    case PATTERN_SINGLE: return "single";
+    case PATTERN_SEQUENTIAL: return "sequential";
+    case PATTERN_STRIDED: return "strided";
+    case PATTERN_REUSE: return "reuse";
+    default: return "irregular";
+    }
+}
+
+
+/*
+ * Address stream of a single instruction. The strides between consecutive
+ * accesses are counted in a small space-saving table, so the dominant
+ * stride is found in constant memory per PC.
+ */
+typedef struct _pattern_t {
+    uint64_t count;
+    uint64_t stride_total;  //< strides seen, count less one per merged thread
+    uint64_t last_addr;
+    uint64_t min_addr;
+    uint64_t max_addr;
+    unsigned int size;
+    int64_t strides[PATTERN_STRIDES];
+    uint64_t stride_counts[PATTERN_STRIDES];
+
+    inline _pattern_t(void) : count(0), stride_total(0), last_addr(0), min_addr(UINT64_MAX), max_addr(0), size(0) {
+        for (int i = 0; i < PATTERN_STRIDES; i++) {
+            this->strides[i] = 0;
+            this->stride_counts[i] = 0;
+        }
+    }
+
+    inline void Access(const uint64_t addr, const unsigned int size) {
+        if (this->count > 0) {
+            this->addStride(static_cast<int64_t>(addr - this->last_addr), 1);
+            this->stride_total++;
+        }
+        this->count++;
+        this->last_addr = addr;
+        this->size = std::max(this->size, size);
+        this->min_addr = std::min(this->min_addr, addr);
+        this->max_addr = std::max(this->max_addr, addr + size);
+    }
+
+    /* Adds the statistics of the same PC in another thread. */
+    inline void Merge(const _pattern_t &rhs) {
+        for (int i = 0; i < PATTERN_STRIDES; i++) {
+            if (rhs.stride_counts[i] > 0) {
+                this->addStride(rhs.strides[i], rhs.stride_counts[i]);
+            }
+        }
+        this->count += rhs.count;
+        this->stride_total += rhs.stride_total;
+        this->size = std::max(this->size, rhs.size);
+        this->min_addr = std::min(this->min_addr, rhs.min_addr);
+        this->max_addr = std::max(this->max_addr, rhs.max_addr);
+    }
+
+    inline int DominantStride(void) const {
+        int best = 0;
+        for (int i = 1; i < PATTERN_STRIDES; i++) {
+            if (this->stride_counts[i] > this->stride_counts[best]) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    /* Share of the strides that equal the dominant one. */
+    inline double Confidence(void) const {
+        if (this->stride_total == 0) {
+            return 0.0;
+        }
+        return static_cast<double>(this->stride_counts[this->DominantStride()]) / static_cast<double>(this->stride_total);
+    }
+
+    inline uint64_t Footprint(void) const {
+        return (this->max_addr > this->min_addr) ? this->max_addr - this->min_addr : 0;
+    }
+
+    inline pattern_class_t Classify(void) const {
+        if (this->count < 2) {
+            return PATTERN_SINGLE;
+        }
+        const int64_t stride = this->strides[this->DominantStride()];
+        if (this->Confidence() >= PATTERN_CONFIDENCE && stride != 0) {
+            const uint64_t abs = static_cast<uint64_t>(stride < 0 ? -stride : stride);
+            return (abs == this->size) ? PATTERN_SEQUENTIAL : PATTERN_STRIDED;
+        }
+        if (this->Footprint() <= PATTERN_SMALL_FOOTPRINT) {
+            return PATTERN_REUSE;
+        }
+        return PATTERN_IRREGULAR;
+    }
+
+private:
+    inline void addStride(const int64_t stride, const uint64_t n) {
+        int min = 0;
+        for (int i = 0; i < PATTERN_STRIDES; i++) {
+            if (this->stride_counts[i] > 0 && this->strides[i] == stride) {
+                this->stride_counts[i] += n;
+                return;
+            }
+            if (this->stride_counts[i] < this->stride_counts[min]) {
+                min = i;
+            }
+        }
+        // Space saving: replace the least frequent stride.
+        this->strides[min] = stride;
+        this->stride_counts[min] += n;
+    }
+} pattern_t;
+
+
+/*
+ * Address streams of accesses that carry no PC, e.g. all references of a
+ * symbol in a .mmtrd trace. A function interleaves the arrays it walks, so
+ * the accesses are split the way a stream prefetcher does it: an access
+ * continues the nearest stream it is within reach of (PATTERN_STREAM_NEAR
+ * or twice the stream's stride), otherwise it starts a new stream. Once
+ * all streams are taken, it continues the nearest one within
+ * PATTERN_STREAM_FAR, which is how strides beyond PATTERN_STREAM_NEAR are
+ * learned, or replaces the least recently used. Arrays walked closer
+ * together than their stride share a stream, so this only approximates
+ * the per-PC patterns.
+ */
+typedef struct _pattern_streams_t {
+    pattern_t streams[PATTERN_STREAMS];
+    uint64_t used[PATTERN_STREAMS];     //< clock of the last access, 0 if free
+    pattern_t retired;                  //< streams replaced so far
+    uint64_t clock;
+
+    inline _pattern_streams_t(void) : clock(0) {
+        for (int i = 0; i < PATTERN_STREAMS; i++) {
+            this->used[i] = 0;
+        }
+    }
+
+    inline void Access(const uint64_t addr, const unsigned int size) {
+        int best = -1, nearest = -1, lru = 0;
+        uint64_t bestDistance = UINT64_MAX, nearestDistance = UINT64_MAX;
+        for (int i = 0; i < PATTERN_STREAMS; i++) {
+            if (this->used[i] < this->used[lru]) {
+                lru = i;
+            }
+            const pattern_t &s = this->streams[i];
+            if (s.count == 0) {
+                continue;
+            }
+            const uint64_t d = (addr > s.last_addr) ? addr - s.last_addr : s.last_addr - addr;
+            uint64_t reach = PATTERN_STREAM_NEAR;
+            if (s.stride_total > 0) {
+                const int64_t stride = s.strides[s.DominantStride()];
+                reach = std::max(reach, 2 * static_cast<uint64_t>(stride < 0 ? -stride : stride));
+            }
+            if (d <= reach && d < bestDistance) {
+                best = i;
+                bestDistance = d;
+            }
+            if (d <= PATTERN_STREAM_FAR && d < nearestDistance) {
+                nearest = i;
+                nearestDistance = d;
+            }
+        }
+        if (best < 0) {
+            best = (this->used[lru] == 0 || nearest < 0) ? lru : nearest;
+            if (best == lru && this->streams[lru].count > 0) {
+                this->retired.Merge(this->streams[lru]);
+                this->streams[lru] = pattern_t();
+            }
+        }
+        this->streams[best].Access(addr, size);
+        this->used[best] = ++this->clock;
+    }
+
+    /* All streams merged into one pattern. */
+    inline pattern_t Pattern(void) const {
+        pattern_t p = this->retired;
+        for (int i = 0; i < PATTERN_STREAMS; i++) {
+            if (this->streams[i].count > 0) {
+                p.Merge(this->streams[i]);
+            }
+        }
+        return p;
+    }
+} pattern_streams_t;
+
+
+/* Per-PC access patterns of one thread (or, after merging, all threads). */
+class AccessPatterns {
+public:
+    typedef std::unordered_map<uint64_t, pattern_t> map_t;
+
+    inline AccessPatterns(void) : lastPc(0), last(NULL) { }
+
+    inline void Access(const uint64_t pc, const uint64_t addr, const unsigned int size) {
+        // Loops interleave few PCs, so checking the previous one first pays off.
+        if (pc != this->lastPc || this->last == NULL) {
+            this->last = &this->patterns[pc];
+            this->lastPc = pc;
+        }
+        this->last->Access(addr, size);
+    }
+
+    inline void Merge(const AccessPatterns &rhs) {
+        for (auto it = rhs.patterns.begin(); it != rhs.patterns.end(); ++it) {
+            this->patterns[it->first].Merge(it->second);
+        }
+        this->last = NULL;
+    }
+
+    /* Returns the PCs ordered by execution count. */
+    inline void Sorted(std::vector<std::pair<uint64_t, const pattern_t *>> &out) const {
+        out.clear();
+        for (auto it = this->patterns.begin(); it != this->patterns.end(); ++it) {
+            out.push_back(std::make_pair(it->first, &it->second));
+        }
+        std::sort(out.begin(), out.end(), [](const std::pair<uint64_t, const pattern_t *> &a,
+            const std::pair<uint64_t, const pattern_t *> &b) {
+            return a.second->count > b.second->count;
+        });
+    }
+
+    AccessPatterns(const AccessPatterns &rhs) = delete;
+
+    AccessPatterns &operator=(const AccessPatterns &rhs) = delete;
+
+private:
+    map_t patterns;
+    uint64_t lastPc;
+    pattern_t *last;
+};
+
+#endif // end ifndef REGINA_ACCESS_PATTERN_H_INCLUDED
@@ -0,0 +1,73 @@
+#ifndef REGINA_BBV_H_INCLUDED
+#define REGINA_BBV_H_INCLUDED
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Basic-block vectors. Each instrumented block gets a slot; a thread's
+ * counter of the slot is increased inline by the number of instructions of
+ * the block whenever it runs, so at the end of an interval the counters
+ * hold the instructions executed per block (the vector SimPoint clusters).
+ */
+typedef struct _bbv_interval_t {
+    uint32_t thread_idx;
+    uint64_t index;         //< interval within the thread
+    uint64_t instrs;        //< instructions executed in the interval
+    std::vector<std::pair<uint32_t, uint64_t> > counts;     //< non-zero slots
+} bbv_interval_t;
+
+
+/*
+ * Registry of counted blocks, keyed by their first application pc. Slots
+ * are assigned at translation time and stay valid for the whole run. Not
+ * synchronized.
+ */
+class BlockSlots {
+public:
+    inline void Init(const size_t capacity) {
+        this->capacity = capacity;
+    }
+
+    /* Returns the slot of the block or -1 if the registry is full. */
+    inline int Assign(const uint64_t pc) {
+        auto it = this->lookup.find(pc);
+        if (it != this->lookup.end()) {
+            return it->second;
+        }
+        if (this->lookup.size() >= this->capacity) {
+            return -1;
+        }
+        const int slot = static_cast<int>(this->lookup.size());
+        this->lookup.insert(std::make_pair(pc, slot));
+        return slot;
+    }
+
+    inline size_t Capacity(void) const {
+        return this->capacity;
+    }
+
+    inline size_t Size(void) const {
+        return this->lookup.size();
+    }
+
+private:
+    size_t capacity;
+    std::unordered_map<uint64_t, int> lookup;
+};
+
+
+/* Moves the non-zero counters into an interval and clears them. */
+inline void bbv_collect(uint64_t *counts, const size_t slots, bbv_interval_t &out) {
+    out.counts.clear();
+    for (size_t i = 0; i < slots; i++) {
+        if (counts[i] != 0) {
+            out.counts.push_back(std::make_pair(static_cast<uint32_t>(i), counts[i]));
+            counts[i] = 0;
+        }
+    }
+}
+
+#endif // end ifndef REGINA_BBV_H_INCLUDED
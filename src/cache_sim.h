@@ -0,0 +1,91 @@
+#ifndef REGINA_CACHE_SIM_H_INCLUDED
+#define REGINA_CACHE_SIM_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+
+#define CACHE_SIM_DEFAULT_SIZE (32 * 1024)
+#define CACHE_SIM_DEFAULT_WAYS 8
+#define CACHE_SIM_LINE_SIZE 64
+
+/*
+ * Set-associative cache with LRU replacement, for counting the misses of
+ * a recorded address stream. The number of sets is rounded down to a power
+ * of two. Not synchronized.
+ */
+class CacheSim {
+public:
+    inline CacheSim(const size_t size = CACHE_SIM_DEFAULT_SIZE, const unsigned int ways = CACHE_SIM_DEFAULT_WAYS) :
+        ways(ways > 0 ? ways : 1), clock(0) {
+        size_t sets = 1;
+        while (sets * 2 * this->ways * CACHE_SIM_LINE_SIZE <= size) {
+            sets *= 2;
+        }
+        this->setMask = sets - 1;
+        this->tags.assign(sets * this->ways, UINT64_MAX);
+        this->stamps.assign(sets * this->ways, 0);
+        this->dirty.assign(sets * this->ways, 0);
+    }
+
+    /* Returns the number of lines of [addr, addr + size) that missed. */
+    inline unsigned int Access(const uint64_t addr, const unsigned int size) {
+        const uint64_t first = addr / CACHE_SIM_LINE_SIZE;
+        const uint64_t last = (addr + (size > 0 ? size - 1 : 0)) / CACHE_SIM_LINE_SIZE;
+        unsigned int misses = 0;
+        for (uint64_t line = first; line <= last; line++) {
+            misses += this->accessLine(line) ? 0 : 1;
+        }
+        return misses;
+    }
+
+    /*
+     * Write-back variant: writes mark their lines dirty, writebacks is
+     * increased by the dirty lines evicted to make room.
+     */
+    inline unsigned int Access(const uint64_t addr, const unsigned int size, const bool is_write,
+        unsigned int &writebacks) {
+        const uint64_t first = addr / CACHE_SIM_LINE_SIZE;
+        const uint64_t last = (addr + (size > 0 ? size - 1 : 0)) / CACHE_SIM_LINE_SIZE;
+        unsigned int misses = 0;
+        for (uint64_t line = first; line <= last; line++) {
+            misses += this->accessLine(line, is_write, writebacks) ? 0 : 1;
+        }
+        return misses;
+    }
+
+private:
+    inline bool accessLine(const uint64_t line) {
+        unsigned int writebacks = 0;
+        return this->accessLine(line, false, writebacks);
+    }
+
+    inline bool accessLine(const uint64_t line, const bool is_write, unsigned int &writebacks) {
+        const size_t base = static_cast<size_t>(line & this->setMask) * this->ways;
+        size_t victim = base;
+        this->clock++;
+        for (size_t i = base; i < base + this->ways; i++) {
+            if (this->tags[i] == line) {
+                this->stamps[i] = this->clock;
+                this->dirty[i] |= is_write ? 1 : 0;
+                return true;
+            }
+            if (this->stamps[i] < this->stamps[victim]) {
+                victim = i;
+            }
+        }
+        writebacks += this->dirty[victim];
+        this->tags[victim] = line;
+        this->stamps[victim] = this->clock;
+        this->dirty[victim] = is_write ? 1 : 0;
+        return false;
+    }
+
+    size_t ways;
+    uint64_t setMask;
+    uint64_t clock;
+    std::vector<uint64_t> tags;
+    std::vector<uint64_t> stamps;
+    std::vector<unsigned char> dirty;
+};
+
+#endif // end ifndef REGINA_CACHE_SIM_H_INCLUDED
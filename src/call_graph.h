@@ -0,0 +1,155 @@
+#ifndef REGINA_CALL_GRAPH_H_INCLUDED
+#define REGINA_CALL_GRAPH_H_INCLUDED
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Per-thread counter of a call site, indexed by the slot the site got when
+ * it was instrumented. The instrumentation increments count inline; for
+ * indirect calls only if the target matches the cached one.
+ */
+typedef struct _cg_slot_t {
+    uint64_t target;
+    uint64_t count;
+} cg_slot_t;
+
+
+typedef struct _cg_edge_t {
+    uint64_t caller;
+    uint64_t target;
+
+    inline bool operator==(const _cg_edge_t &rhs) const {
+        return this->caller == rhs.caller && this->target == rhs.target;
+    }
+} cg_edge_t;
+
+
+typedef struct _cg_edge_hash_t {
+    inline size_t operator()(const cg_edge_t &e) const {
+        return static_cast<size_t>((e.caller * 0x9E3779B97F4A7C15ull) ^ e.target);
+    }
+} cg_edge_hash_t;
+
+
+/*
+ * Registry of instrumented call sites. Slots are assigned at translation
+ * time and stay valid for the whole run, so re-translating a block reuses
+ * the slot of its call. Not synchronized.
+ */
+class CallSites {
+public:
+    typedef struct _site_t {
+        uint64_t caller;
+        uint64_t target;    //< 0 for indirect calls
+    } site_t;
+
+    inline void Init(const size_t capacity) {
+        this->capacity = capacity;
+        this->sites.reserve(capacity);
+    }
+
+    /* Returns the slot of the call site or -1 if the registry is full. */
+    inline int Assign(const uint64_t caller, const uint64_t target) {
+        auto it = this->lookup.find(caller);
+        if (it != this->lookup.end()) {
+            return it->second;
+        }
+        if (this->sites.size() >= this->capacity) {
+            return -1;
+        }
+        site_t site;
+        site.caller = caller;
+        site.target = target;
+        this->sites.push_back(site);
+        const int slot = static_cast<int>(this->sites.size() - 1);
+        this->lookup.insert(std::make_pair(caller, slot));
+        return slot;
+    }
+
+    inline size_t Capacity(void) const {
+        return this->capacity;
+    }
+
+    inline size_t Size(void) const {
+        return this->sites.size();
+    }
+
+    inline const site_t &Site(const size_t slot) const {
+        return this->sites[slot];
+    }
+
+private:
+    size_t capacity;
+    std::vector<site_t> sites;
+    std::unordered_map<uint64_t, int> lookup;
+};
+
+
+/* Weighted call edges. Not synchronized. */
+class CallGraph {
+public:
+    typedef struct _edge_count_t {
+        cg_edge_t edge;
+        bool indirect;
+        uint64_t count;
+    } edge_count_t;
+
+    inline void Add(const uint64_t caller, const uint64_t target, const bool indirect, const uint64_t count) {
+        cg_edge_t e;
+        e.caller = caller;
+        e.target = target;
+        auto it = this->edges.find(e);
+        if (it == this->edges.end()) {
+            edge_count_t c;
+            c.edge = e;
+            c.indirect = indirect;
+            c.count = count;
+            this->edges.insert(std::make_pair(e, c));
+        } else {
+            it->second.count += count;
+        }
+    }
+
+    /* Adds the counters of a thread; slots past sites.Size() are unused. */
+    inline void AddSlots(const CallSites &sites, const cg_slot_t *slots) {
+        for (size_t i = 0; i < sites.Size(); i++) {
+            if (slots[i].count == 0) {
+                continue;
+            }
+            const CallSites::site_t &site = sites.Site(i);
+            if (site.target != 0) {
+                this->Add(site.caller, site.target, false, slots[i].count);
+            } else {
+                this->Add(site.caller, slots[i].target, true, slots[i].count);
+            }
+        }
+    }
+
+    inline void Merge(const CallGraph &rhs) {
+        for (auto it = rhs.edges.begin(); it != rhs.edges.end(); ++it) {
+            this->Add(it->first.caller, it->first.target, it->second.indirect, it->second.count);
+        }
+    }
+
+    /* Returns the edges grouped by call site, hottest targets first. */
+    inline void Sorted(std::vector<edge_count_t> &out) const {
+        out.clear();
+        for (auto it = this->edges.begin(); it != this->edges.end(); ++it) {
+            out.push_back(it->second);
+        }
+        std::sort(out.begin(), out.end(), [](const edge_count_t &a, const edge_count_t &b) {
+            if (a.edge.caller != b.edge.caller) {
+                return a.edge.caller < b.edge.caller;
+            }
+            return a.count > b.count;
+        });
+    }
+
+private:
+    std::unordered_map<cg_edge_t, edge_count_t, cg_edge_hash_t> edges;
+};
+
+#endif // end ifndef REGINA_CALL_GRAPH_H_INCLUDED
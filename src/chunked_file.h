@@ -0,0 +1,265 @@
+#ifndef REGINA_CHUNKED_FILE_H_INCLUDED
+#define REGINA_CHUNKED_FILE_H_INCLUDED
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "mmtrd_format.h"
+#include "shm_ring.h"
+#include "trace_container.h"
+
+/*
+ * Per-thread .mmtrd output. Records are written unchanged through FileIO;
+ * ChunkedFile only keeps track of chunk boundaries and appends the chunk
+ * index and footer (see mmtrd_format.h) on Close().
+ *
+ * Opened on a ShmRing instead of a file, the records of a batch are
+ * collected and published as one frame by EndBatch(); no index is kept.
+ * Opened on a TraceContainer, the records of a chunk are collected and
+ * appended to the container as a whole, which keeps the index.
+ */
+class ChunkedFile {
+public:
+    inline ChunkedFile(void) :
+        f(NULL), ring(NULL), container(NULL), chunkSize(MMTRD_DEFAULT_CHUNK_SIZE), threadIdx(0), offset(0),
+        records(0), batchBegin(0), batchEnd(0), flags(0), pendingCount(0) { }
+
+    inline ~ChunkedFile(void) {
+        this->Close();
+    }
+
+    /* flags (MMTRD_CHUNK_*) describe the encoding of the records. */
+    bool Open(const char *filename, const int thread_idx, const uint64_t timestamp,
+        const uint32_t chunk_size = MMTRD_DEFAULT_CHUNK_SIZE, const uint32_t flags = 0);
+
+    /* Streams to a ring instead, the ring is not owned. */
+    bool Open(ShmRing *ring, const int thread_idx, const uint64_t timestamp);
+
+    /* Writes the chunks to a container shared by all threads, which is not owned. */
+    bool Open(TraceContainer *container, const int thread_idx, const uint64_t timestamp,
+        const uint32_t chunk_size = MMTRD_DEFAULT_CHUNK_SIZE, const uint32_t flags = 0);
+
+    void Close(void);
+
+    /* Marks the start of a flushed batch of records at the given time. */
+    inline void BeginBatch(const uint64_t timestamp) {
+        this->batchBegin = this->batchEnd;
+        this->batchEnd = timestamp;
+    }
+
+    /* Publishes the records collected since the last call (ring only). */
+    inline void EndBatch(void) {
+        if (this->ring != NULL && this->pendingCount > 0) {
+            this->ring->Write(SHM_FRAME_RECORDS, this->threadIdx, this->records - this->pendingCount,
+                this->pendingCount, this->pending.data(), this->pending.size());
+            this->pending.clear();
+            this->pendingCount = 0;
+        }
+    }
+
+    /* Discards the records collected since the last call, they count as dropped (ring only). */
+    inline void DropBatch(void) {
+        if (this->ring != NULL && this->pendingCount > 0) {
+            this->ring->Drop(this->pendingCount);
+            this->pending.clear();
+            this->pendingCount = 0;
+        }
+    }
+
+    /* Writes and accounts an encoded record. */
+    inline void Write(const unsigned char *record, const size_t bytes, const bool is_mem, const uint64_t data_addr) {
+        if (this->ring != NULL) {
+            this->pending.insert(this->pending.end(), record, record + bytes);
+            this->pendingCount++;
+            this->Account(bytes, is_mem, data_addr);
+        } else if (this->container != NULL) {
+            this->pending.insert(this->pending.end(), record, record + bytes);
+            this->Account(bytes, is_mem, data_addr);
+        } else {
+            std::fwrite(record, bytes, 1, this->f);
+            this->Account(bytes, is_mem, data_addr);
+        }
+    }
+
+    /* Accounts a record of the given size that has just been written. */
+    inline void Account(const size_t bytes, const bool is_mem, const uint64_t data_addr) {
+        if (this->chunk.record_count == 0) {
+            this->chunk.ts_begin = this->batchBegin;
+        }
+        this->chunk.ts_end = this->batchEnd;
+        if (is_mem) {
+            if (data_addr < this->chunk.min_addr) {
+                this->chunk.min_addr = data_addr;
+            }
+            if (data_addr > this->chunk.max_addr) {
+                this->chunk.max_addr = data_addr;
+            }
+        }
+        this->chunk.size += bytes;
+        this->chunk.record_count++;
+        this->offset += bytes;
+        this->records++;
+
+        if (this->chunk.size >= this->chunkSize) {
+            this->closeChunk();
+        }
+    }
+
+    inline FILE *File(void) const {
+        return this->f;
+    }
+
+    inline ShmRing *Ring(void) const {
+        return this->ring;
+    }
+
+    /* Encoder state of a delta encoded chunk, reset with every chunk. */
+    inline mmtrd_delta_t &Delta(void) {
+        return this->delta;
+    }
+
+    ChunkedFile(const ChunkedFile &rhs) = delete;
+
+    ChunkedFile &operator=(const ChunkedFile &rhs) = delete;
+
+private:
+    inline void closeChunk(void) {
+        if (this->chunk.record_count > 0 && this->f != NULL) {
+            this->index.push_back(this->chunk);
+        } else if (this->chunk.record_count > 0 && this->container != NULL) {
+            this->container->Append(this->chunk, this->pending.data());
+            this->pending.clear();
+        }
+        this->initChunk();
+    }
+
+    inline void initChunk(void) {
+        mmtrd_chunk_init(this->chunk, this->offset, this->records, this->threadIdx);
+        this->chunk.flags = this->flags;
+        mmtrd_delta_init(this->delta);
+    }
+
+    FILE *f;
+    ShmRing *ring;
+    TraceContainer *container;
+    uint32_t chunkSize;
+    uint32_t threadIdx;
+    uint64_t offset;
+    uint64_t records;
+    uint64_t batchBegin;
+    uint64_t batchEnd;
+    uint32_t flags;
+    mmtrd_chunk_t chunk;
+    mmtrd_delta_t delta;
+    std::vector<mmtrd_chunk_t> index;
+    std::vector<unsigned char> pending;
+    uint32_t pendingCount;
+};
+
+
+inline bool ChunkedFile::Open(const char *filename, const int thread_idx, const uint64_t timestamp,
+    const uint32_t chunk_size, const uint32_t flags) {
+    this->Close();
+
+    this->f = std::fopen(filename, "wb");
+    if (this->f == NULL) {
+        return false;
+    }
+
+    this->chunkSize = chunk_size;
+    this->flags = flags;
+    this->threadIdx = static_cast<uint32_t>(thread_idx);
+    this->offset = 0;
+    this->records = 0;
+    this->batchBegin = this->batchEnd = timestamp;
+    this->index.clear();
+    this->initChunk();
+
+    return true;
+}
+
+
+inline bool ChunkedFile::Open(ShmRing *ring, const int thread_idx, const uint64_t timestamp) {
+    this->Close();
+
+    this->ring = ring;
+    this->chunkSize = MMTRD_DEFAULT_CHUNK_SIZE;
+    this->flags = 0;
+    this->threadIdx = static_cast<uint32_t>(thread_idx);
+    this->offset = 0;
+    this->records = 0;
+    this->batchBegin = this->batchEnd = timestamp;
+    this->pending.reserve(1 << 16);
+    this->pendingCount = 0;
+    this->initChunk();
+
+    return true;
+}
+
+
+inline bool ChunkedFile::Open(TraceContainer *container, const int thread_idx, const uint64_t timestamp,
+    const uint32_t chunk_size, const uint32_t flags) {
+    this->Close();
+
+    this->container = container;
+    this->chunkSize = chunk_size;
+    this->flags = flags;
+    this->threadIdx = static_cast<uint32_t>(thread_idx);
+    this->offset = 0;
+    this->records = 0;
+    this->batchBegin = this->batchEnd = timestamp;
+    this->pending.clear();
+    this->initChunk();
+
+    return true;
+}
+
+
+inline void ChunkedFile::Close(void) {
+    if (this->ring != NULL) {
+        this->EndBatch();
+        this->ring = NULL;
+        return;
+    }
+
+    if (this->container != NULL) {
+        this->closeChunk();
+        this->container = NULL;
+        std::vector<unsigned char>().swap(this->pending);
+        return;
+    }
+
+    if (this->f == NULL) {
+        return;
+    }
+
+    this->closeChunk();
+
+    // Nothing has been accounted (e.g. text output), leave the file as is.
+    if (this->records == 0) {
+        std::fclose(this->f);
+        this->f = NULL;
+        return;
+    }
+
+    mmtrd_footer_t footer;
+    std::memset(&footer, 0, sizeof(footer));
+    footer.index_offset = this->offset;
+    footer.chunk_count = this->index.size();
+    footer.record_count = this->records;
+    footer.chunk_size = this->chunkSize;
+    footer.version = MMTRD_FORMAT_VERSION;
+    std::memcpy(footer.magic, MMTRD_FOOTER_MAGIC, sizeof(footer.magic));
+
+    if (!this->index.empty()) {
+        std::fwrite(this->index.data(), sizeof(mmtrd_chunk_t), this->index.size(), this->f);
+    }
+    std::fwrite(&footer, sizeof(footer), 1, this->f);
+
+    std::fclose(this->f);
+    this->f = NULL;
+    this->index.clear();
+}
+
+#endif // end ifndef REGINA_CHUNKED_FILE_H_INCLUDED
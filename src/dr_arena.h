@@ -0,0 +1,224 @@
+#ifndef REGINA_DR_ARENA_H_INCLUDED
+#define REGINA_DR_ARENA_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <stdint.h>
+
+#include "dr_api.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_GRANULE 16
+#define ARENA_CLASSES 16        //< pooled sizes up to ARENA_GRANULE * ARENA_CLASSES bytes
+
+/*
+ * Client memory that stays out of the application's heap. A DrArena is a
+ * per-thread pool on DR's thread heap: small requests are served from free
+ * lists per 16 byte size class, carved from 64 KiB blocks, larger ones go
+ * to dr_thread_alloc directly. The arena belongs to its thread and is not
+ * synchronized; all blocks are released when it is destroyed, at the latest
+ * at thread exit. Containers shared by threads use DR's global heap
+ * instead (an ArenaAllocator without arena).
+ */
+typedef struct _heap_stats_t {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes;         //< requested and not yet freed
+    uint64_t peak;          //< of bytes
+    uint64_t reserved;      //< taken from DR for blocks and large requests
+
+    inline _heap_stats_t(void) : allocations(0), frees(0), bytes(0), peak(0), reserved(0) { }
+
+    inline void Alloc(const size_t size) {
+        this->allocations++;
+        this->bytes += size;
+        this->peak = (this->bytes > this->peak) ? this->bytes : this->peak;
+    }
+
+    inline void Free(const size_t size) {
+        this->frees++;
+        this->bytes -= size;
+    }
+
+    /* Adds the statistics of an arena that is gone; peaks are summed. */
+    inline void Merge(const _heap_stats_t &rhs) {
+        this->allocations += rhs.allocations;
+        this->frees += rhs.frees;
+        this->bytes += rhs.bytes;
+        this->peak += rhs.peak;
+        this->reserved += rhs.reserved;
+    }
+} heap_stats_t;
+
+
+class DrArena {
+public:
+    inline DrArena(void *drcontext) : drcontext(drcontext), blocks(NULL), cursor(NULL), end(NULL) {
+        for (int i = 0; i < ARENA_CLASSES; i++) {
+            this->free[i] = NULL;
+        }
+    }
+
+    inline ~DrArena(void) {
+        while (this->blocks != NULL) {
+            block_t *next = this->blocks->next;
+            dr_thread_free(this->drcontext, this->blocks, ARENA_BLOCK_SIZE);
+            this->blocks = next;
+        }
+    }
+
+    inline void *Alloc(const size_t size) {
+        this->stats.Alloc(size);
+        if (size > ARENA_GRANULE * ARENA_CLASSES) {
+            this->stats.reserved += size;
+            return dr_thread_alloc(this->drcontext, size);
+        }
+        const size_t c = (size > 0) ? (size - 1) / ARENA_GRANULE : 0;
+        if (this->free[c] != NULL) {
+            free_t *p = this->free[c];
+            this->free[c] = p->next;
+            return p;
+        }
+        const size_t rounded = (c + 1) * ARENA_GRANULE;
+        if (this->cursor == NULL || this->cursor + rounded > this->end) {
+            block_t *block = static_cast<block_t *>(dr_thread_alloc(this->drcontext, ARENA_BLOCK_SIZE));
+            block->next = this->blocks;
+            this->blocks = block;
+            this->cursor = reinterpret_cast<char *>(block) + ARENA_GRANULE;
+            this->end = reinterpret_cast<char *>(block) + ARENA_BLOCK_SIZE;
+            this->stats.reserved += ARENA_BLOCK_SIZE;
+        }
+        void *p = this->cursor;
+        this->cursor += rounded;
+        return p;
+    }
+
+    inline void Free(void *p, const size_t size) {
+        this->stats.Free(size);
+        if (size > ARENA_GRANULE * ARENA_CLASSES) {
+            dr_thread_free(this->drcontext, p, size);
+            return;
+        }
+        const size_t c = (size > 0) ? (size - 1) / ARENA_GRANULE : 0;
+        free_t *f = static_cast<free_t *>(p);
+        f->next = this->free[c];
+        this->free[c] = f;
+    }
+
+    inline const heap_stats_t &Stats(void) const {
+        return this->stats;
+    }
+
+    DrArena(const DrArena &rhs) = delete;
+
+    DrArena &operator=(const DrArena &rhs) = delete;
+
+private:
+    typedef struct _block_t {
+        struct _block_t *next;  //< the first granule of a block is its header
+    } block_t;
+
+    typedef struct _free_t {
+        struct _free_t *next;
+    } free_t;
+
+    void *drcontext;
+    block_t *blocks;
+    char *cursor;
+    char *end;
+    free_t *free[ARENA_CLASSES];
+    heap_stats_t stats;
+};
+
+
+/* Statistics of the global DR heap used by the client; updated without locks. */
+typedef struct _global_heap_stats_t {
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> frees;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> peak;
+} global_heap_stats_t;
+
+
+inline global_heap_stats_t &dr_heap_global_stats(void) {
+    static global_heap_stats_t stats = { { 0 }, { 0 }, { 0 }, { 0 } };
+    return stats;
+}
+
+
+inline void *dr_heap_alloc(DrArena *arena, const size_t size) {
+    if (arena != NULL) {
+        return arena->Alloc(size);
+    }
+    global_heap_stats_t &stats = dr_heap_global_stats();
+    stats.allocations++;
+    const uint64_t bytes = (stats.bytes += size);
+    uint64_t peak = stats.peak.load();
+    while (bytes > peak && !stats.peak.compare_exchange_weak(peak, bytes)) { }
+    return dr_global_alloc(size);
+}
+
+
+inline void dr_heap_free(DrArena *arena, void *p, const size_t size) {
+    if (arena != NULL) {
+        arena->Free(p, size);
+        return;
+    }
+    global_heap_stats_t &stats = dr_heap_global_stats();
+    stats.frees++;
+    stats.bytes -= size;
+    dr_global_free(p, size);
+}
+
+
+/*
+ * STL allocator on an arena, or on DR's global heap without one. The
+ * arena travels with the container on moves and swaps, so a container
+ * filled by one thread can be moved around but must be emptied by that
+ * thread.
+ */
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template<class U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    inline ArenaAllocator(DrArena *arena = NULL) : arena(arena) { }
+
+    template<class U>
+    inline ArenaAllocator(const ArenaAllocator<U> &rhs) : arena(rhs.arena) { }
+
+    inline T *allocate(const size_t n) {
+        return static_cast<T *>(dr_heap_alloc(this->arena, n * sizeof(T)));
+    }
+
+    inline void deallocate(T *p, const size_t n) {
+        dr_heap_free(this->arena, p, n * sizeof(T));
+    }
+
+    template<class U>
+    inline bool operator==(const ArenaAllocator<U> &rhs) const {
+        return this->arena == rhs.arena;
+    }
+
+    template<class U>
+    inline bool operator!=(const ArenaAllocator<U> &rhs) const {
+        return this->arena != rhs.arena;
+    }
+
+    DrArena *arena;
+};
+
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > dr_string;
+
+#endif // end ifndef REGINA_DR_ARENA_H_INCLUDED
@@ -2,8 +2,12 @@
 #define REGINA_FILEIO_H_INCLUDED
 
 #include <cstdio>
+#include <cstring>
+#include <string>
+#include <stdint.h>
 
 #include "abstract_fileio.h"
+#include "chunked_file.h"
 
 template<bool writeOnly, bool binary>
 class FileIO : public AbstractFileIO<writeOnly, binary> {
@@ -31,6 +35,9 @@ class FileIO<writeOnly, false> : public AbstractFileIO<writeOnly, false> {
 public:
     typedef AbstractFileIO<writeOnly, false> Super;
 
+    /* Records carry the symbol strings. */
+    static const bool SymbolNames = true;
+
     inline FileIO() { };
 
     inline FileIO(const char *filename) :
@@ -48,33 +55,107 @@ public:
     }
 
     void Print(FILE *const f, const typename AbstractFileIO<writeOnly, false>::RefType refType, const void *ref);
+
+    /* Text traces are not indexed, records go straight to the file. */
+    inline void Print(ChunkedFile *const f, const typename AbstractFileIO<writeOnly, false>::RefType refType, const void *ref) {
+        this->Print(f->File(), refType, ref);
+    }
+};
+
+
+/*
+ * Line buffer for text records. Formats numbers by hand, which is much
+ * faster than fprintf and independent of the locale.
+ */
+class TextLine {
+public:
+    inline TextLine(FILE *const f) : f(f), n(0) { }
+
+    inline ~TextLine(void) {
+        this->Flush();
+    }
+
+    inline TextLine &Append(const char *str, const size_t len) {
+        if (this->n + len > sizeof(this->buf)) {
+            this->Flush();
+            if (len > sizeof(this->buf)) {
+                std::fwrite(str, 1, len, this->f);
+                return *this;
+            }
+        }
+        std::memcpy(this->buf + this->n, str, len);
+        this->n += len;
+        return *this;
+    }
+
+    inline TextLine &Append(const char *str) {
+        return this->Append(str, std::strlen(str));
+    }
+
+    inline TextLine &Append(const std::string &str) {
+        return this->Append(str.data(), str.size());
+    }
+
+    /* Pointers as 16 upper case hex digits, the same as %p on Windows. */
+    inline TextLine &AppendPtr(const void *ptr) {
+        static const char digits[] = "0123456789ABCDEF";
+        char tmp[16];
+        uint64_t v = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr));
+        for (int i = 15; i >= 0; i--) {
+            tmp[i] = digits[v & 0xf];
+            v >>= 4;
+        }
+        return this->Append(tmp, sizeof(tmp));
+    }
+
+    inline TextLine &AppendDec(unsigned int v) {
+        char tmp[10];
+        int i = sizeof(tmp);
+        do {
+            tmp[--i] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        return this->Append(tmp + i, sizeof(tmp) - i);
+    }
+
+    inline void Flush(void) {
+        if (this->n > 0) {
+            std::fwrite(this->buf, 1, this->n, this->f);
+            this->n = 0;
+        }
+    }
+
+private:
+    FILE *f;
+    size_t n;
+    char buf[512];
 };
 
 
 template<bool writeOnly>
 inline void FileIO<writeOnly, false>::Print(FILE *const f, const typename AbstractFileIO<writeOnly, false>::RefType refType, const void *ref) {
+    TextLine line(f);
+
     if (refType == Super::RefType::MemRef) {
         const typename Super::MemRef_t *memRef = reinterpret_cast<const typename Super::MemRef_t *>(ref);
 
-        if (memRef->is_write) {
-            std::fprintf(f, "MEM WRITE @ %p %s of size %d to %p\n", memRef->instr, memRef->instrSym.c_str(), memRef->size, memRef->data);
-        } else {
-            std::fprintf(f, "MEM READ @ %p %s of size %d to %p\n", memRef->instr, memRef->instrSym.c_str(), memRef->size, memRef->data);
-        }
+        line.Append(memRef->is_write ? "MEM WRITE @ " : "MEM READ @ ").AppendPtr(memRef->instr)
+            .Append(" ", 1).Append(memRef->instrSym).Append(" of size ").AppendDec(memRef->size)
+            .Append(" to ").AppendPtr(memRef->data).Append("\n", 1);
 
     } else {
         const typename Super::CallRetRef_t *callRef = reinterpret_cast<const typename Super::CallRetRef_t *>(ref);
 
         if (refType == Super::RefType::CallRef) {
-            std::fprintf(f, "CALL @ %p %s\n", callRef->instr, callRef->instrSym.c_str());
-            std::fprintf(f, "\t to %p %s\n", callRef->target, callRef->targetSym.c_str());
+            line.Append("CALL @ ");
         } else if (refType == Super::RefType::CallIndRef) {
-            std::fprintf(f, "CALL IND @ %p %s\n", callRef->instr, callRef->instrSym.c_str());
-            std::fprintf(f, "\t to %p %s\n", callRef->target, callRef->targetSym.c_str());
-        } else if (refType == Super::RefType::RetRef) {
-            std::fprintf(f, "RET @ %p %s\n", callRef->instr, callRef->instrSym.c_str());
-            std::fprintf(f, "\t to %p %s\n", callRef->target, callRef->targetSym.c_str());
+            line.Append("CALL IND @ ");
+        } else {
+            line.Append("RET @ ");
         }
+        line.AppendPtr(callRef->instr).Append(" ", 1).Append(callRef->instrSym)
+            .Append("\n\t to ").AppendPtr(callRef->target).Append(" ", 1).Append(callRef->targetSym)
+            .Append("\n", 1);
     }
 }
 
@@ -109,6 +190,8 @@ class FileIO<writeOnly, true> : public AbstractFileIO<writeOnly, true> {
 public:
     typedef AbstractFileIO<writeOnly, true> Super;
 
+    static const bool SymbolNames = false;
+
     inline FileIO() { };
 
     inline FileIO(const char *filename) :
@@ -125,67 +208,134 @@ public:
         return *this;
     }
 
+    /*
+     * Encodes a record in the .mmtrd layout (see mmtrd_format.h) into out,
+     * which must hold MMTRD_CALLRET_RECORD_SIZE bytes. Returns its size.
+     */
+    static size_t Encode(unsigned char *out, const typename AbstractFileIO<writeOnly, true>::RefType refType, const void *ref);
+
     void Print(FILE *const f, const typename AbstractFileIO<writeOnly, true>::RefType refType, const void *ref);
+
+    void Print(ChunkedFile *const f, const typename AbstractFileIO<writeOnly, true>::RefType refType, const void *ref);
 };
 
 
 template<bool writeOnly>
-inline void FileIO<writeOnly, true>::Print(FILE *const f, const typename AbstractFileIO<writeOnly, true>::RefType refType, const void *ref) {
+inline size_t FileIO<writeOnly, true>::Encode(unsigned char *out, const typename AbstractFileIO<writeOnly, true>::RefType refType, const void *ref) {
     if (refType == Super::RefType::MemRef) {
         const typename Super::MemRef_t *memRef = reinterpret_cast<const typename Super::MemRef_t *>(ref);
 
-        /*std::fwrite(&refType, sizeof(AbstractFileIO<writeOnly, true>::RefType), 1, f);
+        out[0] = 0; // type
         if (memRef->is_write) {
-            bool tmp = true;
-            std::fwrite(&tmp, sizeof(bool), 1, f);
+            out[1] = 1;
         } else {
-            bool tmp = false;
-            std::fwrite(&tmp, sizeof(bool), 1, f);
+            out[1] = 2;
         }
-        std::fwrite(&(memRef->instr), sizeof(size_t), 1, f);
-        std::fwrite(&(memRef->size), sizeof(unsigned int), 1, f);
-        std::fwrite(&(memRef->data), sizeof(size_t), 1, f);*/
+        std::memcpy(out + 2, &(memRef->data), sizeof(size_t));
+        out[10] = static_cast<unsigned char>(memRef->size);
+        std::memcpy(out + 11, &(memRef->symIdx), sizeof(size_t));
+        return MMTRD_MEM_RECORD_SIZE;
 
-        unsigned char type = 0; // type
-        std::fwrite(&type, sizeof(unsigned char), 1, f);
-        unsigned char memType;
-        if (memRef->is_write) {
-            memType = 1;
+    } else {
+        const typename Super::CallRetRef_t *callRef = reinterpret_cast<const typename Super::CallRetRef_t *>(ref);
+
+        out[0] = 1; // type
+        if (refType == Super::RefType::CallRef) {
+            out[1] = 0;
+        } else if (refType == Super::RefType::CallIndRef) {
+            out[1] = 1;
         } else {
-            memType = 2;
+            out[1] = 2;
         }
-        std::fwrite(&memType, sizeof(unsigned char), 1, f);
-        std::fwrite(&(memRef->data), sizeof(size_t), 1, f);
-        std::fwrite(&(memRef->size), sizeof(unsigned char), 1, f);
-        std::fwrite(&(memRef->symIdx), sizeof(size_t), 1, f);
+        std::memcpy(out + 2, &(callRef->instr), sizeof(size_t));
+        std::memcpy(out + 10, &(callRef->target), sizeof(size_t));
+        std::memcpy(out + 18, &(callRef->instrSymIdx), sizeof(size_t));
+        std::memcpy(out + 26, &(callRef->targetSymIdx), sizeof(size_t));
+        return MMTRD_CALLRET_RECORD_SIZE;
+    }
+}
+
 
+template<bool writeOnly>
+inline void FileIO<writeOnly, true>::Print(FILE *const f, const typename AbstractFileIO<writeOnly, true>::RefType refType, const void *ref) {
+    unsigned char record[MMTRD_CALLRET_RECORD_SIZE];
+    std::fwrite(record, FileIO::Encode(record, refType, ref), 1, f);
+}
+
+
+template<bool writeOnly>
+inline void FileIO<writeOnly, true>::Print(ChunkedFile *const f, const typename AbstractFileIO<writeOnly, true>::RefType refType, const void *ref) {
+    unsigned char record[MMTRD_CALLRET_RECORD_SIZE];
+    const size_t bytes = FileIO::Encode(record, refType, ref);
+    if (refType == Super::RefType::MemRef) {
+        const typename Super::MemRef_t *memRef = reinterpret_cast<const typename Super::MemRef_t *>(ref);
+        f->Write(record, bytes, true, reinterpret_cast<uint64_t>(memRef->data));
     } else {
-        const typename Super::CallRetRef_t *callRef = reinterpret_cast<const typename Super::CallRetRef_t *>(ref);
+        f->Write(record, bytes, false, 0);
+    }
+}
 
-        unsigned char type = 1; // type
-        std::fwrite(&type, sizeof(unsigned char), 1, f);
 
-        unsigned char subtype = 0;
+/*
+ * Binary records, delta encoded per chunk (see mmtrd_format.h). Smaller
+ * traces for the price of some encoding work.
+ */
+class CompressedFileIO : public AbstractFileIO<true, true> {
+public:
+    typedef AbstractFileIO<true, true> Super;
+
+    static const bool SymbolNames = false;
+
+    inline CompressedFileIO(void) { }
+
+    void Print(ChunkedFile *const f, const Super::RefType refType, const void *ref);
+};
+
+
+inline void CompressedFileIO::Print(ChunkedFile *const f, const Super::RefType refType, const void *ref) {
+    mmtrd_record_t rec;
+    if (refType == Super::RefType::MemRef) {
+        const Super::MemRef_t *memRef = reinterpret_cast<const Super::MemRef_t *>(ref);
+        rec.type = MMTRD_RECORD_MEM;
+        rec.subtype = memRef->is_write ? MMTRD_MEM_WRITE : MMTRD_MEM_READ;
+        rec.size = memRef->size;
+        rec.data = reinterpret_cast<uint64_t>(memRef->data);
+        rec.sym = memRef->symIdx;
+        rec.instr = rec.target = rec.target_sym = 0;
+    } else {
+        const Super::CallRetRef_t *callRef = reinterpret_cast<const Super::CallRetRef_t *>(ref);
+        rec.type = MMTRD_RECORD_CALLRET;
         if (refType == Super::RefType::CallRef) {
-            /*typename Super::RefType tmp = Super::RefType::CallRef;
-            std::fwrite(&tmp, sizeof(char), 1, f);*/
-            subtype = 0;
+            rec.subtype = MMTRD_CALL;
         } else if (refType == Super::RefType::CallIndRef) {
-            /*typename Super::RefType tmp = Super::RefType::CallIndRef;
-            std::fwrite(&tmp, sizeof(char), 1, f);*/
-            subtype = 1;
-        } else if (refType == Super::RefType::RetRef) {
-            /*typename Super::RefType tmp = Super::RefType::RetRef;
-            std::fwrite(&tmp, sizeof(char), 1, f);*/
-            subtype = 2;
+            rec.subtype = MMTRD_CALL_IND;
+        } else {
+            rec.subtype = MMTRD_RET;
         }
-        std::fwrite(&subtype, sizeof(unsigned char), 1, f);
-
-        std::fwrite(&(callRef->instr), sizeof(size_t), 1, f);
-        std::fwrite(&(callRef->target), sizeof(size_t), 1, f);
-        std::fwrite(&(callRef->instrSymIdx), sizeof(size_t), 1, f);
-        std::fwrite(&(callRef->targetSymIdx), sizeof(size_t), 1, f);
+        rec.instr = reinterpret_cast<uint64_t>(callRef->instr);
+        rec.target = reinterpret_cast<uint64_t>(callRef->target);
+        rec.sym = callRef->instrSymIdx;
+        rec.target_sym = callRef->targetSymIdx;
+        rec.size = 0;
+        rec.data = 0;
     }
+
+    unsigned char record[MMTRD_DELTA_MAX_RECORD_SIZE];
+    const size_t bytes = mmtrd_encode_delta(record, rec, f->Delta());
+    f->Write(record, bytes, rec.type == MMTRD_RECORD_MEM, rec.data);
 }
 
+
+/* Discards all records, for measuring the tracing overhead without I/O. */
+class NullFileIO : public AbstractFileIO<true, true> {
+public:
+    typedef AbstractFileIO<true, true> Super;
+
+    static const bool SymbolNames = false;
+
+    inline NullFileIO(void) { }
+
+    inline void Print(ChunkedFile *const /*f*/, const Super::RefType /*refType*/, const void * /*ref*/) { }
+};
+
 #endif
\ No newline at end of file
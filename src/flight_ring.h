@@ -0,0 +1,68 @@
+#ifndef REGINA_FLIGHT_RING_H_INCLUDED
+#define REGINA_FLIGHT_RING_H_INCLUDED
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+#include "trace_ref_t.h"
+
+/*
+ * The last records of a thread for -flight: a fixed number of slots that
+ * are overwritten oldest first. Batches are appended instead of written,
+ * so a thread neither allocates nor touches a file after its start. For
+ * trace_flush the ring reads like a vector, oldest record first. Not
+ * synchronized, one per thread; dumps copy it under the thread's lock.
+ */
+template<class Alloc = std::allocator<trace_ref_t> >
+class BasicFlightRing {
+public:
+    inline BasicFlightRing(const size_t capacity, const Alloc &alloc = Alloc()) :
+        records(capacity > 0 ? capacity : 1, trace_ref_t(), alloc), head(0), count(0), total(0) { }
+
+    /* Appends a batch; only its last Capacity() records are kept if it is larger. */
+    template<class Trace>
+    inline void Append(const Trace &trace) {
+        const size_t capacity = this->records.size();
+        const size_t skip = (trace.size() > capacity) ? trace.size() - capacity : 0;
+        for (size_t i = skip; i < trace.size(); i++) {
+            this->records[this->head] = trace[i];
+            this->head = (this->head + 1 < capacity) ? this->head + 1 : 0;
+        }
+        this->count = std::min(capacity, this->count + trace.size());
+        this->total += trace.size();
+    }
+
+    inline size_t size(void) const {
+        return this->count;
+    }
+
+    /* Record i of the ring, 0 is the oldest one. */
+    inline const trace_ref_t &operator[](const size_t i) const {
+        const size_t capacity = this->records.size();
+        const size_t pos = this->head + capacity - this->count + i;
+        return this->records[(pos < capacity) ? pos : pos - capacity];
+    }
+
+    inline size_t Capacity(void) const {
+        return this->records.size();
+    }
+
+    /* Records appended since the thread started, written or not. */
+    inline uint64_t Total(void) const {
+        return this->total;
+    }
+
+    BasicFlightRing(const BasicFlightRing &rhs) = delete;
+
+    BasicFlightRing &operator=(const BasicFlightRing &rhs) = delete;
+
+private:
+    std::vector<trace_ref_t, Alloc> records;
+    size_t head;    //< slot of the next record
+    size_t count;   //< valid records before head
+    uint64_t total;
+};
+
+#endif // end ifndef REGINA_FLIGHT_RING_H_INCLUDED
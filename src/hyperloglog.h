@@ -0,0 +1,108 @@
+#ifndef REGINA_HYPERLOGLOG_H_INCLUDED
+#define REGINA_HYPERLOGLOG_H_INCLUDED
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* 64 bit mixer (splitmix64 finalizer) used to hash keys for the sketch. */
+inline uint64_t hll_hash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+
+inline unsigned int hll_leading_zeros(const uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    return _BitScanReverse64(&idx, x) ? 63 - idx : 64;
+#else
+    return (x == 0) ? 64 : __builtin_clzll(x);
+#endif
+}
+
+
+/*
+ * HyperLogLog cardinality sketch with 2^precision one byte registers. The
+ * standard error is about 1.04 / sqrt(2^precision), memory is constant.
+ */
+class HyperLogLog {
+public:
+    inline HyperLogLog(const unsigned int precision = 12) :
+        precision(precision), registers(static_cast<size_t>(1) << precision, 0) { }
+
+    /* Adds an already hashed key. */
+    inline void Add(const uint64_t hash) {
+        const size_t idx = static_cast<size_t>(hash >> (64 - this->precision));
+        const uint64_t rest = (hash << this->precision) | (1ull << (this->precision - 1));
+        const unsigned char rank = static_cast<unsigned char>(hll_leading_zeros(rest) + 1);
+        if (rank > this->registers[idx]) {
+            this->registers[idx] = rank;
+        }
+    }
+
+    /* Union with a sketch of the same precision. */
+    inline void Merge(const HyperLogLog &rhs) {
+        for (size_t i = 0; i < this->registers.size(); i++) {
+            if (rhs.registers[i] > this->registers[i]) {
+                this->registers[i] = rhs.registers[i];
+            }
+        }
+    }
+
+    inline void Clear(void) {
+        std::memset(this->registers.data(), 0, this->registers.size());
+    }
+
+    double Estimate(void) const;
+
+    inline unsigned int Precision(void) const {
+        return this->precision;
+    }
+
+private:
+    unsigned int precision;
+    std::vector<unsigned char> registers;
+};
+
+
+inline double HyperLogLog::Estimate(void) const {
+    const double m = static_cast<double>(this->registers.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < this->registers.size(); i++) {
+        sum += std::ldexp(1.0, -static_cast<int>(this->registers[i]));
+        if (this->registers[i] == 0) {
+            zeros++;
+        }
+    }
+
+    double alpha;
+    if (this->registers.size() == 16) {
+        alpha = 0.673;
+    } else if (this->registers.size() == 32) {
+        alpha = 0.697;
+    } else if (this->registers.size() == 64) {
+        alpha = 0.709;
+    } else {
+        alpha = 0.7213 / (1.0 + 1.079 / m);
+    }
+
+    const double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        // Small range correction (linear counting).
+        return m * std::log(m / static_cast<double>(zeros));
+    }
+    return estimate;
+}
+
+#endif // end ifndef REGINA_HYPERLOGLOG_H_INCLUDED
@@ -0,0 +1,97 @@
+#ifndef REGINA_INSTR_MIX_H_INCLUDED
+#define REGINA_INSTR_MIX_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * Instruction mix and register usage of basic blocks. The static part of a
+ * block is computed once at translation time, executions are counted
+ * inline, and both are combined per function at the end of the run.
+ */
+typedef enum _mix_class_t {
+    MIX_INT,            //< general purpose and everything else
+    MIX_FP,             //< x87 and scalar SSE/AVX floating point
+    MIX_SIMD64,         //< MMX
+    MIX_SIMD128,        //< packed on xmm registers
+    MIX_SIMD256,        //< packed on ymm registers
+    MIX_BRANCH,         //< jumps, calls and returns
+    MIX_CLASSES
+} mix_class_t;
+
+
+inline const char *mix_class_name(const int c) {
+    switch (c) {
+    case MIX_INT: return "int";
+    case MIX_FP: return "fp";
+    case MIX_SIMD64: return "simd64";
+    case MIX_SIMD128: return "simd128";
+    case MIX_SIMD256: return "simd256";
+    default: return "branch";
+    }
+}
+
+
+/* Register bits: general purpose 0..15, xmm/ymm 16..31, mmx 32..39. */
+#define MIX_REG_GPR 0
+#define MIX_REG_SIMD 16
+#define MIX_REG_MMX 32
+
+inline unsigned int mix_popcount(uint64_t x) {
+    unsigned int n = 0;
+    for (; x != 0; x &= x - 1) {
+        n++;
+    }
+    return n;
+}
+
+
+typedef struct _block_mix_t {
+    uint64_t pc;
+    uint32_t instrs;
+    uint32_t classes[MIX_CLASSES];
+    uint32_t loads;         //< instructions reading memory
+    uint32_t stores;        //< instructions writing memory
+    uint32_t flops;         //< floating point operations, per vector element
+    uint64_t regs_read;
+    uint64_t regs_written;
+} block_mix_t;
+
+
+/* Dynamic mix of a function, the sum of its executed blocks. */
+typedef struct _function_mix_t {
+    uint64_t executions;    //< of blocks
+    uint64_t instrs;
+    uint64_t classes[MIX_CLASSES];
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t flops;
+    uint64_t block_regs;    //< registers used per block execution, summed
+    uint64_t regs;          //< registers used anywhere
+
+    inline _function_mix_t(void) : executions(0), instrs(0), loads(0), stores(0), flops(0), block_regs(0), regs(0) {
+        for (int i = 0; i < MIX_CLASSES; i++) {
+            this->classes[i] = 0;
+        }
+    }
+
+    inline void Add(const block_mix_t &b, const uint64_t count) {
+        const uint64_t used = b.regs_read | b.regs_written;
+        this->executions += count;
+        this->instrs += count * b.instrs;
+        for (int i = 0; i < MIX_CLASSES; i++) {
+            this->classes[i] += count * b.classes[i];
+        }
+        this->loads += count * b.loads;
+        this->stores += count * b.stores;
+        this->flops += count * b.flops;
+        this->block_regs += count * mix_popcount(used);
+        this->regs |= used;
+    }
+
+    /* Average number of registers a block of the function touches. */
+    inline double Pressure(void) const {
+        return (this->executions > 0) ? static_cast<double>(this->block_regs) / static_cast<double>(this->executions) : 0.0;
+    }
+} function_mix_t;
+
+#endif // end ifndef REGINA_INSTR_MIX_H_INCLUDED
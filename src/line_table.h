@@ -0,0 +1,84 @@
+#ifndef REGINA_LINE_TABLE_H_INCLUDED
+#define REGINA_LINE_TABLE_H_INCLUDED
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Line table of a single module, sorted by module offset. Each entry marks
+ * the start of a source line; an offset belongs to the closest entry below
+ * it. Built once per module, afterwards lookups are a binary search.
+ */
+class LineTable {
+public:
+    typedef struct _line_entry_t {
+        size_t offs;
+        uint32_t file;
+        uint32_t line;
+
+        inline bool operator<(const _line_entry_t &rhs) const {
+            return this->offs < rhs.offs;
+        }
+    } line_entry_t;
+
+    inline LineTable(void) { }
+
+    inline void Add(const size_t offs, const char *file, const uint64_t line) {
+        if (file == NULL) {
+            return;
+        }
+
+        uint32_t fileIdx;
+        auto it = this->fileLookup.find(file);
+        if (it != this->fileLookup.end()) {
+            fileIdx = it->second;
+        } else {
+            fileIdx = static_cast<uint32_t>(this->files.size());
+            this->files.push_back(file);
+            this->fileLookup.insert(std::make_pair(this->files.back(), fileIdx));
+        }
+
+        line_entry_t entry;
+        entry.offs = offs;
+        entry.file = fileIdx;
+        entry.line = static_cast<uint32_t>(line);
+        this->entries.push_back(entry);
+    }
+
+    /* Sorts the entries; must be called after the last Add(). */
+    inline void Finalize(void) {
+        std::stable_sort(this->entries.begin(), this->entries.end());
+        this->entries.erase(std::unique(this->entries.begin(), this->entries.end(),
+            [](const line_entry_t &l, const line_entry_t &r) { return l.offs == r.offs; }),
+            this->entries.end());
+        this->fileLookup.clear();
+    }
+
+    inline const line_entry_t *Lookup(const size_t offs) const {
+        line_entry_t key;
+        key.offs = offs;
+        auto it = std::upper_bound(this->entries.begin(), this->entries.end(), key);
+        if (it == this->entries.begin()) {
+            return NULL;
+        }
+        return &*(--it);
+    }
+
+    inline const std::string &File(const line_entry_t *entry) const {
+        return this->files[entry->file];
+    }
+
+    inline size_t Size(void) const {
+        return this->entries.size();
+    }
+
+private:
+    std::vector<line_entry_t> entries;
+    std::vector<std::string> files;
+    std::unordered_map<std::string, uint32_t> fileLookup;
+};
+
+#endif // end ifndef REGINA_LINE_TABLE_H_INCLUDED
@@ -0,0 +1,185 @@
+#ifndef REGINA_LOOP_TABLE_H_INCLUDED
+#define REGINA_LOOP_TABLE_H_INCLUDED
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include "access_pattern.h"
+#include "hyperloglog.h"
+
+#define LOOP_MAX_SPAN 0x10000   //< longest backward branch taken for a loop
+#define LOOP_PRECISION 10       //< of the distinct lines per loop
+#define LOOP_LINE_SIZE 64
+#define LOOP_COUNTERS 3         //< per loop: head executions, back edges taken, exits at the latch
+
+/*
+ * Loops found from backward branches: the target of a direct backward
+ * branch is the head, the loop extends to the end of the farthest branch
+ * back to it. A loop with several back edges (continue) is one loop.
+ */
+typedef struct _loop_t {
+    uint64_t head;
+    uint64_t end;           //< first byte after the last back edge
+} loop_t;
+
+
+/*
+ * Registry of loops, ids are assigned in order of discovery and stay valid
+ * for the whole run. Not synchronized.
+ */
+class LoopTable {
+public:
+    inline void Init(const size_t capacity) {
+        this->capacity = capacity;
+    }
+
+    /*
+     * Registers the back edge ending at end to head. Returns the id of the
+     * loop or -1 if the table is full; changed is set if the loop is new or
+     * grew.
+     */
+    inline int Add(const uint64_t head, const uint64_t end, bool &changed) {
+        changed = false;
+        auto it = this->byHead.find(head);
+        if (it != this->byHead.end()) {
+            loop_t &l = this->loops[it->second];
+            if (end > l.end) {
+                l.end = end;
+                changed = true;
+            }
+            return it->second;
+        }
+        if (this->loops.size() >= this->capacity) {
+            return -1;
+        }
+        loop_t l;
+        l.head = head;
+        l.end = end;
+        const int id = static_cast<int>(this->loops.size());
+        this->loops.push_back(l);
+        this->byHead.insert(std::make_pair(head, id));
+        changed = true;
+        return id;
+    }
+
+    /* Returns the loop starting at pc or -1. */
+    inline int Head(const uint64_t pc) const {
+        auto it = this->byHead.find(pc);
+        return (it != this->byHead.end()) ? it->second : -1;
+    }
+
+    /*
+     * Returns the innermost loop containing pc or -1. Nested loops start
+     * behind the loops around them, so that is the nearest head in front of
+     * pc whose loop reaches past it.
+     */
+    inline int Innermost(const uint64_t pc) const {
+        auto it = this->byHead.upper_bound(pc);
+        while (it != this->byHead.begin()) {
+            --it;
+            if (pc - it->first > LOOP_MAX_SPAN) {
+                break;
+            }
+            if (pc < this->loops[it->second].end) {
+                return it->second;
+            }
+        }
+        return -1;
+    }
+
+    inline const loop_t &Get(const int id) const {
+        return this->loops[id];
+    }
+
+    inline size_t Capacity(void) const {
+        return this->capacity;
+    }
+
+    inline size_t Size(void) const {
+        return this->loops.size();
+    }
+
+private:
+    size_t capacity;
+    std::vector<loop_t> loops;
+    std::map<uint64_t, int> byHead;
+};
+
+
+/* Memory references of the instructions whose innermost loop this is. */
+typedef struct _loop_stats_t {
+    uint64_t accesses;
+    uint64_t bytes;
+    HyperLogLog lines;
+    std::unordered_map<uint64_t, pattern_t> pcs;
+
+    inline _loop_stats_t(void) : accesses(0), bytes(0), lines(LOOP_PRECISION) { }
+
+    inline void Access(const uint64_t pc, const uint64_t addr, const unsigned int size) {
+        this->accesses++;
+        this->bytes += size;
+        this->lines.Add(hll_hash(addr / LOOP_LINE_SIZE));
+        this->pcs[pc].Access(addr, size);
+    }
+
+    inline void Merge(const _loop_stats_t &rhs) {
+        this->accesses += rhs.accesses;
+        this->bytes += rhs.bytes;
+        this->lines.Merge(rhs.lines);
+        for (auto it = rhs.pcs.begin(); it != rhs.pcs.end(); ++it) {
+            this->pcs[it->first].Merge(it->second);
+        }
+    }
+
+    /* The stream of the instruction with the most accesses, NULL without accesses. */
+    inline const pattern_t *Dominant(void) const {
+        const pattern_t *best = NULL;
+        for (auto it = this->pcs.begin(); it != this->pcs.end(); ++it) {
+            if (best == NULL || it->second.count > best->count) {
+                best = &it->second;
+            }
+        }
+        return best;
+    }
+} loop_stats_t;
+
+
+/* Statistics of all loops of a thread, keyed by loop id. */
+class LoopProfile {
+public:
+    inline LoopProfile(void) : lastId(-1), last(NULL) { }
+
+    inline void Access(const int id, const uint64_t pc, const uint64_t addr, const unsigned int size) {
+        if (id != this->lastId || this->last == NULL) {
+            this->last = &this->loops[id];
+            this->lastId = id;
+        }
+        this->last->Access(pc, addr, size);
+    }
+
+    inline void Merge(const LoopProfile &rhs) {
+        for (auto it = rhs.loops.begin(); it != rhs.loops.end(); ++it) {
+            this->loops[it->first].Merge(it->second);
+        }
+        this->last = NULL;
+    }
+
+    /* Returns NULL if the loop had no memory references. */
+    inline const loop_stats_t *Get(const int id) const {
+        auto it = this->loops.find(id);
+        return (it != this->loops.end()) ? &it->second : NULL;
+    }
+
+    LoopProfile(const LoopProfile &rhs) = delete;
+
+    LoopProfile &operator=(const LoopProfile &rhs) = delete;
+
+private:
+    std::unordered_map<int, loop_stats_t> loops;
+    int lastId;
+    loop_stats_t *last;
+};
+
+#endif // end ifndef REGINA_LOOP_TABLE_H_INCLUDED
@@ -0,0 +1,291 @@
+#ifndef REGINA_MMTRD_FORMAT_H_INCLUDED
+#define REGINA_MMTRD_FORMAT_H_INCLUDED
+
+#include <cstring>
+#include <stdint.h>
+
+/*
+ * On-disk layout of the binary .mmtrd trace.
+ *
+ * The file is a sequence of records as written by FileIO<writeOnly, true>,
+ * grouped into chunks of roughly MMTRD_DEFAULT_CHUNK_SIZE bytes. A chunk
+ * always ends on a record boundary, so every chunk can be decoded on its
+ * own. The file ends with the chunk index (one mmtrd_chunk_t per chunk)
+ * followed by a fixed-size mmtrd_footer_t. Files without a footer (older
+ * traces) are treated as a single chunk.
+ *
+ * Records (all integers little endian, pointers 64 bit):
+ *   mem:      u8 type = 0, u8 1 (write) / 2 (read), u64 data, u8 size, u64 sym
+ *   call/ret: u8 type = 1, u8 0 (call) / 1 (ind. call) / 2 (ret),
+ *             u64 instr, u64 target, u64 instr sym, u64 target sym
+ *
+ * Chunks flagged MMTRD_CHUNK_DELTA hold the same records delta encoded
+ * (-output compressed). The first byte packs type (bit 0), subtype (bits 1-2)
+ * and whether the symbol equals the previous one (bit 3), followed by LEB128
+ * varints; signed deltas are zigzag encoded:
+ *   mem:      u8 size, data - previous data, [sym]
+ *   call/ret: instr - previous instr, target - instr, [instr sym], target sym
+ * The previous values start at 0 in every chunk.
+ *
+ * A container (regina.mmtrd) holds the chunks of all threads of a process
+ * in the order they were completed. It starts with MMTRD_CONTAINER_MAGIC,
+ * and every chunk is preceded by a copy of its mmtrd_chunk_t, whose
+ * thread_idx tells the stream it belongs to. Index and footer are the same
+ * as above, the index offsets point at the record data, so a container can
+ * be read like a trace; record numbers count per thread. The chunk headers
+ * allow to recover a container whose process died before the index was
+ * written.
+ */
+
+#define MMTRD_RECORD_MEM 0
+#define MMTRD_RECORD_CALLRET 1
+
+#define MMTRD_MEM_WRITE 1
+#define MMTRD_MEM_READ 2
+
+#define MMTRD_CALL 0
+#define MMTRD_CALL_IND 1
+#define MMTRD_RET 2
+
+#define MMTRD_MEM_RECORD_SIZE 19
+#define MMTRD_CALLRET_RECORD_SIZE 34
+
+#define MMTRD_DELTA_MAX_RECORD_SIZE 48
+
+#define MMTRD_CHUNK_DELTA 1
+
+#define MMTRD_DEFAULT_CHUNK_SIZE (1 << 20)
+
+#define MMTRD_FOOTER_MAGIC "MMTRDIDX"
+#define MMTRD_FORMAT_VERSION 1
+
+#define MMTRD_CONTAINER_MAGIC "MMTRDCON"
+
+#pragma pack(push, 1)
+typedef struct _mmtrd_chunk_t {
+    uint64_t offset;        //< file offset of the first record
+    uint64_t size;          //< bytes of record data in the chunk
+    uint64_t first_record;  //< number of the first record within its thread
+    uint64_t record_count;
+    uint64_t ts_begin;      //< microseconds, start of the first flushed batch
+    uint64_t ts_end;        //< microseconds, end of the last flushed batch
+    uint64_t min_addr;      //< smallest data address of a mem record
+    uint64_t max_addr;      //< largest data address of a mem record
+    uint32_t thread_idx;
+    uint32_t flags;         //< MMTRD_CHUNK_*, 0 in older traces
+} mmtrd_chunk_t;
+
+typedef struct _mmtrd_footer_t {
+    uint64_t index_offset;
+    uint64_t chunk_count;
+    uint64_t record_count;
+    uint32_t chunk_size;
+    uint32_t version;
+    char magic[8];
+} mmtrd_footer_t;
+#pragma pack(pop)
+
+/* Decoded form of a single record. */
+typedef struct _mmtrd_record_t {
+    unsigned char type;
+    unsigned char subtype;  //< MMTRD_MEM_* or MMTRD_CALL/CALL_IND/RET
+    unsigned char size;
+    uint64_t data;
+    uint64_t instr;
+    uint64_t target;
+    uint64_t sym;
+    uint64_t target_sym;
+} mmtrd_record_t;
+
+/* Previous values of a delta encoded chunk. */
+typedef struct _mmtrd_delta_t {
+    uint64_t data;
+    uint64_t instr;
+    uint64_t sym;
+} mmtrd_delta_t;
+
+
+inline void mmtrd_delta_init(mmtrd_delta_t &delta) {
+    delta.data = delta.instr = delta.sym = 0;
+}
+
+
+inline void mmtrd_chunk_init(mmtrd_chunk_t &chunk, uint64_t offset, uint64_t first_record, uint32_t thread_idx) {
+    std::memset(&chunk, 0, sizeof(chunk));
+    chunk.offset = offset;
+    chunk.first_record = first_record;
+    chunk.min_addr = UINT64_MAX;
+    chunk.thread_idx = thread_idx;
+}
+
+
+/*
+ * Decodes the record at p into rec. Returns the number of bytes consumed or
+ * 0 if the buffer is truncated or the record type is unknown.
+ */
+inline size_t mmtrd_decode(const unsigned char *p, const unsigned char *end, mmtrd_record_t &rec) {
+    if (p >= end) {
+        return 0;
+    }
+
+    rec.type = p[0];
+    if (rec.type == MMTRD_RECORD_MEM) {
+        if (end - p < MMTRD_MEM_RECORD_SIZE) {
+            return 0;
+        }
+        rec.subtype = p[1];
+        std::memcpy(&rec.data, p + 2, sizeof(uint64_t));
+        rec.size = p[10];
+        std::memcpy(&rec.sym, p + 11, sizeof(uint64_t));
+        rec.instr = rec.target = rec.target_sym = 0;
+        return MMTRD_MEM_RECORD_SIZE;
+
+    } else if (rec.type == MMTRD_RECORD_CALLRET) {
+        if (end - p < MMTRD_CALLRET_RECORD_SIZE) {
+            return 0;
+        }
+        rec.subtype = p[1];
+        std::memcpy(&rec.instr, p + 2, sizeof(uint64_t));
+        std::memcpy(&rec.target, p + 10, sizeof(uint64_t));
+        std::memcpy(&rec.sym, p + 18, sizeof(uint64_t));
+        std::memcpy(&rec.target_sym, p + 26, sizeof(uint64_t));
+        rec.size = 0;
+        rec.data = 0;
+        return MMTRD_CALLRET_RECORD_SIZE;
+    }
+
+    return 0;
+}
+
+
+inline unsigned char *mmtrd_put_varint(unsigned char *out, uint64_t v) {
+    while (v >= 0x80) {
+        *out++ = static_cast<unsigned char>(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = static_cast<unsigned char>(v);
+    return out;
+}
+
+
+inline unsigned char *mmtrd_put_svarint(unsigned char *out, const int64_t v) {
+    return mmtrd_put_varint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+}
+
+
+/* Returns NULL if the buffer ends within the varint. */
+inline const unsigned char *mmtrd_get_varint(const unsigned char *p, const unsigned char *end, uint64_t &v) {
+    v = 0;
+    for (unsigned int shift = 0; p < end && shift < 64; shift += 7) {
+        const unsigned char b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+
+inline const unsigned char *mmtrd_get_svarint(const unsigned char *p, const unsigned char *end, int64_t &v) {
+    uint64_t u;
+    p = mmtrd_get_varint(p, end, u);
+    v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+    return p;
+}
+
+
+/*
+ * Delta encodes rec into out (at least MMTRD_DELTA_MAX_RECORD_SIZE bytes).
+ * Returns the number of bytes written.
+ */
+inline size_t mmtrd_encode_delta(unsigned char *out, const mmtrd_record_t &rec, mmtrd_delta_t &delta) {
+    unsigned char *p = out + 1;
+    const bool sameSym = rec.sym == delta.sym;
+    out[0] = static_cast<unsigned char>((rec.type & 1) | ((rec.subtype & 3) << 1) | (sameSym ? 8 : 0));
+
+    if (rec.type == MMTRD_RECORD_MEM) {
+        *p++ = rec.size;
+        p = mmtrd_put_svarint(p, static_cast<int64_t>(rec.data - delta.data));
+        delta.data = rec.data;
+    } else {
+        p = mmtrd_put_svarint(p, static_cast<int64_t>(rec.instr - delta.instr));
+        p = mmtrd_put_svarint(p, static_cast<int64_t>(rec.target - rec.instr));
+        delta.instr = rec.instr;
+    }
+    if (!sameSym) {
+        p = mmtrd_put_varint(p, rec.sym);
+        delta.sym = rec.sym;
+    }
+    if (rec.type != MMTRD_RECORD_MEM) {
+        p = mmtrd_put_varint(p, rec.target_sym);
+    }
+
+    return static_cast<size_t>(p - out);
+}
+
+
+/* Counterpart of mmtrd_encode_delta, returns 0 if the buffer is truncated. */
+inline size_t mmtrd_decode_delta(const unsigned char *p, const unsigned char *end, mmtrd_record_t &rec,
+    mmtrd_delta_t &delta) {
+    const unsigned char *q = p;
+    if (q >= end) {
+        return 0;
+    }
+    const unsigned char head = *q++;
+    rec.type = head & 1;
+    rec.subtype = (head >> 1) & 3;
+    int64_t d;
+
+    if (rec.type == MMTRD_RECORD_MEM) {
+        if (q >= end) {
+            return 0;
+        }
+        rec.size = *q++;
+        if ((q = mmtrd_get_svarint(q, end, d)) == NULL) {
+            return 0;
+        }
+        rec.data = delta.data + static_cast<uint64_t>(d);
+        rec.instr = rec.target = rec.target_sym = 0;
+    } else {
+        if ((q = mmtrd_get_svarint(q, end, d)) == NULL) {
+            return 0;
+        }
+        rec.instr = delta.instr + static_cast<uint64_t>(d);
+        if ((q = mmtrd_get_svarint(q, end, d)) == NULL) {
+            return 0;
+        }
+        rec.target = rec.instr + static_cast<uint64_t>(d);
+        rec.size = 0;
+        rec.data = 0;
+    }
+    if ((head & 8) != 0) {
+        rec.sym = delta.sym;
+    } else if ((q = mmtrd_get_varint(q, end, rec.sym)) == NULL) {
+        return 0;
+    }
+    if (rec.type != MMTRD_RECORD_MEM && (q = mmtrd_get_varint(q, end, rec.target_sym)) == NULL) {
+        return 0;
+    }
+
+    // Only commit the state for complete records.
+    if (rec.type == MMTRD_RECORD_MEM) {
+        delta.data = rec.data;
+    } else {
+        delta.instr = rec.instr;
+    }
+    delta.sym = rec.sym;
+    return static_cast<size_t>(q - p);
+}
+
+
+/* Decodes the next record of a chunk with the given MMTRD_CHUNK_* flags. */
+inline size_t mmtrd_decode_next(const unsigned char *p, const unsigned char *end, const uint32_t flags,
+    mmtrd_record_t &rec, mmtrd_delta_t &delta) {
+    if ((flags & MMTRD_CHUNK_DELTA) != 0) {
+        return mmtrd_decode_delta(p, end, rec, delta);
+    }
+    return mmtrd_decode(p, end, rec);
+}
+
+#endif // end ifndef REGINA_MMTRD_FORMAT_H_INCLUDED
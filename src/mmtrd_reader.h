@@ -0,0 +1,220 @@
+#ifndef REGINA_MMTRD_READER_H_INCLUDED
+#define REGINA_MMTRD_READER_H_INCLUDED
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "mmtrd_format.h"
+
+#ifdef _WIN32
+#define REGINA_FSEEK _fseeki64
+#define REGINA_FTELL _ftelli64
+#else
+#define REGINA_FSEEK fseeko
+#define REGINA_FTELL ftello
+#endif
+
+/*
+ * Random access to a .mmtrd trace through its chunk index. Chunks can be
+ * read independently (each ReadChunk() call seeks), so callers that want to
+ * decode in parallel simply open one reader per worker.
+ *
+ * A container holds the chunks of several threads; Select() narrows the
+ * reader to the stream of one of them.
+ */
+class MmtrdReader {
+public:
+    inline MmtrdReader(void) : f(NULL), records(0) { }
+
+    inline ~MmtrdReader(void) {
+        this->Close();
+    }
+
+    bool Open(const char *filename);
+
+    inline void Close(void) {
+        if (this->f != NULL) {
+            std::fclose(this->f);
+            this->f = NULL;
+        }
+        this->index.clear();
+        this->records = 0;
+    }
+
+    inline const std::vector<mmtrd_chunk_t> &Chunks(void) const {
+        return this->index;
+    }
+
+    inline uint64_t RecordCount(void) const {
+        return this->records;
+    }
+
+    /* Returns the index of the chunk holding the given record number of a single thread. */
+    size_t FindChunk(const uint64_t record) const;
+
+    /* The threads with chunks in the file, in ascending order. */
+    void Threads(std::vector<uint32_t> &out) const;
+
+    /* Drops the chunks of all other threads. */
+    void Select(const uint32_t thread_idx);
+
+    bool ReadChunk(const size_t chunk, std::vector<unsigned char> &data);
+
+    MmtrdReader(const MmtrdReader &rhs) = delete;
+
+    MmtrdReader &operator=(const MmtrdReader &rhs) = delete;
+
+private:
+    bool scanUnindexed(const uint64_t file_size);
+
+    bool scanContainer(const std::vector<unsigned char> &data);
+
+    FILE *f;
+    uint64_t records;
+    std::vector<mmtrd_chunk_t> index;
+};
+
+
+inline bool MmtrdReader::Open(const char *filename) {
+    this->Close();
+
+    this->f = std::fopen(filename, "rb");
+    if (this->f == NULL) {
+        return false;
+    }
+
+    REGINA_FSEEK(this->f, 0, SEEK_END);
+    const uint64_t file_size = static_cast<uint64_t>(REGINA_FTELL(this->f));
+
+    mmtrd_footer_t footer;
+    if (file_size >= sizeof(footer)) {
+        REGINA_FSEEK(this->f, file_size - sizeof(footer), SEEK_SET);
+        if (std::fread(&footer, sizeof(footer), 1, this->f) == 1 &&
+            std::memcmp(footer.magic, MMTRD_FOOTER_MAGIC, sizeof(footer.magic)) == 0 &&
+            footer.index_offset + footer.chunk_count * sizeof(mmtrd_chunk_t) + sizeof(footer) == file_size) {
+            this->index.resize(static_cast<size_t>(footer.chunk_count));
+            REGINA_FSEEK(this->f, footer.index_offset, SEEK_SET);
+            if (!this->index.empty() &&
+                std::fread(this->index.data(), sizeof(mmtrd_chunk_t), this->index.size(), this->f) != this->index.size()) {
+                this->Close();
+                return false;
+            }
+            this->records = footer.record_count;
+            return true;
+        }
+    }
+
+    return this->scanUnindexed(file_size);
+}
+
+
+inline size_t MmtrdReader::FindChunk(const uint64_t record) const {
+    size_t lo = 0;
+    size_t hi = this->index.size();
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (this->index[mid].first_record + this->index[mid].record_count <= record) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+inline void MmtrdReader::Threads(std::vector<uint32_t> &out) const {
+    out.clear();
+    for (size_t i = 0; i < this->index.size(); i++) {
+        out.push_back(this->index[i].thread_idx);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+
+inline void MmtrdReader::Select(const uint32_t thread_idx) {
+    size_t n = 0;
+    this->records = 0;
+    for (size_t i = 0; i < this->index.size(); i++) {
+        if (this->index[i].thread_idx == thread_idx) {
+            this->index[n++] = this->index[i];
+            this->records += this->index[i].record_count;
+        }
+    }
+    this->index.resize(n);
+}
+
+
+inline bool MmtrdReader::ReadChunk(const size_t chunk, std::vector<unsigned char> &data) {
+    if (this->f == NULL || chunk >= this->index.size()) {
+        return false;
+    }
+
+    const mmtrd_chunk_t &c = this->index[chunk];
+    data.resize(static_cast<size_t>(c.size));
+    if (data.empty()) {
+        return true;
+    }
+    REGINA_FSEEK(this->f, c.offset, SEEK_SET);
+    return std::fread(data.data(), 1, data.size(), this->f) == data.size();
+}
+
+
+/* Builds a single-chunk index for traces written without a footer. */
+inline bool MmtrdReader::scanUnindexed(const uint64_t file_size) {
+    std::vector<unsigned char> data(static_cast<size_t>(file_size));
+    REGINA_FSEEK(this->f, 0, SEEK_SET);
+    if (!data.empty() && std::fread(data.data(), 1, data.size(), this->f) != data.size()) {
+        this->Close();
+        return false;
+    }
+    if (data.size() >= 8 && std::memcmp(data.data(), MMTRD_CONTAINER_MAGIC, 8) == 0) {
+        return this->scanContainer(data);
+    }
+
+    mmtrd_chunk_t chunk;
+    mmtrd_chunk_init(chunk, 0, 0, 0);
+    mmtrd_record_t rec;
+    const unsigned char *p = data.data();
+    const unsigned char *end = p + data.size();
+    size_t len;
+    while ((len = mmtrd_decode(p, end, rec)) > 0) {
+        if (rec.type == MMTRD_RECORD_MEM) {
+            chunk.min_addr = std::min(chunk.min_addr, rec.data);
+            chunk.max_addr = std::max(chunk.max_addr, rec.data);
+        }
+        chunk.size += len;
+        chunk.record_count++;
+        p += len;
+    }
+
+    this->index.push_back(chunk);
+    this->records = chunk.record_count;
+    return true;
+}
+
+
+/*
+ * Rebuilds the index of a container without footer from the chunk headers;
+ * a truncated last chunk is dropped.
+ */
+inline bool MmtrdReader::scanContainer(const std::vector<unsigned char> &data) {
+    uint64_t pos = 8;
+    while (pos + sizeof(mmtrd_chunk_t) <= data.size()) {
+        mmtrd_chunk_t chunk;
+        std::memcpy(&chunk, data.data() + pos, sizeof(chunk));
+        pos += sizeof(chunk);
+        if (chunk.offset != pos || chunk.size > data.size() - pos) {
+            break;
+        }
+        this->index.push_back(chunk);
+        this->records += chunk.record_count;
+        pos += chunk.size;
+    }
+    return true;
+}
+
+#endif // end ifndef REGINA_MMTRD_READER_H_INCLUDED
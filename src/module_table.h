@@ -0,0 +1,231 @@
+#ifndef REGINA_MODULE_TABLE_H_INCLUDED
+#define REGINA_MODULE_TABLE_H_INCLUDED
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "dr_api.h"
+#include "drsyms.h"
+
+#include "line_table.h"
+#include "symbol_ranges.h"
+
+typedef struct _module_entry_t {
+    app_pc start;
+    app_pc end;
+    std::string path;
+    std::string name;
+    LineTable *lines;   //< NULL until the first line lookup
+    bool lines_loaded;
+    SymbolRanges *symbols;  //< NULL until the first symbol lookup
+    bool symbols_loaded;
+} module_entry_t;
+
+
+/*
+ * Address ranges of the loaded modules, maintained from the module load and
+ * unload events. Per-module tables (lines, ...) are loaded on first use.
+ */
+class ModuleTable {
+public:
+    inline ModuleTable(void) : lock(NULL) { }
+
+    inline void Init(void) {
+        this->lock = dr_rwlock_create();
+    }
+
+    void Exit(void);
+
+    void Add(const module_data_t *info);
+
+    void Remove(const module_data_t *info);
+
+    /*
+     * Looks up file and line of pc. Returns false if pc is not inside a known
+     * module or the module has no line information.
+     */
+    bool LookupLine(const app_pc pc, std::string &file, uint32_t &line);
+
+    /*
+     * Resolves pc to the index of its "module#symbol" name. The index is
+     * requested once per symbol from assign(name) and cached afterwards.
+     * name receives the symbol string if not NULL. Returns false if pc is
+     * not inside a known module or precedes all of its symbols.
+     */
+    template<class Assign>
+    bool LookupSymbol(const app_pc pc, size_t &id, std::string *name, Assign &assign);
+
+private:
+    /* Returns the module containing pc or NULL; requires the lock. */
+    inline module_entry_t *find(const app_pc pc) {
+        auto it = std::upper_bound(this->modules.begin(), this->modules.end(), pc,
+            [](const app_pc p, const module_entry_t *m) { return p < m->start; });
+        if (it == this->modules.begin()) {
+            return NULL;
+        }
+        --it;
+        return (pc < (*it)->end) ? *it : NULL;
+    }
+
+    static bool loadLinesCallback(drsym_line_info_t *info, void *data);
+
+    static bool loadSymbolsCallback(const char *name, size_t modoffs, void *data);
+
+    static void free(module_entry_t *module);
+
+    void *lock;
+    std::vector<module_entry_t *> modules;   //< sorted by start
+};
+
+
+inline void ModuleTable::Exit(void) {
+    for (size_t i = 0; i < this->modules.size(); i++) {
+        ModuleTable::free(this->modules[i]);
+    }
+    this->modules.clear();
+    dr_rwlock_destroy(this->lock);
+    this->lock = NULL;
+}
+
+
+inline void ModuleTable::Add(const module_data_t *info) {
+    module_entry_t *module = new module_entry_t();
+    module->start = info->start;
+    module->end = info->end;
+    module->path = (info->full_path != NULL) ? info->full_path : "";
+    const char *name = dr_module_preferred_name(info);
+    module->name = (name != NULL) ? name : "<noname>";
+    module->lines = NULL;
+    module->lines_loaded = false;
+    module->symbols = NULL;
+    module->symbols_loaded = false;
+
+    dr_rwlock_write_lock(this->lock);
+    auto it = std::upper_bound(this->modules.begin(), this->modules.end(), module->start,
+        [](const app_pc p, const module_entry_t *m) { return p < m->start; });
+    this->modules.insert(it, module);
+    dr_rwlock_write_unlock(this->lock);
+}
+
+
+inline void ModuleTable::Remove(const module_data_t *info) {
+    dr_rwlock_write_lock(this->lock);
+    for (auto it = this->modules.begin(); it != this->modules.end(); ++it) {
+        if ((*it)->start == info->start) {
+            ModuleTable::free(*it);
+            this->modules.erase(it);
+            break;
+        }
+    }
+    dr_rwlock_write_unlock(this->lock);
+}
+
+
+inline bool ModuleTable::LookupLine(const app_pc pc, std::string &file, uint32_t &line) {
+    dr_rwlock_read_lock(this->lock);
+    module_entry_t *module = this->find(pc);
+    if (module != NULL && !module->lines_loaded) {
+        // Load the line table once, re-checking under the write lock.
+        dr_rwlock_read_unlock(this->lock);
+        dr_rwlock_write_lock(this->lock);
+        module = this->find(pc);
+        if (module != NULL && !module->lines_loaded) {
+            LineTable *lines = new LineTable();
+            if (drsym_enumerate_lines(module->path.c_str(), ModuleTable::loadLinesCallback, lines) == DRSYM_SUCCESS &&
+                lines->Size() > 0) {
+                lines->Finalize();
+                module->lines = lines;
+            } else {
+                delete lines;
+            }
+            module->lines_loaded = true;
+        }
+        dr_rwlock_write_unlock(this->lock);
+        dr_rwlock_read_lock(this->lock);
+        module = this->find(pc);
+    }
+
+    bool found = false;
+    if (module != NULL && module->lines != NULL) {
+        const LineTable::line_entry_t *entry = module->lines->Lookup(static_cast<size_t>(pc - module->start));
+        if (entry != NULL) {
+            file = module->lines->File(entry);
+            line = entry->line;
+            found = true;
+        }
+    }
+    dr_rwlock_read_unlock(this->lock);
+
+    return found;
+}
+
+
+template<class Assign>
+inline bool ModuleTable::LookupSymbol(const app_pc pc, size_t &id, std::string *name, Assign &assign) {
+    dr_rwlock_read_lock(this->lock);
+    module_entry_t *module = this->find(pc);
+    if (module != NULL && !module->symbols_loaded) {
+        // Enumerate the symbols once, re-checking under the write lock.
+        dr_rwlock_read_unlock(this->lock);
+        dr_rwlock_write_lock(this->lock);
+        module = this->find(pc);
+        if (module != NULL && !module->symbols_loaded) {
+            SymbolRanges *symbols = new SymbolRanges();
+            if (drsym_enumerate_symbols(module->path.c_str(), ModuleTable::loadSymbolsCallback, symbols,
+                DRSYM_DEFAULT_FLAGS) == DRSYM_SUCCESS && symbols->Size() > 0) {
+                symbols->Finalize();
+                module->symbols = symbols;
+            } else {
+                delete symbols;
+            }
+            module->symbols_loaded = true;
+        }
+        dr_rwlock_write_unlock(this->lock);
+        dr_rwlock_read_lock(this->lock);
+        module = this->find(pc);
+    }
+
+    bool found = false;
+    if (module != NULL && module->symbols != NULL) {
+        SymbolRanges::symbol_entry_t *entry = module->symbols->Lookup(static_cast<size_t>(pc - module->start));
+        if (entry != NULL) {
+            if (entry->id == SYMBOL_ID_NONE || name != NULL) {
+                std::string str = module->name + "#" + module->symbols->Name(entry);
+                // Threads racing here get the same index for the same name.
+                if (entry->id == SYMBOL_ID_NONE) {
+                    entry->id = assign(str);
+                }
+                if (name != NULL) {
+                    name->swap(str);
+                }
+            }
+            id = entry->id;
+            found = true;
+        }
+    }
+    dr_rwlock_read_unlock(this->lock);
+
+    return found;
+}
+
+
+inline bool ModuleTable::loadLinesCallback(drsym_line_info_t *info, void *data) {
+    static_cast<LineTable *>(data)->Add(info->line_addr, info->file, info->line);
+    return true;
+}
+
+
+inline bool ModuleTable::loadSymbolsCallback(const char *name, size_t modoffs, void *data) {
+    static_cast<SymbolRanges *>(data)->Add(modoffs, name);
+    return true;
+}
+
+
+inline void ModuleTable::free(module_entry_t *module) {
+    delete module->lines;
+    delete module->symbols;
+    delete module;
+}
+
+#endif // end ifndef REGINA_MODULE_TABLE_H_INCLUDED
@@ -0,0 +1,364 @@
+#ifndef REGINA_OPTIONS_H_INCLUDED
+#define REGINA_OPTIONS_H_INCLUDED
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include "log.h"
+
+typedef enum _regina_output_t {
+    REGINA_OUTPUT_BINARY,       //< .mmtrd records
+    REGINA_OUTPUT_TEXT,         //< one line per record
+    REGINA_OUTPUT_COMPRESSED,   //< delta encoded .mmtrd records
+    REGINA_OUTPUT_NULL          //< nothing, to measure the overhead
+} regina_output_t;
+
+
+/*
+ * Client options, given after the client library on the drrun command line:
+ *   drrun -c regina.dll -lines -- app.exe
+ */
+typedef struct _regina_options_t {
+    regina_output_t output; //< -output <binary|text|compressed|null>
+    std::string out_dir;    //< -out_dir <dir>: directory of all output files
+    std::string prefix;     //< -prefix <name>: first part of all output file names
+    bool line_info;     //< -lines: attribute records to file:line
+    bool sharing;       //< -sharing: detect false and true sharing
+    size_t sharing_lines;   //< -sharing_lines <n>: cache lines tracked
+    bool working_set;   //< -ws: working set size time series
+    size_t ws_window;   //< -ws_window <ms>: length of a time window
+    bool ws_symbols;    //< -ws_symbols: working set per symbol
+    bool ws_merge;      //< -ws_merge: working set of all threads
+    bool patterns;      //< -patterns: classify the access pattern per PC
+    bool values;        //< -values: silent stores and redundant loads per PC
+    bool loops;         //< -loops: find loops and attribute references to them
+    size_t loops_max;   //< -loops_max <n>: loops with inline counters
+    bool callgraph;     //< -callgraph: only count call edges
+    size_t callgraph_sites; //< -callgraph_sites <n>: call sites with inline counters
+    bool persist;       //< -persist: emit blocks for DR's persisted code caches
+    char shm[64];       //< -shm <name>: stream records to a shared memory ring instead of files
+    size_t shm_size;    //< -shm_size <bytes>: size of a ring
+    bool shm_per_thread;    //< -shm_per_thread: one ring per thread (<name>.<thread>)
+    bool shm_block;     //< -shm_block: wait for the consumer instead of dropping records
+    bool watch;         //< any of the -watch options: only trace references to watch ranges
+    std::vector<std::pair<uint64_t, uint64_t> > watch_ranges;  //< -watch <addr>:<size>
+    std::vector<std::string> watch_symbols; //< -watch <module!symbol>: a global variable
+    std::vector<std::string> watch_alloc;   //< -watch_alloc <module!function>: blocks it allocates directly (malloc, new)
+    bool watch_marker;  //< -watch_marker: ranges registered by regina_watch() in the application
+    bool bbv;           //< -bbv: only collect basic-block vectors and select simpoints
+    size_t bbv_interval;    //< -bbv_interval <n>: instructions per interval
+    size_t bbv_blocks;  //< -bbv_blocks <n>: blocks with inline counters
+    size_t bbv_k;       //< -bbv_k <n>: maximum number of clusters
+    std::string simpoints;  //< -simpoints <file>: only trace the intervals selected by a -bbv run
+    bool mix;           //< -mix: only count the instruction mix and register usage per function
+    size_t mix_blocks;  //< -mix_blocks <n>: blocks with inline counters
+    bool roofline;      //< -roofline: floating point operations per byte and function
+    size_t roofline_llc;    //< -roofline_llc <bytes>: size of the simulated LLC
+    double roofline_balance;    //< -roofline_balance <flops/byte>: machine balance of the report
+    size_t flight;      //< -flight <records>: keep the last records per thread, only written on triggers
+    size_t flight_dumps;    //< -flight_dumps <n>: triggered dumps at most
+    size_t flight_signal;   //< -flight_signal <n>: signal that triggers a dump (not on Windows)
+    uint64_t signature; //< hash of all options, identifies compatible caches
+} regina_options_t;
+
+
+inline void regina_options_init(regina_options_t &ops) {
+    ops.output = REGINA_OUTPUT_BINARY;
+    ops.out_dir.clear();
+    ops.prefix = "regina";
+    ops.line_info = false;
+    ops.sharing = false;
+    ops.sharing_lines = 1 << 18;
+    ops.working_set = false;
+    ops.ws_window = 1000;
+    ops.ws_symbols = false;
+    ops.ws_merge = false;
+    ops.patterns = false;
+    ops.values = false;
+    ops.loops = false;
+    ops.loops_max = 1 << 14;
+    ops.callgraph = false;
+    ops.callgraph_sites = 1 << 16;
+    ops.persist = false;
+    ops.shm[0] = '\0';
+    ops.shm_size = 1 << 26;
+    ops.shm_per_thread = false;
+    ops.shm_block = false;
+    ops.watch = false;
+    ops.watch_ranges.clear();
+    ops.watch_symbols.clear();
+    ops.watch_alloc.clear();
+    ops.watch_marker = false;
+    ops.bbv = false;
+    ops.bbv_interval = 10000000;
+    ops.bbv_blocks = 1 << 16;
+    ops.bbv_k = 10;
+    ops.simpoints.clear();
+    ops.mix = false;
+    ops.mix_blocks = 1 << 16;
+    ops.roofline = false;
+    ops.roofline_llc = 8 * 1024 * 1024;
+    ops.roofline_balance = 10.0;
+    ops.flight = 0;
+    ops.flight_dumps = 8;
+    ops.flight_signal = 0;
+    ops.signature = 0;
+}
+
+
+/* Reads the numeric value following option argv[i]. */
+inline bool regina_options_value(int argc, const char *argv[], int &i, size_t &value) {
+    if (i + 1 >= argc) {
+        REGINA_LOG_ERROR("regina: option '%s' requires a value\n", argv[i]);
+        return false;
+    }
+    char *end;
+    value = static_cast<size_t>(std::strtoull(argv[++i], &end, 0));
+    if (*end != '\0') {
+        REGINA_LOG_ERROR("regina: invalid value '%s' for option '%s'\n", argv[i], argv[i - 1]);
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * Parses the client arguments (argv[0] is the client path). Returns false
+ * on unknown or malformed options.
+ */
+inline bool regina_options_parse(int argc, const char *argv[], regina_options_t &ops) {
+    regina_options_init(ops);
+
+    // FNV-1a over the arguments
+    ops.signature = 0xcbf29ce484222325ull;
+    for (int i = 1; i < argc; i++) {
+        for (const char *c = argv[i]; ; c++) {
+            ops.signature = (ops.signature ^ static_cast<unsigned char>(*c)) * 0x100000001b3ull;
+            if (*c == '\0') {
+                break;
+            }
+        }
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-output") == 0) {
+            const char *mode = (i + 1 < argc) ? argv[++i] : "";
+            if (std::strcmp(mode, "binary") == 0) {
+                ops.output = REGINA_OUTPUT_BINARY;
+            } else if (std::strcmp(mode, "text") == 0) {
+                ops.output = REGINA_OUTPUT_TEXT;
+            } else if (std::strcmp(mode, "compressed") == 0) {
+                ops.output = REGINA_OUTPUT_COMPRESSED;
+            } else if (std::strcmp(mode, "null") == 0) {
+                ops.output = REGINA_OUTPUT_NULL;
+            } else {
+                REGINA_LOG_ERROR("regina: invalid output '%s', use binary, text, compressed or null\n", mode);
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-out_dir") == 0 || std::strcmp(argv[i], "-prefix") == 0) {
+            if (i + 1 >= argc || argv[i + 1][0] == '\0') {
+                REGINA_LOG_ERROR("regina: option '%s' requires a value\n", argv[i]);
+                return false;
+            }
+            (std::strcmp(argv[i], "-out_dir") == 0 ? ops.out_dir : ops.prefix) = argv[i + 1];
+            i++;
+        } else if (std::strcmp(argv[i], "-lines") == 0) {
+            ops.line_info = true;
+        } else if (std::strcmp(argv[i], "-sharing") == 0) {
+            ops.sharing = true;
+        } else if (std::strcmp(argv[i], "-sharing_lines") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.sharing_lines)) {
+                return false;
+            }
+            // The table is indexed by masking, round up to a power of two.
+            size_t lines = 1;
+            while (lines < ops.sharing_lines) {
+                lines <<= 1;
+            }
+            ops.sharing_lines = lines;
+        } else if (std::strcmp(argv[i], "-ws") == 0) {
+            ops.working_set = true;
+        } else if (std::strcmp(argv[i], "-ws_window") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.ws_window) || ops.ws_window == 0) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-ws_symbols") == 0) {
+            ops.working_set = ops.ws_symbols = true;
+        } else if (std::strcmp(argv[i], "-ws_merge") == 0) {
+            ops.working_set = ops.ws_merge = true;
+        } else if (std::strcmp(argv[i], "-patterns") == 0) {
+            ops.patterns = true;
+        } else if (std::strcmp(argv[i], "-values") == 0) {
+            ops.values = true;
+        } else if (std::strcmp(argv[i], "-loops") == 0) {
+            ops.loops = true;
+        } else if (std::strcmp(argv[i], "-loops_max") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.loops_max)) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-callgraph") == 0) {
+            ops.callgraph = true;
+        } else if (std::strcmp(argv[i], "-callgraph_sites") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.callgraph_sites)) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-persist") == 0) {
+            ops.persist = true;
+        } else if (std::strcmp(argv[i], "-shm") == 0) {
+            if (i + 1 >= argc || std::strlen(argv[i + 1]) >= sizeof(ops.shm)) {
+                REGINA_LOG_ERROR("regina: option '%s' requires a name of less than %u characters\n",
+                    argv[i], static_cast<unsigned int>(sizeof(ops.shm)));
+                return false;
+            }
+            std::strcpy(ops.shm, argv[++i]);
+        } else if (std::strcmp(argv[i], "-shm_size") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.shm_size)) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-shm_per_thread") == 0) {
+            ops.shm_per_thread = true;
+        } else if (std::strcmp(argv[i], "-shm_block") == 0) {
+            ops.shm_block = true;
+        } else if (std::strcmp(argv[i], "-watch") == 0 || std::strcmp(argv[i], "-watch_alloc") == 0) {
+            if (i + 1 >= argc) {
+                REGINA_LOG_ERROR("regina: option '%s' requires a value\n", argv[i]);
+                return false;
+            }
+            const bool alloc = std::strcmp(argv[i++], "-watch_alloc") == 0;
+            if (std::strchr(argv[i], '!') != NULL) {
+                (alloc ? ops.watch_alloc : ops.watch_symbols).push_back(argv[i]);
+            } else if (alloc) {
+                REGINA_LOG_ERROR("regina: invalid allocation site '%s', use module!function\n", argv[i]);
+                return false;
+            } else {
+                char *end;
+                const uint64_t start = std::strtoull(argv[i], &end, 0);
+                const uint64_t size = (*end == ':') ? std::strtoull(end + 1, &end, 0) : 0;
+                if (*end != '\0' || size == 0) {
+                    REGINA_LOG_ERROR("regina: invalid watch range '%s', use <addr>:<size> or module!symbol\n", argv[i]);
+                    return false;
+                }
+                ops.watch_ranges.push_back(std::make_pair(start, size));
+            }
+            ops.watch = true;
+        } else if (std::strcmp(argv[i], "-watch_marker") == 0) {
+            ops.watch = ops.watch_marker = true;
+        } else if (std::strcmp(argv[i], "-bbv") == 0) {
+            ops.bbv = true;
+        } else if (std::strcmp(argv[i], "-bbv_interval") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.bbv_interval) || ops.bbv_interval == 0) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-bbv_blocks") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.bbv_blocks)) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-bbv_k") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.bbv_k) || ops.bbv_k == 0) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-simpoints") == 0) {
+            if (i + 1 >= argc) {
+                REGINA_LOG_ERROR("regina: option '%s' requires a value\n", argv[i]);
+                return false;
+            }
+            ops.simpoints = argv[++i];
+        } else if (std::strcmp(argv[i], "-mix") == 0) {
+            ops.mix = true;
+        } else if (std::strcmp(argv[i], "-mix_blocks") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.mix_blocks)) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-roofline") == 0) {
+            ops.roofline = true;
+        } else if (std::strcmp(argv[i], "-roofline_llc") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.roofline_llc) || ops.roofline_llc == 0) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-roofline_balance") == 0) {
+            char *end = NULL;
+            ops.roofline_balance = (i + 1 < argc) ? std::strtod(argv[++i], &end) : 0.0;
+            if (end == NULL || *end != '\0' || ops.roofline_balance <= 0.0) {
+                REGINA_LOG_ERROR("regina: option '-roofline_balance' requires a positive number\n");
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-flight") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.flight)) {
+                return false;
+            }
+            if (ops.flight == 0) {
+                REGINA_LOG_ERROR("regina: option '-flight' requires a number of records\n");
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-flight_dumps") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.flight_dumps)) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "-flight_signal") == 0) {
+            if (!regina_options_value(argc, argv, i, ops.flight_signal)) {
+                return false;
+            }
+        } else {
+            REGINA_LOG_ERROR("regina: unknown option '%s'\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (ops.shm[0] != '\0' && ops.output != REGINA_OUTPUT_BINARY) {
+        REGINA_LOG_ERROR("regina: -shm streams binary records, it cannot be combined with -output\n");
+        return false;
+    }
+
+    if (ops.bbv && !ops.simpoints.empty()) {
+        REGINA_LOG_ERROR("regina: -simpoints traces the intervals of a previous -bbv run, use them in separate runs\n");
+        return false;
+    }
+
+    if ((ops.bbv || !ops.simpoints.empty()) && ops.persist) {
+        REGINA_LOG_ERROR("regina: -bbv and -simpoints count blocks with counters of this run, they cannot be combined with -persist\n");
+        return false;
+    }
+
+    if (ops.loops && (ops.callgraph || ops.bbv || ops.mix || ops.persist)) {
+        REGINA_LOG_ERROR("regina: -loops attributes traced references to the loops of this run, it cannot be combined with -callgraph, -bbv, -mix or -persist\n");
+        return false;
+    }
+
+    if (ops.mix && (ops.callgraph || ops.bbv || !ops.simpoints.empty())) {
+        REGINA_LOG_ERROR("regina: -mix only counts blocks, it cannot be combined with -callgraph, -bbv or -simpoints\n");
+        return false;
+    }
+
+    if (ops.callgraph && ops.persist) {
+        REGINA_LOG_ERROR("regina: -callgraph counts calls with counters of this run, it cannot be combined with -persist\n");
+        return false;
+    }
+
+    if (ops.mix && ops.persist) {
+        REGINA_LOG_ERROR("regina: -mix counts blocks with counters of this run, it cannot be combined with -persist\n");
+        return false;
+    }
+
+    if (ops.roofline && (ops.mix || ops.callgraph || ops.bbv || !ops.simpoints.empty() || ops.watch || ops.persist)) {
+        REGINA_LOG_ERROR("regina: -roofline relates all operations to all traced bytes of this run, it cannot be combined with -mix, -callgraph, -bbv, -simpoints, -watch or -persist\n");
+        return false;
+    }
+
+    if (ops.flight > 0 && (ops.shm[0] != '\0' || (ops.output != REGINA_OUTPUT_BINARY && ops.output != REGINA_OUTPUT_COMPRESSED))) {
+        REGINA_LOG_ERROR("regina: -flight writes its dumps as containers, it cannot be combined with -shm or -output text|null\n");
+        return false;
+    }
+
+    if (ops.flight > 0 && (ops.callgraph || ops.bbv || ops.mix)) {
+        REGINA_LOG_ERROR("regina: -flight records traced references, it cannot be combined with -callgraph, -bbv or -mix\n");
+        return false;
+    }
+
+    return true;
+}
+
+#endif // end ifndef REGINA_OPTIONS_H_INCLUDED
@@ -2,15 +2,69 @@
 #define REGINA_PER_THREAD_T_H_INCLUDED
 
 #include <stdio.h>
+#include <unordered_map>
 
 #include "trace_ref_t.h"
+#include "dr_arena.h"
 #include "fileio.h"
+#include "chunked_file.h"
+#include "trace_flush.h"
+#include "working_set.h"
+#include "access_pattern.h"
+#include "value_profile.h"
+#include "call_graph.h"
+#include "simpoint.h"
+#include "instr_mix.h"
+#include "loop_table.h"
+#include "roofline.h"
+#include "flight_ring.h"
+
+/* Buffered references of a thread, in the thread's arena. */
+typedef std::vector<trace_ref_t, ArenaAllocator<trace_ref_t> > arena_trc_str;
+
+/* The last references of a thread (-flight), in the thread's arena. */
+typedef BasicFlightRing<ArenaAllocator<trace_ref_t> > arena_flight_ring;
+
+/* Symbol index per pc, in the thread's arena. */
+typedef std::unordered_map<app_pc, size_t, std::hash<app_pc>, std::equal_to<app_pc>,
+    ArenaAllocator<std::pair<const app_pc, size_t> > > pc_index_map_t;
+
+/* Part of the streamed symbols already written to a shared memory ring. */
+typedef struct _shm_published_t {
+    size_t bytes;
+    uint count;
+} shm_published_t;
 
 typedef struct _per_thread_t {
     int thread_idx;
+    DrArena *arena;     //< client memory of the thread
+    arena_trc_str *trace;   //< references of the current batch
+    arena_flight_ring *flight;  //< batches kept for a dump instead of written (-flight)
+    void *flight_lock;  //< held while a batch is appended to flight or a dump copies it
     trace_ref_t *buf;
-    FILE *f;
-    FILE *fileIO;
+    app_pc code_cache;
+    ChunkedFile *fileIO;
+    shm_published_t shm_published;  //< symbols in the thread's own ring (-shm_per_thread)
+    FlushBatch *flush_batch;   //< distinct PCs of the batch being written
+    WorkingSet *ws;
+    pc_index_map_t *sym_cache;
+    AccessPatterns *patterns;
+    ValueProfile *values;
+    cg_slot_t *cg_slots;
+    CallGraph *cg_edges;
+    uint64 bb_icount;   //< instructions executed, counted inline
+    uint64 bb_limit;    //< bb_icount at which the current interval ends
+    uint64 bb_start;    //< bb_icount at which the current interval began
+    uint64 bb_interval; //< index of the current interval
+    uint64 *bb_counts;  //< instructions per block slot, counted inline (-bbv)
+    bbv_interval_t *bb_current;     //< vector of the interval being closed
+    std::vector<simpoint_interval_t> *bb_intervals;
+    FILE *bb_file;      //< regina.N.bb, a line per closed interval
+    uint trace_off;     //< -simpoints: nonzero outside the selected intervals, checked inline
+    uint64 *mix_counts; //< executions per block slot, counted inline (-mix, -roofline)
+    RooflineProfile *roofline;
+    ptr_uint_t *loop_counts;    //< LOOP_COUNTERS per loop, counted inline (-loops)
+    LoopProfile *loops;
 } per_thread_t;
 
 #endif
\ No newline at end of file
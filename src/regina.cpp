@@ -37,13 +37,18 @@
  * DAMAGE.
  */
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <string.h>
-#include <sstream>
 #include <cstdio>
 #include <cstddef>
+#include <cctype>
+#include <set>
 #include <unordered_map>
+#ifndef WIN32
+#include <signal.h>
+#endif
 
 #include "dr_api.h"
 #include "dr_config.h"
@@ -52,27 +57,75 @@
 #include "drreg.h"
 #include "drutil.h"
 #include "drsyms.h"
+#include "drwrap.h"
 
 #include "log.h"
+#include "options.h"
+#include "module_table.h"
+#include "sharing_table.h"
+#include "shm_ring.h"
 #include "per_thread_t.h"
 #include "trace_ref_t.h"
 #include "fileio.h"
+#include "symbol_table.h"
+#include "trace_flush.h"
+#include "trace_container.h"
+#include "dr_arena.h"
+#include "watch_ranges.h"
+#include "bbv.h"
+#include "simpoint.h"
 
 
 #define MAX_TRACE_STORAGE_SIZE 10000
 
+#define SHARING_REPORT_LINES 100
+
+#define PATTERN_REPORT_MIN_COUNT 2
+
+#define PERSIST_MAGIC 0x5453524550474552ull /* "REGPERST" */
+
 
 // Forward declarations
 static void event_exit(void);
 static void event_thread_init(void *drcontext);
 static void event_thread_exit(void *drcontext);
+static void event_module_load(void *drcontext, const module_data_t *info, bool loaded);
+static void event_module_unload(void *drcontext, const module_data_t *info);
+static size_t event_persist_ro_size(void *drcontext, void *perscxt, size_t file_offs, void **user_data);
+static bool event_persist_ro(void *drcontext, void *perscxt, file_t fd, void *user_data);
+static bool event_resurrect_ro(void *drcontext, void *perscxt, byte **map);
 static dr_emit_flags_t event_app_instruction(void *drcontext, void *tag,
     instrlist_t *bb, instr_t *instr, bool for_trace, bool translating,
     void *user_data);
 static dr_emit_flags_t event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
     bool for_trace, bool translating);
 static void cb_mem_ref();
+static void analyze_trace(per_thread_t *data);
+static void write_sharing_report(void);
+static void write_pattern_report(void);
+static void write_value_report(void);
+static void write_callgraph_report(void);
+static void write_bbv_report(void);
+static void write_mix_report(void);
+static void write_roofline_report(void);
+static void write_loop_report(void);
+static void write_heap_report(void);
+static void write_symbols(void);
+static std::string output_path(const char *name);
+static bool read_simpoints(const char *path);
+static void translate_addr(app_pc addr, char *buf, size_t size);
 static void translate_addr(app_pc addr, std::string &sym_string);
+static size_t intern_symbol(app_pc addr, std::string *sym_string);
+static size_t assign_symbol(const std::string &sym_string);
+static size_t assign_symbol_name(const char *name, size_t len);
+static void close_ws_window(per_thread_t *data, const uint64 window, const bool last);
+static void bbv_end_interval(per_thread_t *data);
+static void end_batch(per_thread_t *data);
+static void watch_module_load(const module_data_t *info);
+static void watch_module_unload(const module_data_t *info);
+static void flight_write(per_thread_t *data);
+static void flight_dump(void *drcontext, const char *reason);
+static void flight_module_load(const module_data_t *info);
 #ifdef WIN32
 static bool event_exception(void *drcontext, dr_exception_t *excpt);
 #else
@@ -80,19 +133,79 @@ static dr_signal_action_t event_signal(void *drcontext, dr_siginfo_t *siginfo);
 #endif
 //---------------------
 
-
 // Global variables
+static client_id_t client_id;
 static int tls_index;
-static glb_trc_str trace_storage;
-static int thread_idx;
+static dr_emit_flags_t emit_flags;
+static volatile int thread_count;
 static app_pc code_cache;
 static drsym_type_t *types;
-static std::unordered_map<std::string, size_t> symbol_lookup;
-static size_t symbol_idx;
+static BasicSymbolTable<ArenaAllocator<char> > symbols;
+static std::unordered_map<app_pc, size_t, std::hash<app_pc>, std::equal_to<app_pc>,
+    ArenaAllocator<std::pair<const app_pc, size_t> > > addr_symbols;
+static void *symbol_lock;
+static heap_stats_t arena_stats;
+static void *heap_lock;
+static regina_options_t options;
+static ModuleTable modules;
+static SharingTable sharing;
+static uint64 start_ms;
+static FILE *ws_file;
+static void *ws_lock;
+static WorkingSetSeries ws_series;
+static AccessPatterns patterns;
+static void *patterns_lock;
+static ValueProfile values;
+static void *values_lock;
+static CallSites call_sites;
+static CallGraph call_graph;
+static void *cg_lock;
+static ShmRing *shm_ring;
+static TraceContainer *trace_container;
+static dr_string shm_symbols;  //< all symbols so far, as lines of SHM_FRAME_SYMBOLS
+static uint shm_symbol_count;
+static shm_published_t shm_published;  //< part of shm_symbols in the ring of all threads
+static void *shm_publish_lock;  //< orders symbols before records in the ring of all threads
+static WatchRanges watch_ranges;
+static watch_envelope_t watch_envelope;
+static std::vector<std::pair<uint64, uint64> > watch_sites;
+static void *watch_lock;
+static BlockSlots block_slots;
+static std::vector<simpoint_interval_t> bbv_intervals;
+static std::set<std::pair<uint64, uint64> > simpoint_intervals;
+static void *bbv_lock;
+static BlockSlots mix_slots;
+static std::vector<block_mix_t> mix_blocks;
+static std::vector<uint64> mix_executions;
+static uint64 mix_dropped;
+static void *mix_lock;
+static RooflineProfile roofline_profile;
+static void *roofline_lock;
+static LoopTable loop_table;
+static std::vector<uint64> loop_counts;
+static LoopProfile loop_profile;
+static void *loop_lock;
+static std::vector<per_thread_t *> flight_threads;  //< threads with a ring, for dumps
+static void *flight_lock;   //< guards flight_threads and serializes dumps
+static uint flight_dumps;
 //-----------------
-typedef FileIO<true, true> _FileIO;
 
-static _FileIO filer;
+/*
+ * Writes the buffered references of a thread, with -flight its ring, with
+ * the output backend chosen by -output. Selected once, so records are not
+ * dispatched.
+ */
+static void (*flush_trace)(per_thread_t *data);
+
+template<class FileIOType>
+static void flush_trace_with(per_thread_t *data) {
+    FileIOType filer;
+    if (data->flight != NULL) {
+        trace_flush(*(data->flight), filer, data->fileIO, intern_symbol, *data->flush_batch);
+    } else {
+        trace_flush(*(data->trace), filer, data->fileIO, intern_symbol, *data->flush_batch);
+    }
+}
 
 
 static void
@@ -131,6 +244,27 @@ static bool event_exception(void *drcontext, dr_exception_t *excpt) {
     return true;
 }
 
+#ifndef WIN32
+/*
+ * event_signal
+ * Dumps the flight recorder right away, a fatal signal may end the process
+ * before any other thread traces a reference.
+ */
+static dr_signal_action_t event_signal(void *drcontext, dr_siginfo_t *siginfo) {
+    if (options.flight > 0) {
+        if (options.flight_signal != 0 && siginfo->sig == static_cast<int>(options.flight_signal)) {
+            flight_dump(drcontext, "signal");
+            return DR_SIGNAL_SUPPRESS;
+        }
+        if (siginfo->sig == SIGSEGV || siginfo->sig == SIGBUS || siginfo->sig == SIGILL ||
+            siginfo->sig == SIGFPE || siginfo->sig == SIGABRT) {
+            flight_dump(drcontext, "fatal signal");
+        }
+    }
+    return DR_SIGNAL_DELIVER;
+}
+#endif
+
 
 /*
  * dr_client_main
@@ -143,6 +277,13 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
     dr_set_client_name("regina -- mem- and call-trace", "-");
     dr_set_client_version_string("0.1.0");
 
+    if (!regina_options_parse(argc, argv, options)) {
+        REGINA_LOG_ERROR("Usage: drrun -c regina.dll [-lines] [-sharing [-sharing_lines <n>]]\n\t[-ws [-ws_window <ms>] [-ws_symbols] [-ws_merge]] [-patterns] [-values] [-loops [-loops_max <n>]]\n\t[-callgraph [-callgraph_sites <n>]] [-persist]\n\t[-output <binary|text|compressed|null>] [-out_dir <dir>] [-prefix <name>]\n\t[-shm <name> [-shm_size <bytes>] [-shm_per_thread] [-shm_block]]\n\t[-watch <addr>:<size>|<module!symbol>] [-watch_alloc <module!caller of malloc|new>] [-watch_marker]\n\t[-bbv [-bbv_interval <n>] [-bbv_blocks <n>] [-bbv_k <n>]] [-simpoints <file>]\n\t[-mix [-mix_blocks <n>]]\n\t[-roofline [-roofline_llc <bytes>] [-roofline_balance <flops/byte>]]\n\t[-flight <records> [-flight_dumps <n>] [-flight_signal <n>]] -- <app>\n");
+        return;
+    }
+
+    client_id = id;
+
     drreg_options_t ops = {sizeof(ops), 3, false};
 
     /* Specify priority relative to other instrumentation operations: */
@@ -163,6 +304,8 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
     dr_register_exit_event(event_exit);
     if (!drmgr_register_thread_init_event(event_thread_init) ||
         !drmgr_register_thread_exit_event(event_thread_exit) ||
+        !drmgr_register_module_load_event(event_module_load) ||
+        !drmgr_register_module_unload_event(event_module_unload) ||
 #ifdef WIN32
         !drmgr_register_exception_event(event_exception) ||
 #else
@@ -183,9 +326,141 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
         return;
     }
 
-    thread_idx = 0;
+    // Persisted blocks must not depend on this run (see event_persist_ro).
+    if (options.persist) {
+        if (!dr_register_persist_ro(event_persist_ro_size, event_persist_ro, event_resurrect_ro)) {
+            DR_ASSERT(false);
+            return;
+        }
+        emit_flags = DR_EMIT_PERSISTABLE;
+    } else {
+        emit_flags = DR_EMIT_DEFAULT;
+    }
+
+    switch (options.output) {
+    case REGINA_OUTPUT_TEXT:
+        flush_trace = flush_trace_with<FileIO<true, false> >;
+        break;
+    case REGINA_OUTPUT_COMPRESSED:
+        flush_trace = flush_trace_with<CompressedFileIO>;
+        break;
+    case REGINA_OUTPUT_NULL:
+        flush_trace = flush_trace_with<NullFileIO>;
+        break;
+    default:
+        flush_trace = flush_trace_with<FileIO<true, true> >;
+        break;
+    }
+
+    thread_count = 0;
+
+    symbol_lock = dr_mutex_create();
+    heap_lock = dr_mutex_create();
+
+    start_ms = dr_get_milliseconds();
+
+    modules.Init();
+
+    if (options.sharing) {
+        sharing.Init(options.sharing_lines);
+    }
+
+    if (options.working_set) {
+        ws_file = std::fopen(output_path("ws.txt").c_str(), "w");
+        if (ws_file == NULL) {
+            REGINA_LOG_ERROR("regina: cannot create '%s'\n", output_path("ws.txt").c_str());
+            DR_ASSERT(false);
+            return;
+        }
+        ws_lock = dr_mutex_create();
+    }
+
+    if (options.patterns) {
+        patterns_lock = dr_mutex_create();
+    }
+
+    if (options.values) {
+        values_lock = dr_mutex_create();
+    }
+
+    if (options.loops) {
+        loop_table.Init(options.loops_max);
+        loop_counts.assign(LOOP_COUNTERS * options.loops_max, 0);
+        loop_lock = dr_mutex_create();
+    }
+
+    if (options.callgraph) {
+        call_sites.Init(options.callgraph_sites);
+        cg_lock = dr_mutex_create();
+    }
+
+    if (options.roofline) {
+        roofline_lock = dr_mutex_create();
+    }
+
+    // -roofline counts the operations with the blocks of -mix.
+    if (options.mix || options.roofline) {
+        mix_slots.Init(options.mix_blocks);
+        mix_executions.assign(options.mix_blocks, 0);
+        mix_dropped = 0;
+        mix_lock = dr_mutex_create();
+    }
+
+    if (options.bbv) {
+        block_slots.Init(options.bbv_blocks);
+        bbv_lock = dr_mutex_create();
+    }
+
+    if (!options.simpoints.empty() && !read_simpoints(options.simpoints.c_str())) {
+        REGINA_LOG_ERROR("regina: cannot read simpoints from '%s'\n", options.simpoints.c_str());
+        DR_ASSERT(false);
+        return;
+    }
+
+    // The traces of all threads go to one container.
+    trace_container = NULL;
+    if (options.shm[0] == '\0' && (options.output == REGINA_OUTPUT_BINARY || options.output == REGINA_OUTPUT_COMPRESSED)) {
+        trace_container = new TraceContainer();
+        if (!trace_container->Open(output_path("mmtrd").c_str())) {
+            REGINA_LOG_ERROR("regina: cannot create '%s'\n", output_path("mmtrd").c_str());
+            DR_ASSERT(false);
+            return;
+        }
+    }
+
+    // Triggered dumps go to containers of their own.
+    if (options.flight > 0) {
+        flight_lock = dr_mutex_create();
+        flight_dumps = 0;
+        if (!drwrap_init()) {
+            DR_ASSERT(false);
+            return;
+        }
+    }
+
+    // Per-thread rings are created by the threads themselves.
+    shm_ring = NULL;
+    if (options.shm[0] != '\0' && !options.shm_per_thread) {
+        shm_ring = new ShmRing();
+        if (!shm_ring->Create(options.shm, options.shm_size, options.shm_block, SHM_RING_ALL_THREADS)) {
+            REGINA_LOG_ERROR("regina: cannot create shared memory ring '%s'\n", options.shm);
+            DR_ASSERT(false);
+            return;
+        }
+        shm_publish_lock = dr_mutex_create();
+    }
 
-    symbol_idx = 0;
+    if (options.watch) {
+        watch_lock = dr_rwlock_create();
+        for (size_t i = 0; i < options.watch_ranges.size(); i++) {
+            watch_ranges.Add(options.watch_ranges[i].first, options.watch_ranges[i].second);
+        }
+        watch_envelope = watch_ranges.Envelope();
+        if ((!options.watch_alloc.empty() || options.watch_marker) && !drwrap_init()) {
+            DR_ASSERT(false);
+            return;
+        }
+    }
 
     types = new drsym_type_t[3];
 
@@ -206,6 +481,8 @@ static void event_exit(void) {
     // Unregister events
     if (!drmgr_unregister_thread_init_event(event_thread_init) ||
         !drmgr_unregister_thread_exit_event(event_thread_exit) ||
+        !drmgr_unregister_module_load_event(event_module_load) ||
+        !drmgr_unregister_module_unload_event(event_module_unload) ||
 #ifdef WIN32
         !drmgr_unregister_exception_event(event_exception) ||
 #else
@@ -214,18 +491,93 @@ static void event_exit(void) {
         !drmgr_unregister_bb_insertion_event(event_app_instruction)) {
         //REGINA_LOG_ERROR("Unable to unregister drmgr events\n");
     }
+    if (options.persist) {
+        dr_unregister_persist_ro(event_persist_ro_size, event_persist_ro, event_resurrect_ro);
+    }
+
+    if (options.sharing) {
+        write_sharing_report();
+    }
+
+    if (options.working_set) {
+        if (options.ws_merge) {
+            ws_series.Write(ws_file, options.ws_window);
+        }
+        std::fclose(ws_file);
+        dr_mutex_destroy(ws_lock);
+    }
+
+    if (options.patterns) {
+        write_pattern_report();
+        dr_mutex_destroy(patterns_lock);
+    }
+
+    if (options.values) {
+        write_value_report();
+        dr_mutex_destroy(values_lock);
+    }
+
+    if (options.loops) {
+        write_loop_report();
+        dr_mutex_destroy(loop_lock);
+    }
+
+    if (options.callgraph) {
+        write_callgraph_report();
+        dr_mutex_destroy(cg_lock);
+    }
+
+    if (options.bbv) {
+        write_bbv_report();
+        dr_mutex_destroy(bbv_lock);
+    }
+
+    if (options.roofline) {
+        write_roofline_report();
+        dr_mutex_destroy(roofline_lock);
+    }
+
+    if (options.mix || options.roofline) {
+        if (options.mix) {
+            write_mix_report();
+        }
+        dr_mutex_destroy(mix_lock);
+    }
+
+    if (shm_ring != NULL) {
+        shm_ring->Close();
+        delete shm_ring;
+        dr_mutex_destroy(shm_publish_lock);
+    }
+
+    modules.Exit();
+
+    if (options.watch) {
+        if (!options.watch_alloc.empty() || options.watch_marker) {
+            drwrap_exit();
+        }
+        dr_rwlock_destroy(watch_lock);
+    }
+    if (options.flight > 0) {
+        drwrap_exit();
+        dr_mutex_destroy(flight_lock);
+    }
 
     // Exit extensions
     drreg_exit();
     drsym_exit();
     drmgr_exit();
 
-    FILE *lookupIO = std::fopen("regina.0.mmtrd.txt", "w");
-    for (auto &e : symbol_lookup) {
-        std::string tmp = std::to_string(e.second)+"|"+ e.first + "\n";
-        std::fwrite(tmp.c_str(), strlen(tmp.c_str()), 1, lookupIO);
+    if (trace_container != NULL) {
+        trace_container->Close();
+        delete trace_container;
     }
-    std::fclose(lookupIO);
+
+    write_symbols();
+    dr_mutex_destroy(symbol_lock);
+
+    write_heap_report();
+    dr_mutex_destroy(heap_lock);
 }
 
 
@@ -233,579 +585,2474 @@ static void event_exit(void) {
  * event_thread_init
  */
 static void event_thread_init(void *drcontext) {
-    // Push a storage for this thread
-    trace_storage.push_back(thr_trc_str());
-
     // Create thread local storage
     per_thread_t *data;
 
     data = static_cast<per_thread_t *>(dr_thread_alloc(drcontext, sizeof(per_thread_t)));
     drmgr_set_tls_field(drcontext, tls_index, data);
+    data->arena = new (dr_thread_alloc(drcontext, sizeof(DrArena))) DrArena(drcontext);
+
+    // Threads start concurrently, the index is the only state they share here.
+    const int thread_idx = dr_atomic_add32_return_sum(&thread_count, 1) - 1;
+
+    // A storage for this thread, large enough for a whole batch
+    data->trace = new (data->arena->Alloc(sizeof(arena_trc_str))) arena_trc_str(ArenaAllocator<trace_ref_t>(data->arena));
+    data->trace->reserve(MAX_TRACE_STORAGE_SIZE + 1);
+    data->flight = NULL;
+    if (options.flight > 0) {
+        data->flight = new (data->arena->Alloc(sizeof(arena_flight_ring)))
+            arena_flight_ring(options.flight, ArenaAllocator<trace_ref_t>(data->arena));
+        data->flight_lock = dr_mutex_create();
+        dr_mutex_lock(flight_lock);
+        flight_threads.push_back(data);
+        dr_mutex_unlock(flight_lock);
+    }
 
     data->thread_idx = thread_idx;
     data->buf = static_cast<trace_ref_t *>(dr_thread_alloc(drcontext, sizeof(trace_ref_t)));
+    data->code_cache = code_cache;
     char filename[1024];
-    sprintf(filename, "regina.%d.log", thread_idx);
-    data->f = fopen(filename, "w");
 
-    sprintf(filename, "regina.%d.mmtrd", thread_idx);
-    data->fileIO = fopen(filename, "wb");
+    data->fileIO = new ChunkedFile();
+    data->shm_published.bytes = 0;
+    data->shm_published.count = 0;
+    data->flush_batch = new FlushBatch();
+    ShmRing *ring = shm_ring;
+    if (options.shm[0] != '\0' && options.shm_per_thread) {
+        sprintf(filename, "%s.%d", options.shm, thread_idx);
+        ring = new ShmRing();
+        if (!ring->Create(filename, options.shm_size, options.shm_block, thread_idx)) {
+            REGINA_LOG_ERROR("regina: cannot create shared memory ring '%s', writing a file\n", filename);
+            delete ring;
+            ring = NULL;
+        }
+    }
+    if (ring != NULL) {
+        data->fileIO->Open(ring, thread_idx, dr_get_microseconds());
+    } else if (options.output == REGINA_OUTPUT_TEXT) {
+        sprintf(filename, "%d.txt", thread_idx);
+        data->fileIO->Open(output_path(filename).c_str(), thread_idx, dr_get_microseconds());
+    } else if (trace_container != NULL) {
+        data->fileIO->Open(trace_container, thread_idx, dr_get_microseconds(), MMTRD_DEFAULT_CHUNK_SIZE,
+            options.output == REGINA_OUTPUT_COMPRESSED ? MMTRD_CHUNK_DELTA : 0);
+    } else if (options.output != REGINA_OUTPUT_NULL) {
+        // A per-thread ring could not be created.
+        sprintf(filename, "%d.mmtrd", thread_idx);
+        data->fileIO->Open(output_path(filename).c_str(), thread_idx, dr_get_microseconds(), MMTRD_DEFAULT_CHUNK_SIZE,
+            options.output == REGINA_OUTPUT_COMPRESSED ? MMTRD_CHUNK_DELTA : 0);
+    }
+
+    if (options.working_set) {
+        data->ws = new WorkingSet(thread_idx, options.ws_symbols);
+        // Under the lock, so no window the thread starts in is written already.
+        dr_mutex_lock(ws_lock);
+        data->ws->Reset((dr_get_milliseconds() - start_ms) / options.ws_window);
+        if (options.ws_merge) {
+            ws_series.Enter(thread_idx, data->ws->Window());
+        }
+        dr_mutex_unlock(ws_lock);
+        data->sym_cache = new (data->arena->Alloc(sizeof(pc_index_map_t)))
+            pc_index_map_t(16, std::hash<app_pc>(), std::equal_to<app_pc>(), ArenaAllocator<pc_index_map_t::value_type>(data->arena));
+    } else {
+        data->ws = NULL;
+        data->sym_cache = NULL;
+    }
+
+    data->patterns = options.patterns ? new AccessPatterns() : NULL;
+    data->values = options.values ? new ValueProfile() : NULL;
+    if (options.loops) {
+        const size_t size = LOOP_COUNTERS * options.loops_max * sizeof(ptr_uint_t);
+        data->loop_counts = static_cast<ptr_uint_t *>(dr_thread_alloc(drcontext, size));
+        memset(data->loop_counts, 0, size);
+        data->loops = new LoopProfile();
+    } else {
+        data->loop_counts = NULL;
+        data->loops = NULL;
+    }
+
+    if (options.callgraph) {
+        const size_t size = options.callgraph_sites * sizeof(cg_slot_t);
+        data->cg_slots = static_cast<cg_slot_t *>(dr_thread_alloc(drcontext, size));
+        memset(data->cg_slots, 0, size);
+        data->cg_edges = new CallGraph();
+    } else {
+        data->cg_slots = NULL;
+        data->cg_edges = NULL;
+    }
+
+    data->bb_icount = 0;
+    data->bb_start = 0;
+    data->bb_limit = options.bbv_interval;
+    data->bb_interval = 0;
+    if (options.bbv) {
+        const size_t size = options.bbv_blocks * sizeof(uint64);
+        data->bb_counts = static_cast<uint64 *>(dr_thread_alloc(drcontext, size));
+        memset(data->bb_counts, 0, size);
+        data->bb_current = new bbv_interval_t();
+        data->bb_intervals = new std::vector<simpoint_interval_t>();
+        char bb_name[64];
+        sprintf(bb_name, "%u.bb", data->thread_idx);
+        data->bb_file = std::fopen(output_path(bb_name).c_str(), "w");
+    } else {
+        data->bb_counts = NULL;
+        data->bb_current = NULL;
+        data->bb_intervals = NULL;
+        data->bb_file = NULL;
+    }
+    if (options.mix || options.roofline) {
+        const size_t size = options.mix_blocks * sizeof(uint64);
+        data->mix_counts = static_cast<uint64 *>(dr_thread_alloc(drcontext, size));
+        memset(data->mix_counts, 0, size);
+    } else {
+        data->mix_counts = NULL;
+    }
+    data->roofline = options.roofline ? new RooflineProfile(options.roofline_llc) : NULL;
+    data->trace_off = !options.simpoints.empty() &&
+        simpoint_intervals.count(std::make_pair(static_cast<uint64>(thread_idx), static_cast<uint64>(0))) == 0;
     /*data->fileIO = static_cast<FileIO<true, true> *>(dr_thread_alloc(drcontext, sizeof(FileIO<true, true>)));
     *(data->fileIO) = std::move(FileIO<true, true>(filename));*/
+}
 
-    thread_idx++;
+
+/*
+ * event_module_load
+ */
+static void event_module_load(void *drcontext, const module_data_t *info, bool loaded) {
+    modules.Add(info);
+    if (options.watch) {
+        watch_module_load(info);
+    }
+    if (options.flight > 0) {
+        flight_module_load(info);
+    }
 }
 
 
 /*
- * event_thread_exit
+ * event_module_unload
  */
-static void event_thread_exit(void *drcontext) {
-    // Free thread local storage
-    per_thread_t *data;
+static void event_module_unload(void *drcontext, const module_data_t *info) {
+    if (options.watch) {
+        watch_module_unload(info);
+    }
+    modules.Remove(info);
+}
 
-    data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
 
-#if 1
-    if (!trace_storage[data->thread_idx].empty()) {
-        // print out
-        for (int i = 0; i < trace_storage[data->thread_idx].size(); i++) {
-            trace_ref_t &tmp = trace_storage[data->thread_idx][i];
-            if (tmp.is_mem_ref) {
-                //fprintf(data->f, "mem %p\n", tmp.instr_addr);
-                if (tmp.is_write) {
-                    std::string str;
-                    _FileIO::MemRef_t mrt;
-                    mrt.is_write = true;
-                    mrt.instr = tmp.instr_addr;
-                    mrt.size = tmp.size;
-                    mrt.data = tmp.data_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        mrt.symIdx = it->second;
-                    } else {
-                        mrt.symIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    mrt.instrSym = str;
-                    filer.Print(data->fileIO, _FileIO::RefType::MemRef, &mrt);
-
-                    /*print_address(data->f, tmp.instr_addr, "\t\t mem write @ ");
-                    print_data(drcontext, data->f, tmp.instr_addr, tmp.data_addr, tmp.size, "\t\t\t type ");*/
-                    //fprintf(data->f, "\t\t\t %u %p\n", tmp.size, tmp.data_addr);
-                } else {
-                    std::string str;
-                    _FileIO::MemRef_t mrt;
-                    mrt.is_write = false;
-                    mrt.instr = tmp.instr_addr;
-                    mrt.size = tmp.size;
-                    mrt.data = tmp.data_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        mrt.symIdx = it->second;
-                    } else {
-                        mrt.symIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    mrt.instrSym = str;
-                    filer.Print(data->fileIO, _FileIO::RefType::MemRef, &mrt);
+/*
+ * Watch ranges.
+ * With any of the -watch options only memory references into the watch
+ * ranges are traced (calls and returns still are). The inline code only
+ * compares the address against watch_envelope, the hull of all ranges;
+ * cb_mem_ref does the exact check. The envelope is updated under the write
+ * lock but read without it, a reference racing with an update is decided by
+ * the exact check anyway.
+ */
+static void watch_add(const uint64 start, const uint64 size) {
+    dr_rwlock_write_lock(watch_lock);
+    watch_ranges.Add(start, size);
+    watch_envelope = watch_ranges.Envelope();
+    dr_rwlock_write_unlock(watch_lock);
+}
 
-                    /*print_address(data->f, tmp.instr_addr, "\t\t mem read @ ");
-                    print_data(drcontext, data->f, tmp.instr_addr, tmp.data_addr, tmp.size, "\t\t\t type ");*/
-                    //fprintf(data->f, "\t\t\t %u %p\n", tmp.size, tmp.data_addr);
-                }
-            } else {
-                if (tmp.is_call) {
-                    std::string str;
-
-                    _FileIO::CallRetRef_t crt;
-                    crt.instr = tmp.instr_addr;
-                    crt.target = tmp.target_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.instrSymIdx = it->second;
-                    } else {
-                        crt.instrSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.instrSym = str;
-                    translate_addr(tmp.target_addr, str);
-                    it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.targetSymIdx = it->second;
-                    } else {
-                        crt.targetSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.targetSym = str;
 
-                    if (tmp.is_ind) {
-                        filer.Print(data->fileIO, _FileIO::RefType::CallIndRef, &crt);
-                    } else {
-                        filer.Print(data->fileIO, _FileIO::RefType::CallRef, &crt);
-                    }
+static void watch_remove(const uint64 start) {
+    dr_rwlock_write_lock(watch_lock);
+    watch_ranges.Remove(start);
+    watch_envelope = watch_ranges.Envelope();
+    dr_rwlock_write_unlock(watch_lock);
+}
 
-                    //fprintf(data->f, "call %p to %p\n", tmp.instr_addr, tmp.target_addr);
-                    /*print_address(data->f, tmp.instr_addr, "call @ ");
-                    print_address(data->f, tmp.target_addr, "\t to ");*/
-                } else {
-                    std::string str;
-
-                    _FileIO::CallRetRef_t crt;
-                    crt.instr = tmp.instr_addr;
-                    crt.target = tmp.target_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.instrSymIdx = it->second;
-                    } else {
-                        crt.instrSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.instrSym = str;
-                    translate_addr(tmp.target_addr, str);
-                    it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.targetSymIdx = it->second;
-                    } else {
-                        crt.targetSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.targetSym = str;
 
-                    filer.Print(data->fileIO, _FileIO::RefType::RetRef, &crt);
+static bool watch_contains(const uint64 addr) {
+    dr_rwlock_read_lock(watch_lock);
+    const bool contained = watch_ranges.Contains(addr);
+    dr_rwlock_read_unlock(watch_lock);
+    return contained;
+}
+
 
-                    //fprintf(data->f, "return %p to %p\n", tmp.instr_addr, tmp.target_addr);
-                    /*print_address(data->f, tmp.instr_addr, "return @ ");
-                    print_address(data->f, tmp.target_addr, "\t to ");*/
-                }
-            }
+/* Whether addr is the return address of a call from an allocation site. */
+static bool watch_is_site(const uint64 addr) {
+    bool site = false;
+    dr_rwlock_read_lock(watch_lock);
+    for (size_t i = 0; i < watch_sites.size() && !site; i++) {
+        site = addr >= watch_sites[i].first && addr < watch_sites[i].second;
+    }
+    dr_rwlock_read_unlock(watch_lock);
+    return site;
+}
+
+
+/*
+ * Resolves "module!symbol" if it names a symbol of info, giving its address
+ * range. The module name is compared case insensitively, with or without
+ * its extension. Symbols without a known size cover one cache line.
+ */
+static bool watch_resolve(const module_data_t *info, const std::string &spec, uint64 &start, uint64 &size) {
+    const char *modname = dr_module_preferred_name(info);
+    const size_t sep = spec.find('!');
+    if (modname == NULL || sep == std::string::npos) {
+        return false;
+    }
+    size_t i = 0;
+    for (; i < sep && modname[i] != '\0'; i++) {
+        if (tolower(static_cast<unsigned char>(modname[i])) != tolower(static_cast<unsigned char>(spec[i]))) {
+            return false;
         }
-        trace_storage[data->thread_idx].clear();
     }
-#endif
+    if (i < sep || (modname[i] != '\0' && modname[i] != '.')) {
+        return false;
+    }
+
+    size_t offs;
+    if (drsym_lookup_symbol(info->full_path, spec.c_str() + sep + 1, &offs, DRSYM_DEFAULT_FLAGS) != DRSYM_SUCCESS) {
+        return false;
+    }
+    drsym_info_t sym;
+    sym.struct_size = sizeof(sym);
+    sym.name = NULL;
+    sym.name_size = 0;
+    sym.file = NULL;
+    sym.file_size = 0;
+    start = reinterpret_cast<uint64>(info->start) + offs;
+    size = 64;
+    drsym_error_t symres = drsym_lookup_address(info->full_path, offs, &sym, DRSYM_DEFAULT_FLAGS);
+    if ((symres == DRSYM_SUCCESS || symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) &&
+        sym.start_offs == offs && sym.end_offs > offs) {
+        size = sym.end_offs - offs;
+    }
+    return true;
+}
 
-    fclose(data->f);
-    fclose(data->fileIO);
 
-    //dr_thread_free(drcontext, data->fileIO, sizeof(FileIO<true, true>));
-    dr_thread_free(drcontext, data->buf, sizeof(trace_ref_t));
-    dr_thread_free(drcontext, data, sizeof(per_thread_t));
+/*
+ * Allocator wrappers for -watch_alloc. The pre callbacks pass the size of
+ * a block requested from an allocation site to the post callback, which
+ * watches the returned block. Freed blocks are no longer watched.
+ */
+static void wrap_malloc_pre(void *wrapcxt, void **user_data) {
+    const bool site = watch_is_site(reinterpret_cast<uint64>(drwrap_get_retaddr(wrapcxt)));
+    *user_data = site ? drwrap_get_arg(wrapcxt, 0) : NULL;
 }
 
 
-// global callbacks forward decl
-//static void cb_mem_ref(void *drcontext, instr_t *where, int pos, bool is_write);
-//------------------------------
+static void wrap_calloc_pre(void *wrapcxt, void **user_data) {
+    const bool site = watch_is_site(reinterpret_cast<uint64>(drwrap_get_retaddr(wrapcxt)));
+    const size_t size = reinterpret_cast<size_t>(drwrap_get_arg(wrapcxt, 0)) *
+        reinterpret_cast<size_t>(drwrap_get_arg(wrapcxt, 1));
+    *user_data = site ? reinterpret_cast<void *>(size) : NULL;
+}
 
-#define MAX_SYM_RESULT 256
-//static void
-//print_address(FILE *f, app_pc addr, const char *prefix) {
-//    drsym_error_t symres;
-//    drsym_info_t sym;
-//    char name[MAX_SYM_RESULT];
-//    char file[MAXIMUM_PATH];
-//    module_data_t *data;
-//    data = dr_lookup_module(addr);
-//    if (data == NULL) {
-//        fprintf(f, "%s %p ? ??:0\n", prefix, addr);
-//        return;
-//    }
-//    sym.struct_size = sizeof(sym);
-//    sym.name = name;
-//    sym.name_size = MAX_SYM_RESULT;
-//    sym.file = file;
-//    sym.file_size = MAXIMUM_PATH;
-//    symres = drsym_lookup_address(data->full_path, addr - data->start, &sym,
-//        DRSYM_DEFAULT_FLAGS);
-//    if (symres == DRSYM_SUCCESS || symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
-//        const char *modname = dr_module_preferred_name(data);
-//        if (modname == NULL)
-//            modname = "<noname>";
-//        fprintf(f, "%s %p %s!%s+%p", prefix, addr,
-//            modname, sym.name, addr - data->start - sym.start_offs);
-//        if (symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
-//            fprintf(f, " ??:0\n");
-//        } else {
-//            fprintf(f, " %s:%d + %d\n",
-//                sym.file, sym.line, sym.line_offs);
-//        }
-//    } else
-//        dr_fprintf(f, "%s %p ? ??:0\n", prefix, addr);
-//    dr_free_module_data(data);
-//}
 
+static void wrap_realloc_pre(void *wrapcxt, void **user_data) {
+    void *block = drwrap_get_arg(wrapcxt, 0);
+    if (block != NULL) {
+        watch_remove(reinterpret_cast<uint64>(block));
+    }
+    const bool site = watch_is_site(reinterpret_cast<uint64>(drwrap_get_retaddr(wrapcxt)));
+    *user_data = site ? drwrap_get_arg(wrapcxt, 1) : NULL;
+}
 
-static void translate_addr(app_pc addr, std::string &sym_string) {
-    std::ostringstream stringStream;
-    stringStream << std::hex;
-    drsym_error_t symres;
-    drsym_info_t sym;
-    char name[MAX_SYM_RESULT];
-    char file[MAXIMUM_PATH];
-    module_data_t *data;
-    data = dr_lookup_module(addr);
-    if (data == NULL) {
-        stringStream << "###";
-        sym_string = stringStream.str();
-        return;
+
+static void wrap_alloc_post(void *wrapcxt, void *user_data) {
+    void *block = drwrap_get_retval(wrapcxt);
+    if (user_data != NULL && block != NULL) {
+        watch_add(reinterpret_cast<uint64>(block), reinterpret_cast<uint64>(user_data));
     }
-    sym.struct_size = sizeof(sym);
-    sym.name = name;
-    sym.name_size = MAX_SYM_RESULT;
-    sym.file = file;
-    sym.file_size = MAXIMUM_PATH;
-    symres = drsym_lookup_address(data->full_path, addr - data->start, &sym,
-        DRSYM_DEFAULT_FLAGS);
-    if (symres == DRSYM_SUCCESS || symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
-        const char *modname = dr_module_preferred_name(data);
-        if (modname == NULL)
-            modname = "<noname>";
-        stringStream << modname << "#" << sym.name;// << "+" << addr - data->start - sym.start_offs;
-        /*if (symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
-            stringStream << "##";
-        } else {
-            stringStream << "#" << sym.file << "#" << std::dec << sym.line << "+" << sym.line_offs;
-        }*/
-    } else
-        stringStream << "###";
-    sym_string = stringStream.str();
-    dr_free_module_data(data);
 }
 
 
-static void
-print_data(void *drcontext, FILE *f, app_pc addr, void *data_addr, uint size, const char *prefix) {
-    drsym_error_t symres;
-    drsym_info_t sym;
-    char name[MAX_SYM_RESULT];
-    char buf[MAX_SYM_RESULT];
-    char file[MAXIMUM_PATH];
-    module_data_t *data;
-    data = dr_lookup_module(addr);
-    if (data == NULL) {
-        fprintf(f, "%s ? %u %p\n", prefix, size, data_addr);
-        return;
+static void wrap_free_pre(void *wrapcxt, void **user_data) {
+    void *block = drwrap_get_arg(wrapcxt, 0);
+    if (block != NULL) {
+        watch_remove(reinterpret_cast<uint64>(block));
     }
-    sym.struct_size = sizeof(sym);
-    sym.name = name;
+}
+
+
+/* Markers for -watch_marker, see include/regina_watch.h. */
+static void wrap_watch_pre(void *wrapcxt, void **user_data) {
+    watch_add(reinterpret_cast<uint64>(drwrap_get_arg(wrapcxt, 0)),
+        reinterpret_cast<uint64>(drwrap_get_arg(wrapcxt, 1)));
+}
+
+
+static void wrap_unwatch_pre(void *wrapcxt, void **user_data) {
+    watch_remove(reinterpret_cast<uint64>(drwrap_get_arg(wrapcxt, 0)));
+}
+
+
+/* operator new and new[] of the Itanium (64 and 32 bit) and MSVC (x64 and x86) ABIs. */
+static const char *watch_new_names[] = {
+    "_Znwm", "_Znam", "_Znwj", "_Znaj",
+    "??2@YAPEAX_K@Z", "??_U@YAPEAX_K@Z", "??2@YAPAXI@Z", "??_U@YAPAXI@Z"
+};
+
+
+/* Looks up an exported function, or any function if symbols are available. */
+static app_pc watch_find_function(const module_data_t *info, const char *name) {
+    app_pc pc = reinterpret_cast<app_pc>(dr_get_proc_address(info->handle, name));
+    size_t offs;
+    if (pc == NULL && drsym_lookup_symbol(info->full_path, name, &offs, DRSYM_DEFAULT_FLAGS) == DRSYM_SUCCESS) {
+        pc = info->start + offs;
+    }
+    return pc;
+}
+
+
+static void watch_module_load(const module_data_t *info) {
+    uint64 start, size;
+    for (size_t i = 0; i < options.watch_symbols.size(); i++) {
+        if (watch_resolve(info, options.watch_symbols[i], start, size)) {
+            watch_add(start, size);
+        }
+    }
+
+    if (!options.watch_alloc.empty()) {
+        for (size_t i = 0; i < options.watch_alloc.size(); i++) {
+            if (watch_resolve(info, options.watch_alloc[i], start, size)) {
+                dr_rwlock_write_lock(watch_lock);
+                watch_sites.push_back(std::make_pair(start, start + size));
+                dr_rwlock_write_unlock(watch_lock);
+            }
+        }
+        // Every C runtime exports its own allocator.
+        app_pc pc;
+        if ((pc = reinterpret_cast<app_pc>(dr_get_proc_address(info->handle, "malloc"))) != NULL) {
+            drwrap_wrap(pc, wrap_malloc_pre, wrap_alloc_post);
+        }
+        if ((pc = reinterpret_cast<app_pc>(dr_get_proc_address(info->handle, "calloc"))) != NULL) {
+            drwrap_wrap(pc, wrap_calloc_pre, wrap_alloc_post);
+        }
+        if ((pc = reinterpret_cast<app_pc>(dr_get_proc_address(info->handle, "realloc"))) != NULL) {
+            drwrap_wrap(pc, wrap_realloc_pre, wrap_alloc_post);
+        }
+        if ((pc = reinterpret_cast<app_pc>(dr_get_proc_address(info->handle, "free"))) != NULL) {
+            drwrap_wrap(pc, wrap_free_pre, NULL);
+        }
+        // C++ allocates through operator new (which calls malloc from the
+        // runtime, not from the site); delete ends in free.
+        for (size_t i = 0; i < sizeof(watch_new_names) / sizeof(watch_new_names[0]); i++) {
+            if ((pc = watch_find_function(info, watch_new_names[i])) != NULL) {
+                drwrap_wrap(pc, wrap_malloc_pre, wrap_alloc_post);
+            }
+        }
+    }
+
+    if (options.watch_marker) {
+        app_pc pc;
+        if ((pc = watch_find_function(info, "regina_watch")) != NULL) {
+            drwrap_wrap(pc, wrap_watch_pre, NULL);
+        }
+        if ((pc = watch_find_function(info, "regina_unwatch")) != NULL) {
+            drwrap_wrap(pc, wrap_unwatch_pre, NULL);
+        }
+    }
+}
+
+
+/* Drops the ranges and allocation sites within an unloaded module. */
+static void watch_module_unload(const module_data_t *info) {
+    const uint64 lo = reinterpret_cast<uint64>(info->start);
+    const uint64 hi = reinterpret_cast<uint64>(info->end);
+    dr_rwlock_write_lock(watch_lock);
+    watch_ranges.RemoveWithin(lo, hi);
+    watch_envelope = watch_ranges.Envelope();
+    for (size_t i = watch_sites.size(); i > 0; i--) {
+        if (watch_sites[i - 1].first >= lo && watch_sites[i - 1].first < hi) {
+            watch_sites.erase(watch_sites.begin() + (i - 1));
+        }
+    }
+    dr_rwlock_write_unlock(watch_lock);
+}
+
+
+/*
+ * Persisted code caches.
+ * Memory references reach the trampoline through per_thread_t::code_cache
+ * and a pc-relative return address, but clean calls still go to absolute
+ * addresses in this library and slots/TLS offsets depend on the options.
+ * A persisted cache is therefore only accepted by a run with the same
+ * client base and the same options.
+ */
+typedef struct _persist_header_t {
+    uint64 magic;
+    uint64 client_base;
+    uint64 signature;
+} persist_header_t;
+
+
+static size_t event_persist_ro_size(void *drcontext, void *perscxt, size_t file_offs, void **user_data) {
+    return sizeof(persist_header_t);
+}
+
+
+static bool event_persist_ro(void *drcontext, void *perscxt, file_t fd, void *user_data) {
+    persist_header_t header;
+    header.magic = PERSIST_MAGIC;
+    header.client_base = reinterpret_cast<uint64>(dr_get_client_base(client_id));
+    header.signature = options.signature;
+    return dr_write_file(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+}
+
+
+static bool event_resurrect_ro(void *drcontext, void *perscxt, byte **map) {
+    persist_header_t header;
+    memcpy(&header, *map, sizeof(header));
+    *map += sizeof(header);
+    return header.magic == PERSIST_MAGIC &&
+        header.client_base == reinterpret_cast<uint64>(dr_get_client_base(client_id)) &&
+        header.signature == options.signature;
+}
+
+
+/*
+ * event_thread_exit
+ */
+static void event_thread_exit(void *drcontext) {
+    // Free thread local storage
+    per_thread_t *data;
+
+    data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+
+#if 1
+    if (data->flight != NULL) {
+        // A dump may read the ring until the thread is unregistered.
+        dr_mutex_lock(flight_lock);
+        flight_threads.erase(std::find(flight_threads.begin(), flight_threads.end(), data));
+        dr_mutex_unlock(flight_lock);
+        // The ring is the trace of the thread.
+        flight_write(data);
+        data->flight->~arena_flight_ring();
+        dr_mutex_destroy(data->flight_lock);
+    } else if (!data->trace->empty()) {
+        analyze_trace(data);
+        data->fileIO->BeginBatch(dr_get_microseconds());
+        flush_trace(data);
+        end_batch(data);
+        data->trace->clear();
+    }
+#endif
+
+    ShmRing *ring = data->fileIO->Ring();
+    data->fileIO->Close();
+    delete data->fileIO;
+    delete data->flush_batch;
+    if (ring != NULL && ring != shm_ring) {
+        ring->Close();
+        delete ring;
+    }
+
+    if (data->ws != NULL) {
+        close_ws_window(data, 0, true);
+        delete data->ws;
+        data->sym_cache->~pc_index_map_t();
+        data->arena->Free(data->sym_cache, sizeof(pc_index_map_t));
+    }
+
+    if (data->patterns != NULL) {
+        dr_mutex_lock(patterns_lock);
+        patterns.Merge(*(data->patterns));
+        dr_mutex_unlock(patterns_lock);
+        delete data->patterns;
+    }
+
+    if (data->values != NULL) {
+        dr_mutex_lock(values_lock);
+        values.Merge(*(data->values));
+        dr_mutex_unlock(values_lock);
+        delete data->values;
+    }
+
+    if (data->loops != NULL) {
+        dr_mutex_lock(loop_lock);
+        for (size_t i = 0; i < LOOP_COUNTERS * options.loops_max; i++) {
+            loop_counts[i] += data->loop_counts[i];
+        }
+        loop_profile.Merge(*(data->loops));
+        dr_mutex_unlock(loop_lock);
+        dr_thread_free(drcontext, data->loop_counts, LOOP_COUNTERS * options.loops_max * sizeof(ptr_uint_t));
+        delete data->loops;
+    }
+
+    if (data->cg_slots != NULL) {
+        dr_mutex_lock(cg_lock);
+        call_graph.AddSlots(call_sites, data->cg_slots);
+        call_graph.Merge(*(data->cg_edges));
+        dr_mutex_unlock(cg_lock);
+        dr_thread_free(drcontext, data->cg_slots, options.callgraph_sites * sizeof(cg_slot_t));
+        delete data->cg_edges;
+    }
+
+    if (data->bb_counts != NULL) {
+        // The last interval is usually a partial one.
+        if (data->bb_icount > data->bb_start) {
+            bbv_end_interval(data);
+        }
+        dr_mutex_lock(bbv_lock);
+        bbv_intervals.insert(bbv_intervals.end(), data->bb_intervals->begin(), data->bb_intervals->end());
+        dr_mutex_unlock(bbv_lock);
+        if (data->bb_file != NULL) {
+            std::fclose(data->bb_file);
+        }
+        dr_thread_free(drcontext, data->bb_counts, options.bbv_blocks * sizeof(uint64));
+        delete data->bb_current;
+        delete data->bb_intervals;
+    }
+
+    if (data->mix_counts != NULL) {
+        dr_mutex_lock(mix_lock);
+        for (size_t i = 0; i < options.mix_blocks; i++) {
+            mix_executions[i] += data->mix_counts[i];
+        }
+        dr_mutex_unlock(mix_lock);
+        dr_thread_free(drcontext, data->mix_counts, options.mix_blocks * sizeof(uint64));
+    }
+
+    if (data->roofline != NULL) {
+        dr_mutex_lock(roofline_lock);
+        roofline_profile.Merge(*(data->roofline));
+        dr_mutex_unlock(roofline_lock);
+        delete data->roofline;
+    }
+
+    // The storage of the thread goes with its arena.
+    data->trace->~arena_trc_str();
+    dr_mutex_lock(heap_lock);
+    arena_stats.Merge(data->arena->Stats());
+    dr_mutex_unlock(heap_lock);
+    data->arena->~DrArena();
+    dr_thread_free(drcontext, data->arena, sizeof(DrArena));
+
+    //dr_thread_free(drcontext, data->fileIO, sizeof(FileIO<true, true>));
+    dr_thread_free(drcontext, data->buf, sizeof(trace_ref_t));
+    dr_thread_free(drcontext, data, sizeof(per_thread_t));
+}
+
+
+// global callbacks forward decl
+//static void cb_mem_ref(void *drcontext, instr_t *where, int pos, bool is_write);
+//------------------------------
+
+#define MAX_SYM_RESULT 256
+#define MAX_SYM_NAME (MAX_SYM_RESULT + MAXIMUM_PATH + 32)  //< module#symbol#file:line
+//static void
+//print_address(FILE *f, app_pc addr, const char *prefix) {
+//    drsym_error_t symres;
+//    drsym_info_t sym;
+//    char name[MAX_SYM_RESULT];
+//    char file[MAXIMUM_PATH];
+//    module_data_t *data;
+//    data = dr_lookup_module(addr);
+//    if (data == NULL) {
+//        fprintf(f, "%s %p ? ??:0\n", prefix, addr);
+//        return;
+//    }
+//    sym.struct_size = sizeof(sym);
+//    sym.name = name;
+//    sym.name_size = MAX_SYM_RESULT;
+//    sym.file = file;
+//    sym.file_size = MAXIMUM_PATH;
+//    symres = drsym_lookup_address(data->full_path, addr - data->start, &sym,
+//        DRSYM_DEFAULT_FLAGS);
+//    if (symres == DRSYM_SUCCESS || symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+//        const char *modname = dr_module_preferred_name(data);
+//        if (modname == NULL)
+//            modname = "<noname>";
+//        fprintf(f, "%s %p %s!%s+%p", prefix, addr,
+//            modname, sym.name, addr - data->start - sym.start_offs);
+//        if (symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+//            fprintf(f, " ??:0\n");
+//        } else {
+//            fprintf(f, " %s:%d + %d\n",
+//                sym.file, sym.line, sym.line_offs);
+//        }
+//    } else
+//        dr_fprintf(f, "%s %p ? ??:0\n", prefix, addr);
+//    dr_free_module_data(data);
+//}
+
+
+/*
+ * translate_addr
+ * Writes "module#symbol" (and "#file:line" with -lines) of addr to buf,
+ * "###" if it is unknown. Builds no strings on the heap.
+ */
+static void translate_addr(app_pc addr, char *buf, size_t size) {
+    drsym_error_t symres;
+    drsym_info_t sym;
+    char name[MAX_SYM_RESULT];
+    module_data_t *data;
+    data = dr_lookup_module(addr);
+    if (data == NULL) {
+        dr_snprintf(buf, size, "###");
+        buf[size - 1] = '\0';
+        return;
+    }
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
     sym.name_size = MAX_SYM_RESULT;
-    sym.file = file;
-    sym.file_size = MAXIMUM_PATH;
+    // Lines come from the cached line tables, not from drsyms.
+    sym.file = NULL;
+    sym.file_size = 0;
     symres = drsym_lookup_address(data->full_path, addr - data->start, &sym,
         DRSYM_DEFAULT_FLAGS);
-    if (symres == DRSYM_SUCCESS) {
-        //drsym_type_t *types = static_cast<drsym_type_t*>(dr_thread_alloc(drcontext, 3*sizeof(drsym_type_t)));
-        symres = drsym_expand_type(data->full_path, sym.type_id, 2, buf, MAX_SYM_RESULT, &types);
-        int i = 0;
-        int j = -1;
-        while (types[i].kind != DRSYM_TYPE_OTHER && i < 3) {
-            i++;
-            j++;
-        }
-        if (j >= 0) {
-            if (types[i].kind == DRSYM_TYPE_INT) {
-                fprintf(f, "%s INT %u %p\n", prefix, size, data_addr);
-            } else if (types[i].kind == DRSYM_TYPE_PTR) {
-                fprintf(f, "%s PTR %u %p\n", prefix, size, data_addr);
-            } else if (types[i].kind == DRSYM_TYPE_FUNC) {
-                fprintf(f, "%s FUNC %u %p\n", prefix, size, data_addr);
-            } else if (types[i].kind == DRSYM_TYPE_VOID) {
-                fprintf(f, "%s VOID %u %p\n", prefix, size, data_addr);
-            } else if (types[i].kind == DRSYM_TYPE_COMPOUND) {
-                fprintf(f, "%s COMPOUND %u %p\n", prefix, size, data_addr);
+    if (symres == DRSYM_SUCCESS || symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+        const char *modname = dr_module_preferred_name(data);
+        if (modname == NULL)
+            modname = "<noname>";
+        int len = dr_snprintf(buf, size, "%s#%s", modname, sym.name);
+        if (options.line_info && len >= 0 && static_cast<size_t>(len) < size) {
+            std::string file;
+            uint32_t line;
+            if (modules.LookupLine(addr, file, line)) {
+                dr_snprintf(buf + len, size - len, "#%s:%u", file.c_str(), line);
             }
         }
-        //dr_thread_free(drcontext, types, 3 * sizeof(drsym_type_t));
     } else
-        fprintf(f, "%s ? %u %p\n", prefix, size, data_addr);
+        dr_snprintf(buf, size, "###");
+    buf[size - 1] = '\0';
     dr_free_module_data(data);
 }
 
 
-static dr_mcontext_t mc;
+static void translate_addr(app_pc addr, std::string &sym_string) {
+    char buf[MAX_SYM_NAME];
+    translate_addr(addr, buf, sizeof(buf));
+    sym_string.assign(buf);
+}
+
+
+/*
+ * intern_symbol
+ * Resolves addr and returns the index of its symbol string in the symbol
+ * table, adding the string if it is new. The string itself is only built
+ * if sym_string is not NULL or the symbol is seen for the first time.
+ */
+static size_t intern_symbol(app_pc addr, std::string *sym_string) {
+    size_t idx;
+    // Source lines differ within a symbol, those names are built per address.
+    if (!options.line_info && modules.LookupSymbol(addr, idx, sym_string, assign_symbol)) {
+        return idx;
+    }
+
+    // The index of an address never changes, only names are built again.
+    if (sym_string == NULL) {
+        dr_mutex_lock(symbol_lock);
+        auto it = addr_symbols.find(addr);
+        const bool found = (it != addr_symbols.end());
+        idx = found ? it->second : 0;
+        dr_mutex_unlock(symbol_lock);
+        if (found) {
+            return idx;
+        }
+    }
+
+    char name[MAX_SYM_NAME];
+    translate_addr(addr, name, sizeof(name));
+    idx = assign_symbol_name(name, strlen(name));
+    dr_mutex_lock(symbol_lock);
+    addr_symbols[addr] = idx;
+    dr_mutex_unlock(symbol_lock);
+    if (sym_string != NULL) {
+        sym_string->assign(name);
+    }
+    return idx;
+}
+
+
+/*
+ * assign_symbol
+ * Returns the index of a symbol string, adding it if it is new.
+ */
+static size_t assign_symbol(const std::string &sym_string) {
+    return assign_symbol_name(sym_string.data(), sym_string.size());
+}
+
+
+static size_t assign_symbol_name(const char *name, size_t len) {
+    bool inserted;
+    dr_mutex_lock(symbol_lock);
+    const size_t idx = symbols.Intern(name, len, inserted);
+    if (inserted) {
+        if (options.shm[0] != '\0') {
+            char prefix[32];
+            dr_snprintf(prefix, sizeof(prefix), "%llu|", static_cast<unsigned long long>(idx));
+            prefix[sizeof(prefix) - 1] = '\0';
+            shm_symbols.append(prefix).append(name, len).append("\n");
+            shm_symbol_count++;
+        }
+    }
+    dr_mutex_unlock(symbol_lock);
+
+    return idx;
+}
+
+
+/*
+ * Flight recorder.
+ */
+
+/*
+ * flight_append
+ * Moves the pending batch of the thread into its ring.
+ */
+static void flight_append(per_thread_t *data) {
+    if (!data->trace->empty()) {
+        analyze_trace(data);
+        dr_mutex_lock(data->flight_lock);
+        data->flight->Append(*(data->trace));
+        dr_mutex_unlock(data->flight_lock);
+        data->trace->clear();
+    }
+}
+
+
+/*
+ * flight_write
+ * Writes the ring of the exiting thread to its trace, oldest record first.
+ */
+static void flight_write(per_thread_t *data) {
+    flight_append(data);
+    if (data->flight->size() > 0) {
+        data->fileIO->BeginBatch(dr_get_microseconds());
+        flush_trace(data);
+        end_batch(data);
+    }
+}
+
+
+/*
+ * flight_dump
+ * Writes the rings of all threads to <prefix>.flight.<n>.mmtrd and the
+ * symbols known so far, and adds a line to <prefix>.flight.txt. The other
+ * threads keep running: their rings are copied one at a time under the
+ * ring's lock, which they only take to append a full batch, and symbolized
+ * from the copy. Their pending batches are not part of the dump.
+ */
+static void flight_dump(void *drcontext, const char *reason) {
+    per_thread_t *self = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+    if (self == NULL || self->flight == NULL) {
+        return;
+    }
+    flight_append(self);
+
+    dr_mutex_lock(flight_lock);
+    if (flight_dumps >= options.flight_dumps) {
+        dr_mutex_unlock(flight_lock);
+        return;
+    }
+
+    char name[64];
+    dr_snprintf(name, sizeof(name), "flight.%u.mmtrd", flight_dumps);
+    TraceContainer container;
+    uint threads = 0;
+    uint64 records = 0;
+    if (container.Open(output_path(name).c_str())) {
+        arena_trc_str snapshot(ArenaAllocator<trace_ref_t>(self->arena));
+        for (size_t t = 0; t < flight_threads.size(); t++) {
+            per_thread_t *data = flight_threads[t];
+            dr_mutex_lock(data->flight_lock);
+            snapshot.resize(data->flight->size());
+            for (size_t i = 0; i < snapshot.size(); i++) {
+                snapshot[i] = (*(data->flight))[i];
+            }
+            dr_mutex_unlock(data->flight_lock);
+            if (snapshot.empty()) {
+                continue;
+            }
+
+            ChunkedFile out;
+            out.Open(&container, data->thread_idx, dr_get_microseconds(), MMTRD_DEFAULT_CHUNK_SIZE,
+                options.output == REGINA_OUTPUT_COMPRESSED ? MMTRD_CHUNK_DELTA : 0);
+            out.BeginBatch(dr_get_microseconds());
+            if (options.output == REGINA_OUTPUT_COMPRESSED) {
+                CompressedFileIO filer;
+                trace_flush(snapshot, filer, &out, intern_symbol, *self->flush_batch);
+            } else {
+                FileIO<true, true> filer;
+                trace_flush(snapshot, filer, &out, intern_symbol, *self->flush_batch);
+            }
+            out.Close();
+            records += snapshot.size();
+            threads++;
+        }
+        container.Close();
+        write_symbols();
+    } else {
+        REGINA_LOG_ERROR("regina: cannot create '%s'\n", output_path(name).c_str());
+    }
+
+    FILE *f = std::fopen(output_path("flight.txt").c_str(), (flight_dumps == 0) ? "w" : "a");
+    if (f != NULL) {
+        if (flight_dumps == 0) {
+            std::fprintf(f, "# dump|reason|ms|threads|records\n");
+        }
+        std::fprintf(f, "%u|%s|%llu|%u|%llu\n", flight_dumps, reason,
+            static_cast<unsigned long long>(dr_get_milliseconds() - start_ms), threads,
+            static_cast<unsigned long long>(records));
+        std::fclose(f);
+    }
+    flight_dumps++;
+    dr_mutex_unlock(flight_lock);
+}
+
+
+/* Marker for -flight, see include/regina_flight.h. */
+static void wrap_flight_pre(void *wrapcxt, void **user_data) {
+    char reason[64];
+    size_t len = 0;
+    const char *tag = static_cast<const char *>(drwrap_get_arg(wrapcxt, 0));
+    // A tag near the end of a page is read partially.
+    if (tag == NULL || (!dr_safe_read(tag, sizeof(reason) - 1, reason, &len) && len == 0)) {
+        len = 0;
+    }
+    reason[len] = '\0';
+    len = strlen(reason);
+    for (size_t i = 0; i < len; i++) {
+        reason[i] = (reason[i] == '|' || reason[i] == '\n') ? ' ' : reason[i];
+    }
+    flight_dump(drwrap_get_drcontext(wrapcxt), (len > 0) ? reason : "marker");
+}
+
+
+#ifdef WIN32
+/* Only exceptions no handler took reach the filter, first-chance ones are ignored. */
+static void wrap_unhandled_pre(void *wrapcxt, void **user_data) {
+    flight_dump(drwrap_get_drcontext(wrapcxt), "unhandled exception");
+}
+#endif
+
+
+static void flight_module_load(const module_data_t *info) {
+    app_pc pc = watch_find_function(info, "regina_flight");
+    if (pc != NULL) {
+        drwrap_wrap(pc, wrap_flight_pre, NULL);
+    }
+#ifdef WIN32
+    // kernel32 or kernelbase, depending on the version of Windows
+    if ((pc = reinterpret_cast<app_pc>(dr_get_proc_address(info->handle, "UnhandledExceptionFilter"))) != NULL) {
+        drwrap_wrap(pc, wrap_unhandled_pre, NULL);
+    }
+#endif
+}
+
+
+/*
+ * end_batch
+ * Completes a flushed batch. When streaming, the symbols the ring has not
+ * seen yet are published before the records of the batch, so a consumer
+ * can resolve them. Every ring gets all symbols, whichever thread
+ * interned them. If the symbols are dropped, the records are dropped as
+ * well and the symbols are sent again with the next batch. The symbols
+ * are copied under symbol_lock but written without it, so a blocking ring
+ * does not stall the other threads.
+ */
+static void end_batch(per_thread_t *data) {
+    ShmRing *ring = data->fileIO->Ring();
+    if (ring == NULL) {
+        return;
+    }
+
+    const bool shared = (ring == shm_ring);
+    shm_published_t &published = shared ? shm_published : data->shm_published;
+    if (shared) {
+        dr_mutex_lock(shm_publish_lock);
+    }
+    dr_mutex_lock(symbol_lock);
+    const uint count = shm_symbol_count - published.count;
+    dr_string pending(ArenaAllocator<char>(data->arena));
+    if (count > 0) {
+        pending.assign(shm_symbols, published.bytes, dr_string::npos);
+    }
+    dr_mutex_unlock(symbol_lock);
+
+    bool complete = true;
+    if (count > 0) {
+        complete = ring->Write(SHM_FRAME_SYMBOLS, data->thread_idx, 0, count, pending.data(), pending.size());
+        if (complete) {
+            published.bytes += pending.size();
+            published.count += count;
+        }
+    }
+    if (complete) {
+        data->fileIO->EndBatch();
+    } else {
+        data->fileIO->DropBatch();
+    }
+    if (shared) {
+        dr_mutex_unlock(shm_publish_lock);
+    }
+}
+
+
+static void
+print_data(void *drcontext, FILE *f, app_pc addr, void *data_addr, uint size, const char *prefix) {
+    drsym_error_t symres;
+    drsym_info_t sym;
+    char name[MAX_SYM_RESULT];
+    char buf[MAX_SYM_RESULT];
+    char file[MAXIMUM_PATH];
+    module_data_t *data;
+    data = dr_lookup_module(addr);
+    if (data == NULL) {
+        fprintf(f, "%s ? %u %p\n", prefix, size, data_addr);
+        return;
+    }
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
+    sym.name_size = MAX_SYM_RESULT;
+    sym.file = file;
+    sym.file_size = MAXIMUM_PATH;
+    symres = drsym_lookup_address(data->full_path, addr - data->start, &sym,
+        DRSYM_DEFAULT_FLAGS);
+    if (symres == DRSYM_SUCCESS) {
+        //drsym_type_t *types = static_cast<drsym_type_t*>(dr_thread_alloc(drcontext, 3*sizeof(drsym_type_t)));
+        symres = drsym_expand_type(data->full_path, sym.type_id, 2, buf, MAX_SYM_RESULT, &types);
+        int i = 0;
+        int j = -1;
+        while (types[i].kind != DRSYM_TYPE_OTHER && i < 3) {
+            i++;
+            j++;
+        }
+        if (j >= 0) {
+            if (types[i].kind == DRSYM_TYPE_INT) {
+                fprintf(f, "%s INT %u %p\n", prefix, size, data_addr);
+            } else if (types[i].kind == DRSYM_TYPE_PTR) {
+                fprintf(f, "%s PTR %u %p\n", prefix, size, data_addr);
+            } else if (types[i].kind == DRSYM_TYPE_FUNC) {
+                fprintf(f, "%s FUNC %u %p\n", prefix, size, data_addr);
+            } else if (types[i].kind == DRSYM_TYPE_VOID) {
+                fprintf(f, "%s VOID %u %p\n", prefix, size, data_addr);
+            } else if (types[i].kind == DRSYM_TYPE_COMPOUND) {
+                fprintf(f, "%s COMPOUND %u %p\n", prefix, size, data_addr);
+            }
+        }
+        //dr_thread_free(drcontext, types, 3 * sizeof(drsym_type_t));
+    } else
+        fprintf(f, "%s ? %u %p\n", prefix, size, data_addr);
+    dr_free_module_data(data);
+}
+
+
+/*
+ * analyze_trace
+ * Feeds the buffered records of a thread to the enabled online analyses
+ * before they are written out.
+ */
+static void analyze_trace(per_thread_t *data) {
+    arena_trc_str &trace = *(data->trace);
+
+    if (options.sharing) {
+        for (size_t i = 0; i < trace.size(); i++) {
+            const trace_ref_t &ref = trace[i];
+            if (ref.is_mem_ref) {
+                sharing.Access(data->thread_idx, reinterpret_cast<uint64_t>(ref.data_addr), ref.size,
+                    ref.is_write != 0, reinterpret_cast<uint64_t>(ref.instr_addr));
+            }
+        }
+    }
+
+    if (options.working_set) {
+        // The whole batch is accounted to the window it is flushed in.
+        const uint64 window = (dr_get_milliseconds() - start_ms) / options.ws_window;
+        if (window != data->ws->Window()) {
+            close_ws_window(data, window, false);
+        }
+
+        std::string str;
+        for (size_t i = 0; i < trace.size(); i++) {
+            const trace_ref_t &ref = trace[i];
+            if (ref.is_mem_ref) {
+                size_t sym = 0;
+                if (options.ws_symbols) {
+                    auto it = data->sym_cache->find(ref.instr_addr);
+                    if (it != data->sym_cache->end()) {
+                        sym = it->second;
+                    } else {
+                        sym = intern_symbol(ref.instr_addr, NULL);
+                        data->sym_cache->insert(std::make_pair(ref.instr_addr, sym));
+                    }
+                }
+                data->ws->Add(reinterpret_cast<uint64_t>(ref.data_addr), sym);
+            }
+        }
+    }
+
+    if (options.patterns) {
+        for (size_t i = 0; i < trace.size(); i++) {
+            const trace_ref_t &ref = trace[i];
+            if (ref.is_mem_ref) {
+                data->patterns->Access(reinterpret_cast<uint64_t>(ref.instr_addr),
+                    reinterpret_cast<uint64_t>(ref.data_addr), ref.size);
+            }
+        }
+    }
+
+    if (options.values) {
+        for (size_t i = 0; i < trace.size(); i++) {
+            const trace_ref_t &ref = trace[i];
+            if (ref.is_mem_ref && ref.has_value) {
+                data->values->Access(reinterpret_cast<uint64_t>(ref.instr_addr),
+                    reinterpret_cast<uint64_t>(ref.data_addr), ref.size, ref.value, ref.is_write != 0);
+            }
+        }
+    }
+
+    if (options.loops) {
+        for (size_t i = 0; i < trace.size(); i++) {
+            const trace_ref_t &ref = trace[i];
+            if (ref.is_mem_ref && ref.loop > 0) {
+                data->loops->Access(ref.loop - 1, reinterpret_cast<uint64_t>(ref.instr_addr),
+                    reinterpret_cast<uint64_t>(ref.data_addr), ref.size);
+            }
+        }
+    }
+
+    if (options.roofline) {
+        for (size_t i = 0; i < trace.size(); i++) {
+            const trace_ref_t &ref = trace[i];
+            if (ref.is_mem_ref) {
+                data->roofline->Access(reinterpret_cast<uint64_t>(ref.instr_addr),
+                    reinterpret_cast<uint64_t>(ref.data_addr), ref.size, ref.is_write != 0);
+            }
+        }
+    }
+}
+
+
+/*
+ * close_ws_window
+ * Writes the current window of the thread and moves it on to window,
+ * unless it is the last one. With -ws_merge, the merged windows all
+ * threads have passed are written as well.
+ */
+static void close_ws_window(per_thread_t *data, const uint64 window, const bool last) {
+    dr_mutex_lock(ws_lock);
+    if (data->ws->Refs() > 0) {
+        data->ws->Write(ws_file, options.ws_window);
+        if (options.ws_merge) {
+            ws_series.Merge(*(data->ws));
+        }
+    }
+    if (!last) {
+        data->ws->Reset(window);
+    }
+    if (options.ws_merge) {
+        if (last) {
+            ws_series.Leave(data->thread_idx);
+        } else {
+            ws_series.Enter(data->thread_idx, window);
+        }
+        ws_series.Flush(ws_file, options.ws_window, (dr_get_milliseconds() - start_ms) / options.ws_window);
+    }
+    dr_mutex_unlock(ws_lock);
+}
+
+
+/*
+ * write_sharing_report
+ */
+static void write_sharing_report(void) {
+    std::vector<SharingTable::line_report_t> lines;
+    sharing.Top(SHARING_REPORT_LINES, lines);
+
+    FILE *f = std::fopen(output_path("sharing.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# line|transfers|true|false|class|threads|writers\n");
+    std::string str;
+    for (size_t i = 0; i < lines.size(); i++) {
+        const SharingTable::line_report_t &l = lines[i];
+        std::fprintf(f, "%p|%llu|%llu|%llu|%s|%u|", reinterpret_cast<void *>(l.line),
+            static_cast<unsigned long long>(l.transfers), static_cast<unsigned long long>(l.true_transfers),
+            static_cast<unsigned long long>(l.false_transfers),
+            (l.false_transfers > l.true_transfers) ? "false" : "true", l.sharers);
+        for (int j = 0; j < SHARING_WRITER_PCS && l.writer_pcs[j] != 0; j++) {
+            translate_addr(reinterpret_cast<app_pc>(l.writer_pcs[j]), str);
+            std::fprintf(f, "%s%p %s", (j > 0) ? "," : "", reinterpret_cast<void *>(l.writer_pcs[j]), str.c_str());
+        }
+        std::fprintf(f, "\n");
+    }
+    if (sharing.Dropped() > 0) {
+        std::fprintf(f, "# %llu accesses not tracked, increase -sharing_lines\n",
+            static_cast<unsigned long long>(sharing.Dropped()));
+    }
+    std::fclose(f);
+}
+
+
+/*
+ * write_pattern_report
+ */
+static void write_pattern_report(void) {
+    std::vector<std::pair<uint64_t, const pattern_t *>> pcs;
+    patterns.Sorted(pcs);
+
+    FILE *f = std::fopen(output_path("patterns.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# pc|symbol|count|class|stride|confidence|footprint\n");
+    std::string str;
+    for (size_t i = 0; i < pcs.size() && pcs[i].second->count >= PATTERN_REPORT_MIN_COUNT; i++) {
+        const pattern_t *p = pcs[i].second;
+        translate_addr(reinterpret_cast<app_pc>(pcs[i].first), str);
+        std::fprintf(f, "%p|%s|%llu|%s|%lld|%.2f|%llu\n", reinterpret_cast<void *>(pcs[i].first), str.c_str(),
+            static_cast<unsigned long long>(p->count), pattern_class_name(p->Classify()),
+            static_cast<long long>(p->strides[p->DominantStride()]), p->Confidence(),
+            static_cast<unsigned long long>(p->Footprint()));
+    }
+    std::fclose(f);
+}
+
+
+/*
+ * write_value_report
+ */
+static void write_value_report(void) {
+    std::vector<std::pair<uint64_t, const value_stats_t *>> pcs;
+    values.Sorted(pcs);
+
+    FILE *f = std::fopen(output_path("values.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# pc|symbol|loads|redundant loads|rate|stores|resolved stores|silent stores|rate\n");
+    std::string str;
+    for (size_t i = 0; i < pcs.size(); i++) {
+        const value_stats_t *v = pcs[i].second;
+        translate_addr(reinterpret_cast<app_pc>(pcs[i].first), str);
+        std::fprintf(f, "%p|%s|%llu|%llu|%.2f|%llu|%llu|%llu|%.2f\n", reinterpret_cast<void *>(pcs[i].first),
+            str.c_str(), static_cast<unsigned long long>(v->loads), static_cast<unsigned long long>(v->redundant),
+            (v->loads > 0) ? static_cast<double>(v->redundant) / static_cast<double>(v->loads) : 0.0,
+            static_cast<unsigned long long>(v->stores), static_cast<unsigned long long>(v->resolved),
+            static_cast<unsigned long long>(v->silent),
+            (v->resolved > 0) ? static_cast<double>(v->silent) / static_cast<double>(v->resolved) : 0.0);
+    }
+    std::fclose(f);
+}
+
+
+/*
+ * mix_functions
+ * Sums the executed blocks per function.
+ */
+static void mix_functions(std::unordered_map<std::string, function_mix_t> &functions) {
+    std::string str;
+    for (size_t i = 0; i < mix_blocks.size(); i++) {
+        if (mix_executions[i] > 0) {
+            translate_addr(reinterpret_cast<app_pc>(mix_blocks[i].pc), str);
+            functions[str].Add(mix_blocks[i], mix_executions[i]);
+        }
+    }
+}
+
+
+/*
+ * write_mix_report
+ * Sums the executed blocks per function, most instructions first.
+ */
+static void write_mix_report(void) {
+    std::unordered_map<std::string, function_mix_t> functions;
+    mix_functions(functions);
+    std::vector<std::pair<uint64_t, std::string> > order;
+    for (auto it = functions.begin(); it != functions.end(); ++it) {
+        order.push_back(std::make_pair(it->second.instrs, it->first));
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<uint64_t, std::string> &l,
+        const std::pair<uint64_t, std::string> &r) {
+        return (l.first != r.first) ? l.first > r.first : l.second < r.second;
+    });
+
+    FILE *f = std::fopen(output_path("mix.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# function|blocks|instructions");
+    for (int c = 0; c < MIX_CLASSES; c++) {
+        std::fprintf(f, "|%s", mix_class_name(c));
+    }
+    std::fprintf(f, "|loads|stores|gprs|simd registers|registers per block\n");
+    for (size_t i = 0; i < order.size(); i++) {
+        const function_mix_t &m = functions[order[i].second];
+        std::fprintf(f, "%s|%llu|%llu", order[i].second.c_str(), static_cast<unsigned long long>(m.executions),
+            static_cast<unsigned long long>(m.instrs));
+        for (int c = 0; c < MIX_CLASSES; c++) {
+            std::fprintf(f, "|%llu", static_cast<unsigned long long>(m.classes[c]));
+        }
+        std::fprintf(f, "|%llu|%llu|%u|%u|%.2f\n", static_cast<unsigned long long>(m.loads),
+            static_cast<unsigned long long>(m.stores), mix_popcount(m.regs & 0xFFFFull),
+            mix_popcount(m.regs & ~0xFFFFull), m.Pressure());
+    }
+    if (mix_dropped > 0) {
+        std::fprintf(f, "# %llu blocks not counted, increase -mix_blocks\n", static_cast<unsigned long long>(mix_dropped));
+    }
+    std::fclose(f);
+}
+
+
+/*
+ * write_roofline_report
+ * Operations of the counted blocks and bytes of the traced references per
+ * function, most operations first. A function is memory bound if its
+ * operations per DRAM byte stay below the machine balance.
+ */
+static void write_roofline_report(void) {
+    typedef struct _roofline_function_t {
+        uint64_t flops;
+        roofline_stats_t bytes;
+
+        inline _roofline_function_t(void) : flops(0) { }
+    } roofline_function_t;
+
+    std::unordered_map<std::string, roofline_function_t> functions;
+    std::unordered_map<std::string, function_mix_t> mixes;
+    mix_functions(mixes);
+    for (auto it = mixes.begin(); it != mixes.end(); ++it) {
+        functions[it->first].flops = it->second.flops;
+    }
+    std::string str;
+    for (auto it = roofline_profile.Pcs().begin(); it != roofline_profile.Pcs().end(); ++it) {
+        translate_addr(reinterpret_cast<app_pc>(it->first), str);
+        functions[str].bytes.Merge(it->second);
+    }
+
+    std::vector<std::pair<std::pair<uint64_t, uint64_t>, std::string> > order;
+    roofline_function_t total;
+    for (auto it = functions.begin(); it != functions.end(); ++it) {
+        order.push_back(std::make_pair(std::make_pair(it->second.flops, it->second.bytes.bytes), it->first));
+        total.flops += it->second.flops;
+        total.bytes.Merge(it->second.bytes);
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<std::pair<uint64_t, uint64_t>, std::string> &l,
+        const std::pair<std::pair<uint64_t, uint64_t>, std::string> &r) {
+        return (l.first != r.first) ? l.first > r.first : l.second < r.second;
+    });
+
+    FILE *f = std::fopen(output_path("roofline.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# LLC %llu bytes, machine balance %.2f flops/byte\n",
+        static_cast<unsigned long long>(options.roofline_llc), options.roofline_balance);
+    std::fprintf(f, "# function|flops|bytes|dram bytes|flops/byte|flops/dram byte|bound\n");
+    for (size_t i = 0; i <= order.size(); i++) {
+        const roofline_function_t &r = (i < order.size()) ? functions[order[i].second] : total;
+        const double intensity = (r.bytes.bytes > 0) ? static_cast<double>(r.flops) / r.bytes.bytes : 0.0;
+        const double dram = (r.bytes.dram > 0) ? static_cast<double>(r.flops) / r.bytes.dram : 0.0;
+        // Without DRAM traffic a function runs from the caches.
+        const bool memory = r.bytes.dram > 0 && dram < options.roofline_balance;
+        std::fprintf(f, "%s|%llu|%llu|%llu|%.3f|%.3f|%s\n", (i < order.size()) ? order[i].second.c_str() : "(all)",
+            static_cast<unsigned long long>(r.flops), static_cast<unsigned long long>(r.bytes.bytes),
+            static_cast<unsigned long long>(r.bytes.dram), intensity, dram, memory ? "memory" : "compute");
+    }
+    if (mix_dropped > 0) {
+        std::fprintf(f, "# %llu blocks not counted, increase -mix_blocks\n", static_cast<unsigned long long>(mix_dropped));
+    }
+    std::fclose(f);
+}
+
+
+/*
+ * write_loop_report
+ * Loops by bytes accessed. Iterations are executions of the head. A loop
+ * entered at its head runs the head without coming from a back edge once
+ * per entry; a loop entered by a jump to its condition (at the latch) only
+ * runs the head from back edges, but leaves through the latch once per
+ * entry. Entries are the larger of both, so loops left by a break still
+ * count. The pattern is that of the loop's busiest instruction.
+ */
+static void write_loop_report(void) {
+    std::vector<std::pair<uint64_t, int> > order;
+    for (size_t i = 0; i < loop_table.Size(); i++) {
+        const loop_stats_t *stats = loop_profile.Get(static_cast<int>(i));
+        order.push_back(std::make_pair((stats != NULL) ? stats->bytes : 0, static_cast<int>(i)));
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<uint64_t, int> &l, const std::pair<uint64_t, int> &r) {
+        if (l.first != r.first) {
+            return l.first > r.first;
+        }
+        return loop_counts[LOOP_COUNTERS * l.second] > loop_counts[LOOP_COUNTERS * r.second];
+    });
+
+    FILE *f = std::fopen(output_path("loops.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# loop|head|symbol|end|entries|iterations|trip count|accesses|bytes|lines|pattern|stride\n");
+    std::string str;
+    for (size_t i = 0; i < order.size(); i++) {
+        const int id = order[i].second;
+        const loop_t &l = loop_table.Get(id);
+        const uint64 iterations = loop_counts[LOOP_COUNTERS * id];
+        const uint64 backEdges = loop_counts[LOOP_COUNTERS * id + 1];
+        const uint64 exits = loop_counts[LOOP_COUNTERS * id + 2];
+        const uint64 entries = std::max((iterations > backEdges) ? iterations - backEdges : 0, exits);
+        if (iterations == 0 && order[i].first == 0) {
+            continue;
+        }
+        const loop_stats_t *stats = loop_profile.Get(id);
+        translate_addr(reinterpret_cast<app_pc>(l.head), str);
+        std::fprintf(f, "%d|%p|%s|%p|%llu|%llu|%.1f|%llu|%llu|%.0f|", id, reinterpret_cast<void *>(l.head),
+            str.c_str(), reinterpret_cast<void *>(l.end), static_cast<unsigned long long>(entries),
+            static_cast<unsigned long long>(iterations),
+            (entries > 0) ? static_cast<double>(iterations) / static_cast<double>(entries) : 0.0,
+            static_cast<unsigned long long>((stats != NULL) ? stats->accesses : 0),
+            static_cast<unsigned long long>(order[i].first), (stats != NULL) ? stats->lines.Estimate() : 0.0);
+        const pattern_t *p = (stats != NULL) ? stats->Dominant() : NULL;
+        if (p == NULL) {
+            std::fprintf(f, "-|-\n");
+        } else if (p->Classify() == PATTERN_SEQUENTIAL || p->Classify() == PATTERN_STRIDED) {
+            std::fprintf(f, "%s|%lld\n", pattern_class_name(p->Classify()),
+                static_cast<long long>(p->strides[p->DominantStride()]));
+        } else {
+            std::fprintf(f, "%s|-\n", pattern_class_name(p->Classify()));
+        }
+    }
+    if (loop_table.Size() >= loop_table.Capacity()) {
+        std::fprintf(f, "# loop table full, increase -loops_max\n");
+    }
+    std::fclose(f);
+}
+
+
+/*
+ * output_path
+ * Path of an output file: <out_dir>/<prefix>.<name>.
+ */
+static std::string output_path(const char *name) {
+    std::string path = options.out_dir;
+    if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\') {
+        path += '/';
+    }
+    return path + options.prefix + "." + name;
+}
+
+
+/*
+ * write_symbols
+ * Writes the symbols of all traces; after each flight dump again, so a
+ * dump can be read before the run ends.
+ */
+static void write_symbols(void) {
+    dr_mutex_lock(symbol_lock);
+    FILE *lookupIO = std::fopen(output_path("0.mmtrd.txt").c_str(), "w");
+    if (lookupIO != NULL) {
+        symbols.Write(lookupIO);
+        std::fclose(lookupIO);
+    }
+    dr_mutex_unlock(symbol_lock);
+}
+
+
+/*
+ * write_heap_report
+ * Client memory from DR's heap: the arenas of all threads (peaks summed
+ * over threads) and the global heap of shared tables. What DR reserves
+ * for its global heap is not known to the client, so that row has no
+ * reserved bytes.
+ */
+static void write_heap_report(void) {
+    FILE *f = std::fopen(output_path("heap.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    const global_heap_stats_t &global = dr_heap_global_stats();
+    std::fprintf(f, "# heap|allocations|frees|bytes in use|peak bytes|reserved bytes\n");
+    std::fprintf(f, "threads|%llu|%llu|%llu|%llu|%llu\n", static_cast<unsigned long long>(arena_stats.allocations),
+        static_cast<unsigned long long>(arena_stats.frees), static_cast<unsigned long long>(arena_stats.bytes),
+        static_cast<unsigned long long>(arena_stats.peak), static_cast<unsigned long long>(arena_stats.reserved));
+    std::fprintf(f, "global|%llu|%llu|%llu|%llu|-\n", static_cast<unsigned long long>(global.allocations.load()),
+        static_cast<unsigned long long>(global.frees.load()), static_cast<unsigned long long>(global.bytes.load()),
+        static_cast<unsigned long long>(global.peak.load()));
+    std::fclose(f);
+}
+
+
+/*
+ * write_callgraph_report
+ */
+static void write_callgraph_report(void) {
+    std::vector<CallGraph::edge_count_t> edges;
+    call_graph.Sorted(edges);
+
+    FILE *f = std::fopen(output_path("callgraph.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# caller|caller symbol|target|target symbol|count|kind\n");
+    std::string caller, target;
+    for (size_t i = 0; i < edges.size(); i++) {
+        const CallGraph::edge_count_t &e = edges[i];
+        translate_addr(reinterpret_cast<app_pc>(e.edge.caller), caller);
+        translate_addr(reinterpret_cast<app_pc>(e.edge.target), target);
+        std::fprintf(f, "%p|%s|%p|%s|%llu|%s\n", reinterpret_cast<void *>(e.edge.caller), caller.c_str(),
+            reinterpret_cast<void *>(e.edge.target), target.c_str(),
+            static_cast<unsigned long long>(e.count), e.indirect ? "ind" : "direct");
+    }
+    std::fclose(f);
+}
+
+
+/*
+ * write_bbv_report
+ * Writes the intervals selected by the clustering. The basic-block vectors
+ * themselves were written in SimPoint's frequency vector format
+ * (regina.N.bb, one line per interval, slots are 1-based) as the intervals
+ * closed.
+ */
+static void write_bbv_report(void) {
+    std::sort(bbv_intervals.begin(), bbv_intervals.end(), [](const simpoint_interval_t &a, const simpoint_interval_t &b) {
+        return (a.thread_idx != b.thread_idx) ? a.thread_idx < b.thread_idx : a.index < b.index;
+    });
+
+    std::vector<simpoint_t> points;
+    const size_t k = simpoint_select(bbv_intervals, options.bbv_k, points);
+    FILE *f = std::fopen(output_path("simpoints.txt").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    std::fprintf(f, "# %llu intervals of %llu instructions, %llu blocks, %llu clusters\n",
+        static_cast<unsigned long long>(bbv_intervals.size()), static_cast<unsigned long long>(options.bbv_interval),
+        static_cast<unsigned long long>(block_slots.Size()), static_cast<unsigned long long>(k));
+    std::fprintf(f, "# thread|interval|cluster|weight|first instruction\n");
+    for (size_t i = 0; i < points.size(); i++) {
+        const simpoint_interval_t &iv = bbv_intervals[points[i].interval];
+        std::fprintf(f, "%u|%llu|%llu|%.6f|%llu\n", iv.thread_idx, static_cast<unsigned long long>(iv.index),
+            static_cast<unsigned long long>(points[i].cluster), points[i].weight,
+            static_cast<unsigned long long>(iv.index * options.bbv_interval));
+    }
+    std::fclose(f);
+}
+
+
+/* Reads the thread|interval pairs of a regina.simpoints.txt file. */
+static bool read_simpoints(const char *path) {
+    FILE *f = std::fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[256];
+    unsigned long long thread, interval;
+    while (std::fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] != '#' && sscanf(line, "%llu|%llu", &thread, &interval) == 2) {
+            simpoint_intervals.insert(std::make_pair(static_cast<uint64>(thread), static_cast<uint64>(interval)));
+        }
+    }
+    std::fclose(f);
+    return true;
+}
+
+
+/*
+ * push_trace
+ * Appends a record to the batch of the thread, flushing the batch first if
+ * it is full. Every record goes through here, so the batch stays bounded
+ * whichever kind of record a thread produces.
+ */
+static void push_trace(per_thread_t *data, const trace_ref_t &ref) {
+    if (data->trace->size() > MAX_TRACE_STORAGE_SIZE) {
+        if (data->flight != NULL) {
+            flight_append(data);
+        } else {
+            analyze_trace(data);
+            data->fileIO->BeginBatch(dr_get_microseconds());
+            flush_trace(data);
+            end_batch(data);
+            data->trace->clear();
+        }
+    }
+    data->trace->push_back(ref);
+}
+
+
+static dr_mcontext_t mc;
+/*
+* cb_mem_ref
+*/
+static void cb_mem_ref(/*instr_t *where, int pos, bool is_write*/) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+
+    int thread_idx = data->thread_idx;
+
+    //trace_ref_t trace(*(data->buf));
+    /*trace.instr_addr = data->buf->instr_addr;
+    trace.data_addr = data->buf->data_addr;
+    trace.is_call = data->buf->is_call;
+    trace.is_mem_ref = data->buf->is_mem_ref;
+    trace.is_write = data->buf->is_write;
+    trace.size = data->buf->size;
+    trace.target_addr = data->buf->target_addr;*/
+    // The inline check only compared against the envelope of the watch ranges.
+    if (!options.watch || watch_contains(reinterpret_cast<uint64>(data->buf->data_addr))) {
+        // Called before the access; if it is going to fault, the application takes the fault, not regina.
+        if (data->buf->has_value) {
+            data->buf->value = 0;
+            data->buf->has_value = dr_safe_read(data->buf->data_addr, data->buf->size, &data->buf->value, NULL);
+        }
+        push_trace(data, *(data->buf));
+    }
+    memset(data->buf, 0, sizeof(trace_ref_t));
+}
+
+
+/*
+ * value_capturable
+ * Whether -values reads the contents of a reference: scalar sizes that fit
+ * a register, and only instructions that really access the operand.
+ */
+static bool value_capturable(instr_t *where, const uint size) {
+    if (size != 1 && size != 2 && size != 4 && size != sizeof(reg_t)) {
+        return false;
+    }
+    const char *name = decode_opcode_name(instr_get_opcode(where));
+    return strncmp(name, "prefetch", 8ul) != 0 && strncmp(name, "nop", 3ul) != 0;
+}
+
+
+static void instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where, int pos, bool iswrite) {
+    drvector_t allowed;
+
+    drreg_init_and_fill_vector(&allowed, false);
+    drreg_set_vector_entry(&allowed, DR_REG_XCX, true);
+
+    reg_id_t reg_ptr, reg_tmp;
+    if (drreg_reserve_register(drcontext, ilist, where, &allowed, &reg_ptr) !=
+        DRREG_SUCCESS ||
+        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_tmp) !=
+        DRREG_SUCCESS) {
+        DR_ASSERT(false); /* cannot recover */
+        return;
+    }
+    drvector_delete(&allowed);
+
+    instr_t *instr, *restore;
+    opnd_t opnd1, opnd2, ref;
+
+    if (iswrite) {
+        ref = instr_get_dst(where, pos);
+    } else {
+        ref = instr_get_src(where, pos);
+    }
+
+    drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg_tmp, reg_ptr);
+
+    // skip references outside the envelope of the watch ranges or the selected intervals
+    instr_t *skip = NULL;
+    if (options.watch || !options.simpoints.empty()) {
+        if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS) {
+            DR_ASSERT(false); /* cannot recover */
+            return;
+        }
+        skip = INSTR_CREATE_label(drcontext);
+    }
+    if (options.watch) {
+        instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)&watch_envelope, opnd_create_reg(reg_ptr),
+            ilist, where, NULL, NULL);
+        opnd1 = opnd_create_reg(reg_tmp);
+        opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(watch_envelope_t, lo));
+        instr = INSTR_CREATE_cmp(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+        instr = INSTR_CREATE_jcc(drcontext, OP_jb, opnd_create_instr(skip));
+        instrlist_meta_preinsert(ilist, where, instr);
+        opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(watch_envelope_t, hi));
+        instr = INSTR_CREATE_cmp(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+        instr = INSTR_CREATE_jcc(drcontext, OP_jae, opnd_create_instr(skip));
+        instrlist_meta_preinsert(ilist, where, instr);
+    }
+
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg_ptr);
+    if (!options.simpoints.empty()) {
+        opnd1 = OPND_CREATE_MEM32(reg_ptr, offsetof(per_thread_t, trace_off));
+        opnd2 = OPND_CREATE_INT32(0);
+        instr = INSTR_CREATE_cmp(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+        instr = INSTR_CREATE_jcc(drcontext, OP_jne, opnd_create_instr(skip));
+        instrlist_meta_preinsert(ilist, where, instr);
+    }
+    // read tls field
+    opnd1 = opnd_create_reg(reg_ptr);
+    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, buf));
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    // store is_write
+    opnd1 = OPND_CREATE_MEM32(reg_ptr, offsetof(trace_ref_t, is_write));
+    opnd2 = OPND_CREATE_INT32(iswrite);
+    instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    // store is_mem_ref
+    opnd1 = OPND_CREATE_MEM32(reg_ptr, offsetof(trace_ref_t, is_mem_ref));
+    opnd2 = OPND_CREATE_INT32(true);
+    instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    // store data addr
+    opnd1 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(trace_ref_t, data_addr));
+    opnd2 = opnd_create_reg(reg_tmp);
+    instr = INSTR_CREATE_mov_st(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    // store data size
+    const uint size = drutil_opnd_mem_size_in_bytes(ref, where);
+    opnd1 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(trace_ref_t, size));
+    opnd2 = OPND_CREATE_INT32(size);
+    instr = INSTR_CREATE_mov_st(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    // ask for the memory contents before the access, cb_mem_ref reads them
+    if (options.values && value_capturable(where, size)) {
+        opnd1 = OPND_CREATE_MEM32(reg_ptr, offsetof(trace_ref_t, has_value));
+        opnd2 = OPND_CREATE_INT32(true);
+        instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+    }
+
+    // store pc
+    opnd1 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(trace_ref_t, instr_addr));
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)instr_get_app_pc(where), opnd1, ilist, where, NULL, NULL);
+
+    // store the innermost loop known at translation time
+    if (options.loops) {
+        dr_mutex_lock(loop_lock);
+        const int loop = loop_table.Innermost(reinterpret_cast<uint64>(instr_get_app_pc(where)));
+        dr_mutex_unlock(loop_lock);
+        if (loop >= 0) {
+            opnd1 = OPND_CREATE_MEM32(reg_ptr, offsetof(trace_ref_t, loop));
+            opnd2 = OPND_CREATE_INT32(loop + 1);
+            instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
+            instrlist_meta_preinsert(ilist, where, instr);
+        }
+    }
+
+    // load trampoline address (per thread, so the code stays position independent)
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg_tmp);
+    opnd1 = opnd_create_reg(reg_tmp);
+    opnd2 = OPND_CREATE_MEMPTR(reg_tmp, offsetof(per_thread_t, code_cache));
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    // store return address (pc-relative)
+    restore = INSTR_CREATE_label(drcontext);
+    opnd1 = opnd_create_reg(reg_ptr);
+    opnd2 = opnd_create_mem_instr(restore, 0, OPSZ_lea);
+    instr = INSTR_CREATE_lea(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    // jump to clean call
+    opnd1 = opnd_create_reg(reg_tmp);
+    instr = INSTR_CREATE_jmp_ind(drcontext, opnd1);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    instrlist_meta_preinsert(ilist, where, restore);
+
+    if (skip != NULL) {
+        instrlist_meta_preinsert(ilist, where, skip);
+        if (drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+            DR_ASSERT(false);
+    }
+
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS ||
+        drreg_unreserve_register(drcontext, ilist, where, reg_tmp) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+}
+
+
+static void at_call(app_pc instr_addr, app_pc target_addr) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+    if (data->trace_off) {
+        return;
+    }
+
+    trace_ref_t trace;
+    trace.is_mem_ref = false;
+    trace.is_call = true;
+    trace.is_ind = false;
+    trace.instr_addr = instr_addr;
+    trace.target_addr = target_addr;
+
+    push_trace(data, trace);
+}
+
+
+static void at_call_ind(app_pc instr_addr, app_pc target_addr) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+    if (data->trace_off) {
+        return;
+    }
+
+    trace_ref_t trace;
+    trace.is_mem_ref = false;
+    trace.is_call = true;
+    trace.is_ind = true;
+    trace.instr_addr = instr_addr;
+    trace.target_addr = target_addr;
+
+    push_trace(data, trace);
+}
+
+
+static void at_return(app_pc instr_addr, app_pc target_addr) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+    if (data->trace_off) {
+        return;
+    }
+
+    trace_ref_t trace;
+    trace.is_mem_ref = false;
+    trace.is_call = false;
+    trace.is_ind = false;
+    trace.instr_addr = instr_addr;
+    trace.target_addr = target_addr;
+
+    push_trace(data, trace);
+}
+
+
+/*
+ * Call graph mode: slow paths of the inline edge counters.
+ */
+static void cg_call_slow(app_pc instr_addr, app_pc target_addr) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+
+    data->cg_edges->Add(reinterpret_cast<uint64_t>(instr_addr), reinterpret_cast<uint64_t>(target_addr), false, 1);
+}
+
+
+static void cg_call_ind_slow(app_pc instr_addr, app_pc target_addr) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+
+    data->cg_edges->Add(reinterpret_cast<uint64_t>(instr_addr), reinterpret_cast<uint64_t>(target_addr), true, 1);
+}
+
+
+static void cg_call_ind_miss(uint slot, app_pc instr_addr, app_pc target_addr) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+
+    cg_slot_t &s = data->cg_slots[slot];
+    if (s.count == 0) {
+        // The first target seen by this thread takes the inline counter.
+        s.target = reinterpret_cast<uint64_t>(target_addr);
+        s.count = 1;
+    } else {
+        data->cg_edges->Add(reinterpret_cast<uint64_t>(instr_addr), reinterpret_cast<uint64_t>(target_addr), true, 1);
+    }
+}
+
+
+/*
+ * instrument_call_count
+ * Call graph mode: increments the per-thread counter of the call site
+ * inline. Indirect calls compare the target with the one cached in the
+ * slot and only take a clean call if it differs.
+ */
+static void instrument_call_count(void *drcontext, instrlist_t *ilist, instr_t *where, bool indirect) {
+    app_pc caller = instr_get_app_pc(where);
+    app_pc target = indirect ? NULL : opnd_get_pc(instr_get_target(where));
+
+    dr_mutex_lock(cg_lock);
+    int slot = call_sites.Assign(reinterpret_cast<uint64_t>(caller), reinterpret_cast<uint64_t>(target));
+    dr_mutex_unlock(cg_lock);
+
+    if (slot < 0) {
+        // No slot left, count through a clean call.
+        if (indirect) {
+            dr_insert_mbr_instrumentation(drcontext, ilist, where, (app_pc)cg_call_ind_slow, SPILL_SLOT_1);
+        } else {
+            dr_insert_call_instrumentation(drcontext, ilist, where, (app_pc)cg_call_slow);
+        }
+        return;
+    }
+
+    reg_id_t reg_ptr, reg_tgt;
+    if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS ||
+        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_ptr) != DRREG_SUCCESS ||
+        (indirect && drreg_reserve_register(drcontext, ilist, where, NULL, &reg_tgt) != DRREG_SUCCESS)) {
+        DR_ASSERT(false); /* cannot recover */
+        return;
+    }
+
+    const int disp = slot * static_cast<int>(sizeof(cg_slot_t));
+    instr_t *instr, *miss = NULL, *done = NULL;
+    opnd_t opnd1, opnd2;
+
+    if (indirect) {
+        // load the app's call target
+        opnd_t ref = instr_get_target(where);
+        if (opnd_is_reg(ref)) {
+            drreg_get_app_value(drcontext, ilist, where, opnd_get_reg(ref), reg_tgt);
+        } else {
+            drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg_tgt, reg_ptr);
+            opnd1 = opnd_create_reg(reg_tgt);
+            opnd2 = OPND_CREATE_MEMPTR(reg_tgt, 0);
+            instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+            instrlist_meta_preinsert(ilist, where, instr);
+        }
+    }
+
+    // read the slots of this thread
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg_ptr);
+    opnd1 = opnd_create_reg(reg_ptr);
+    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, cg_slots));
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    if (indirect) {
+        // compare with the cached target
+        miss = INSTR_CREATE_label(drcontext);
+        done = INSTR_CREATE_label(drcontext);
+        opnd1 = opnd_create_reg(reg_tgt);
+        opnd2 = OPND_CREATE_MEMPTR(reg_ptr, disp + offsetof(cg_slot_t, target));
+        instr = INSTR_CREATE_cmp(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+        instr = INSTR_CREATE_jcc(drcontext, OP_jne, opnd_create_instr(miss));
+        instrlist_meta_preinsert(ilist, where, instr);
+    }
+
+    // increment the counter
+    opnd1 = OPND_CREATE_MEM64(reg_ptr, disp + offsetof(cg_slot_t, count));
+    instr = INSTR_CREATE_inc(drcontext, opnd1);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    if (indirect) {
+        instr = INSTR_CREATE_jmp(drcontext, opnd_create_instr(done));
+        instrlist_meta_preinsert(ilist, where, instr);
+        instrlist_meta_preinsert(ilist, where, miss);
+        dr_insert_clean_call(drcontext, ilist, where, (void *)cg_call_ind_miss, false, 3,
+            OPND_CREATE_INT32(slot), OPND_CREATE_INTPTR(caller), opnd_create_reg(reg_tgt));
+        instrlist_meta_preinsert(ilist, where, done);
+    }
+
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS ||
+        (indirect && drreg_unreserve_register(drcontext, ilist, where, reg_tgt) != DRREG_SUCCESS) ||
+        drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+}
+
+
 /*
-* cb_mem_ref
-*/
-static void cb_mem_ref(/*instr_t *where, int pos, bool is_write*/) {
+ * Vector memory accesses.
+ * drutil cannot compute the addresses of gathers (VSIB operands) and knows
+ * nothing about masks, so these instructions are traced by a clean call
+ * that decodes the instruction and reads the index and mask registers from
+ * the machine context. Every active element becomes a memory reference,
+ * adjacent active elements are merged into one.
+ */
+#define VECTOR_GATHER 0         //< vgather*, vpgather*
+#define VECTOR_MASKED 1         //< vmaskmov*, vpmaskmov*: mask bit per element
+#define VECTOR_BYTE_MASKED 2    //< maskmovq, (v)maskmovdqu: mask bit per byte, stores to [xdi]
+
+typedef struct _vector_shape_t {
+    int kind;
+    uint elem_size;
+    uint index_size;    //< gathers only
+} vector_shape_t;
+
+
+static bool vector_shape(const int opcode, vector_shape_t &shape) {
+    shape.index_size = 0;
+    switch (opcode) {
+    case OP_vgatherdps: case OP_vpgatherdd:
+        shape.kind = VECTOR_GATHER; shape.elem_size = 4; shape.index_size = 4; return true;
+    case OP_vgatherdpd: case OP_vpgatherdq:
+        shape.kind = VECTOR_GATHER; shape.elem_size = 8; shape.index_size = 4; return true;
+    case OP_vgatherqps: case OP_vpgatherqd:
+        shape.kind = VECTOR_GATHER; shape.elem_size = 4; shape.index_size = 8; return true;
+    case OP_vgatherqpd: case OP_vpgatherqq:
+        shape.kind = VECTOR_GATHER; shape.elem_size = 8; shape.index_size = 8; return true;
+    case OP_vmaskmovps: case OP_vpmaskmovd:
+        shape.kind = VECTOR_MASKED; shape.elem_size = 4; return true;
+    case OP_vmaskmovpd: case OP_vpmaskmovq:
+        shape.kind = VECTOR_MASKED; shape.elem_size = 8; return true;
+    case OP_maskmovq: case OP_maskmovdqu: case OP_vmaskmovdqu:
+        shape.kind = VECTOR_BYTE_MASKED; shape.elem_size = 1; return true;
+    default:
+        return false;
+    }
+}
+
+
+static void push_vector_ref(per_thread_t *data, trace_ref_t &ref, const uint64 addr, const uint size) {
+    if (size == 0 || (options.watch && !watch_contains(addr))) {
+        return;
+    }
+    ref.data_addr = reinterpret_cast<void *>(addr);
+    ref.size = size;
+    push_trace(data, ref);
+}
+
+
+static void at_vector_mem(app_pc instr_addr) {
     void *drcontext = dr_get_current_drcontext();
     per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+    if (data->trace_off) {
+        return;
+    }
 
-    int thread_idx = data->thread_idx;
-#if 1
-    if (trace_storage[data->thread_idx].size() > MAX_TRACE_STORAGE_SIZE) {
-        // print out
-        for (int i = 0; i < trace_storage[data->thread_idx].size(); i++) {
-            trace_ref_t &tmp = trace_storage[data->thread_idx][i];
-            if (tmp.is_mem_ref) {
-                //fprintf(data->f, "mem %p\n", tmp.instr_addr);
-                if (tmp.is_write) {
-                    std::string str;
-                    _FileIO::MemRef_t mrt;
-                    mrt.is_write = true;
-                    mrt.instr = tmp.instr_addr;
-                    mrt.size = tmp.size;
-                    mrt.data = tmp.data_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        mrt.symIdx = it->second;
-                    } else {
-                        mrt.symIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    mrt.instrSym = str;
-                    filer.Print(data->fileIO, _FileIO::RefType::MemRef, &mrt);
-
-                    /*print_address(data->f, tmp.instr_addr, "\t\t mem write @ ");
-                    print_data(drcontext, data->f, tmp.instr_addr, tmp.data_addr, tmp.size, "\t\t\t type ");*/
-                    //fprintf(data->f, "\t\t\t %u %p\n", tmp.size, tmp.data_addr);
-                } else {
-                    std::string str;
-                    _FileIO::MemRef_t mrt;
-                    mrt.is_write = false;
-                    mrt.instr = tmp.instr_addr;
-                    mrt.size = tmp.size;
-                    mrt.data = tmp.data_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        mrt.symIdx = it->second;
-                    } else {
-                        mrt.symIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    mrt.instrSym = str;
-                    filer.Print(data->fileIO, _FileIO::RefType::MemRef, &mrt);
+    vector_shape_t shape;
+    instr_t instr;
+    instr_init(drcontext, &instr);
+    if (decode(drcontext, instr_addr, &instr) == NULL || !vector_shape(instr_get_opcode(&instr), shape)) {
+        instr_free(drcontext, &instr);
+        return;
+    }
 
-                    /*print_address(data->f, tmp.instr_addr, "\t\t mem read @ ");
-                    print_data(drcontext, data->f, tmp.instr_addr, tmp.data_addr, tmp.size, "\t\t\t type ");*/
-                    //fprintf(data->f, "\t\t\t %u %p\n", tmp.size, tmp.data_addr);
-                }
-            } else {
-                if (tmp.is_call) {
-                    std::string str;
-
-                    _FileIO::CallRetRef_t crt;
-                    crt.instr = tmp.instr_addr;
-                    crt.target = tmp.target_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.instrSymIdx = it->second;
-                    } else {
-                        crt.instrSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.instrSym = str;
-                    translate_addr(tmp.target_addr, str);
-                    it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.targetSymIdx = it->second;
-                    } else {
-                        crt.targetSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.targetSym = str;
+    dr_mcontext_t mcontext;
+    mcontext.size = sizeof(mcontext);
+    mcontext.flags = DR_MC_ALL;
+    dr_get_mcontext(drcontext, &mcontext);
+
+    // The mask is the first vector source, of maskmovq/maskmovdqu the last.
+    opnd_t mem = opnd_create_null();
+    reg_id_t mask = DR_REG_NULL;
+    bool is_write = false;
+    for (int i = 0; i < instr_num_dsts(&instr); i++) {
+        if (opnd_is_memory_reference(instr_get_dst(&instr, i))) {
+            mem = instr_get_dst(&instr, i);
+            is_write = true;
+        }
+    }
+    for (int i = 0; i < instr_num_srcs(&instr); i++) {
+        opnd_t src = instr_get_src(&instr, i);
+        if (opnd_is_memory_reference(src)) {
+            mem = src;
+        } else if (opnd_is_reg(src) && (reg_is_xmm(opnd_get_reg(src)) || reg_is_mmx(opnd_get_reg(src))) &&
+            (mask == DR_REG_NULL || shape.kind == VECTOR_BYTE_MASKED)) {
+            mask = opnd_get_reg(src);
+        }
+    }
+    if (opnd_is_null(mem) || mask == DR_REG_NULL) {
+        instr_free(drcontext, &instr);
+        return;
+    }
 
-                    if (tmp.is_ind) {
-                        filer.Print(data->fileIO, _FileIO::RefType::CallIndRef, &crt);
-                    } else {
-                        filer.Print(data->fileIO, _FileIO::RefType::CallRef, &crt);
-                    }
+    byte mask_value[sizeof(dr_ymm_t)];
+    byte index_value[sizeof(dr_ymm_t)];
+    reg_get_value_ex(mask, &mcontext, mask_value);
+    const uint mask_bytes = reg_is_ymm(mask) ? 32 : (reg_is_mmx(mask) ? 8 : 16);
+
+    uint lanes = mask_bytes / shape.elem_size;
+    uint64 base = 0;
+    reg_id_t index = DR_REG_NULL;
+    if (shape.kind == VECTOR_GATHER) {
+        index = opnd_get_index(mem);
+        reg_get_value_ex(index, &mcontext, index_value);
+        const uint index_lanes = (reg_is_ymm(index) ? 32 : 16) / shape.index_size;
+        lanes = (index_lanes < lanes) ? index_lanes : lanes;
+        if (opnd_get_base(mem) != DR_REG_NULL) {
+            base = reg_get_value(opnd_get_base(mem), &mcontext);
+        }
+        base += opnd_get_disp(mem);
+    } else {
+        base = reinterpret_cast<uint64>(opnd_compute_address(mem, &mcontext));
+    }
 
-                    //fprintf(data->f, "call %p to %p\n", tmp.instr_addr, tmp.target_addr);
-                    /*print_address(data->f, tmp.instr_addr, "call @ ");
-                    print_address(data->f, tmp.target_addr, "\t to ");*/
-                } else {
-                    std::string str;
-
-                    _FileIO::CallRetRef_t crt;
-                    crt.instr = tmp.instr_addr;
-                    crt.target = tmp.target_addr;
-                    translate_addr(tmp.instr_addr, str);
-                    auto it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.instrSymIdx = it->second;
-                    } else {
-                        crt.instrSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.instrSym = str;
-                    translate_addr(tmp.target_addr, str);
-                    it = symbol_lookup.find(str);
-                    if (it != symbol_lookup.end()) {
-                        crt.targetSymIdx = it->second;
-                    } else {
-                        crt.targetSymIdx = symbol_idx;
-                        symbol_lookup.insert(std::make_pair(str, symbol_idx++));
-                    }
-                    crt.targetSym = str;
+    trace_ref_t ref;
+    ref.is_mem_ref = true;
+    ref.is_write = is_write;
+    ref.is_call = false;
+    ref.is_ind = false;
+    ref.has_value = false;
+    ref.loop = 0;
+    ref.instr_addr = instr_addr;
+    ref.target_addr = NULL;
+
+    uint64 run_start = 0;
+    uint run_size = 0;
+    for (uint lane = 0; lane < lanes; lane++) {
+        // An element is active if the sign bit of its mask element is set.
+        if ((mask_value[lane * shape.elem_size + shape.elem_size - 1] & 0x80) == 0) {
+            continue;
+        }
+        uint64 addr = base + lane * shape.elem_size;
+        if (shape.kind == VECTOR_GATHER) {
+            int64 offs;
+            if (shape.index_size == 4) {
+                int idx;
+                memcpy(&idx, index_value + lane * 4, sizeof(idx));
+                offs = idx;
+            } else {
+                memcpy(&offs, index_value + lane * 8, sizeof(offs));
+            }
+            addr = base + offs * opnd_get_scale(mem);
+        }
+        if (run_size > 0 && addr == run_start + run_size) {
+            run_size += shape.elem_size;
+        } else {
+            push_vector_ref(data, ref, run_start, run_size);
+            run_start = addr;
+            run_size = shape.elem_size;
+        }
+    }
+    push_vector_ref(data, ref, run_start, run_size);
+
+    instr_free(drcontext, &instr);
+}
 
-                    filer.Print(data->fileIO, _FileIO::RefType::RetRef, &crt);
 
-                    //fprintf(data->f, "return %p to %p\n", tmp.instr_addr, tmp.target_addr);
-                    /*print_address(data->f, tmp.instr_addr, "return @ ");
-                    print_address(data->f, tmp.target_addr, "\t to ");*/
-                }
+/*
+ * Basic-block vectors.
+ * Every block adds its number of instructions to the thread's instruction
+ * count and, with -bbv, to the counter of its slot. Once the count passes
+ * the end of the interval, a clean call closes it. -simpoints counts the
+ * same way, so intervals line up with those of the -bbv run.
+ */
+static void bbv_end_interval(per_thread_t *data) {
+    if (data->bb_counts != NULL) {
+        bbv_interval_t &iv = *(data->bb_current);
+        iv.thread_idx = data->thread_idx;
+        iv.index = data->bb_interval;
+        iv.instrs = data->bb_icount - data->bb_start;
+        bbv_collect(data->bb_counts, options.bbv_blocks, iv);
+        if (data->bb_file != NULL) {
+            std::fputc('T', data->bb_file);
+            for (size_t j = 0; j < iv.counts.size(); j++) {
+                std::fprintf(data->bb_file, ":%u:%llu ", iv.counts[j].first + 1,
+                    static_cast<unsigned long long>(iv.counts[j].second));
             }
+            std::fputc('\n', data->bb_file);
         }
-        trace_storage[data->thread_idx].clear();
+        // Only the projection is kept, the sparse vector is reused.
+        data->bb_intervals->push_back(simpoint_interval_t());
+        simpoint_interval_t &sp = data->bb_intervals->back();
+        sp.thread_idx = iv.thread_idx;
+        sp.index = iv.index;
+        sp.instrs = iv.instrs;
+        simpoint_project(iv, sp.point);
     }
-#endif
+    data->bb_interval++;
+    data->bb_start = data->bb_icount;
+    data->bb_limit = data->bb_icount + options.bbv_interval;
+    if (!options.simpoints.empty()) {
+        data->trace_off = simpoint_intervals.count(
+            std::make_pair(static_cast<uint64>(data->thread_idx), data->bb_interval)) == 0;
+    }
+}
 
-    //trace_ref_t trace(*(data->buf));
-    /*trace.instr_addr = data->buf->instr_addr;
-    trace.data_addr = data->buf->data_addr;
-    trace.is_call = data->buf->is_call;
-    trace.is_mem_ref = data->buf->is_mem_ref;
-    trace.is_write = data->buf->is_write;
-    trace.size = data->buf->size;
-    trace.target_addr = data->buf->target_addr;*/
-    trace_storage[data->thread_idx].push_back(trace_ref_t(*(data->buf)));
-    memset(data->buf, 0, sizeof(trace_ref_t));
+
+static void bbv_interval_end(void) {
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+
+    bbv_end_interval(data);
 }
 
 
-static void instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where, int pos, bool iswrite) {
-    drvector_t allowed;
+static void instrument_block_count(void *drcontext, instrlist_t *ilist, instr_t *where) {
+    int slot = -1;
+    if (options.bbv) {
+        dr_mutex_lock(bbv_lock);
+        slot = block_slots.Assign(reinterpret_cast<uint64_t>(instr_get_app_pc(where)));
+        dr_mutex_unlock(bbv_lock);
+    }
 
-    drreg_init_and_fill_vector(&allowed, false);
-    drreg_set_vector_entry(&allowed, DR_REG_XCX, true);
+    int ninstrs = 0;
+    for (instr_t *instr = instrlist_first_app(ilist); instr != NULL; instr = instr_get_next_app(instr)) {
+        ninstrs++;
+    }
 
     reg_id_t reg_ptr, reg_tmp;
-    if (drreg_reserve_register(drcontext, ilist, where, &allowed, &reg_ptr) !=
-        DRREG_SUCCESS ||
-        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_tmp) !=
-        DRREG_SUCCESS) {
+    if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS ||
+        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_ptr) != DRREG_SUCCESS ||
+        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_tmp) != DRREG_SUCCESS) {
         DR_ASSERT(false); /* cannot recover */
         return;
     }
-    drvector_delete(&allowed);
 
-    instr_t *instr, *restore;
-    opnd_t opnd1, opnd2, ref;
+    instr_t *instr, *done = INSTR_CREATE_label(drcontext);
+    opnd_t opnd1, opnd2;
 
-    if (iswrite) {
-        ref = instr_get_dst(where, pos);
-    } else {
-        ref = instr_get_src(where, pos);
-    }
+    // count the instructions of the thread
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg_ptr);
+    opnd1 = OPND_CREATE_MEM64(reg_ptr, offsetof(per_thread_t, bb_icount));
+    opnd2 = OPND_CREATE_INT32(ninstrs);
+    instr = INSTR_CREATE_add(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
 
-    drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg_tmp, reg_ptr);
+    if (slot >= 0) {
+        // count the instructions of the block
+        opnd1 = opnd_create_reg(reg_tmp);
+        opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, bb_counts));
+        instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+        opnd1 = OPND_CREATE_MEM64(reg_tmp, slot * static_cast<int>(sizeof(uint64)));
+        opnd2 = OPND_CREATE_INT32(ninstrs);
+        instr = INSTR_CREATE_add(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+    }
 
-    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg_ptr);
-    // read tls field
-    opnd1 = opnd_create_reg(reg_ptr);
-    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, buf));
+    // close the interval once it is full
+    opnd1 = opnd_create_reg(reg_tmp);
+    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, bb_icount));
     instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
     instrlist_meta_preinsert(ilist, where, instr);
-
-    // store is_write
-    opnd1 = OPND_CREATE_MEM32(reg_ptr, offsetof(trace_ref_t, is_write));
-    opnd2 = OPND_CREATE_INT32(iswrite);
-    instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
+    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, bb_limit));
+    instr = INSTR_CREATE_cmp(drcontext, opnd1, opnd2);
     instrlist_meta_preinsert(ilist, where, instr);
-
-    // store is_mem_ref
-    opnd1 = OPND_CREATE_MEM32(reg_ptr, offsetof(trace_ref_t, is_mem_ref));
-    opnd2 = OPND_CREATE_INT32(true);
-    instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
+    instr = INSTR_CREATE_jcc(drcontext, OP_jb, opnd_create_instr(done));
     instrlist_meta_preinsert(ilist, where, instr);
+    dr_insert_clean_call(drcontext, ilist, where, (void *)bbv_interval_end, false, 0);
+    instrlist_meta_preinsert(ilist, where, done);
 
-    // store data addr
-    opnd1 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(trace_ref_t, data_addr));
-    opnd2 = opnd_create_reg(reg_tmp);
-    instr = INSTR_CREATE_mov_st(drcontext, opnd1, opnd2);
-    instrlist_meta_preinsert(ilist, where, instr);
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS ||
+        drreg_unreserve_register(drcontext, ilist, where, reg_tmp) != DRREG_SUCCESS ||
+        drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+}
 
-    // store data size
-    opnd1 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(trace_ref_t, size));
-    opnd2 = OPND_CREATE_INT32(drutil_opnd_mem_size_in_bytes(ref, where));
-    instr = INSTR_CREATE_mov_st(drcontext, opnd1, opnd2);
-    instrlist_meta_preinsert(ilist, where, instr);
 
-    // store pc
-    opnd1 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(trace_ref_t, instr_addr));
-    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)instr_get_app_pc(where), opnd1, ilist, where, NULL, NULL);
+/*
+ * mix_reg_bit
+ * Bit of a register in the masks of block_mix_t, -1 for others (flags,
+ * segments, x87 stack).
+ */
+static int mix_reg_bit(const reg_id_t reg) {
+    if (reg_is_gpr(reg)) {
+        return MIX_REG_GPR + (reg_to_pointer_sized(reg) - DR_REG_XAX);
+    } else if (reg_is_ymm(reg)) {
+        return MIX_REG_SIMD + (reg - DR_REG_YMM0);
+    } else if (reg_is_xmm(reg)) {
+        return MIX_REG_SIMD + (reg - DR_REG_XMM0);
+    } else if (reg_is_mmx(reg)) {
+        return MIX_REG_MMX + (reg - DR_REG_MM0);
+    }
+    return -1;
+}
 
-    // store return address
-    restore = INSTR_CREATE_label(drcontext);
-    opnd1 = opnd_create_reg(reg_ptr);
-    opnd2 = opnd_create_instr(restore);
-    instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
-    instrlist_meta_preinsert(ilist, where, instr);
 
-    // jump to clean call
-    opnd1 = opnd_create_pc(code_cache);
-    instr = INSTR_CREATE_jmp(drcontext, opnd1);
-    instrlist_meta_preinsert(ilist, where, instr);
+static void mix_add_regs(const opnd_t opnd, uint64 &mask) {
+    for (int i = 0; i < opnd_num_regs_used(opnd); i++) {
+        const int bit = mix_reg_bit(opnd_get_reg_used(opnd, i));
+        if (bit >= 0) {
+            mask |= 1ull << bit;
+        }
+    }
+}
 
-    instrlist_meta_preinsert(ilist, where, restore);
 
-    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS ||
-        drreg_unreserve_register(drcontext, ilist, where, reg_tmp) != DRREG_SUCCESS)
-        DR_ASSERT(false);
+/*
+ * mix_classify
+ * The widest register operand decides between the vector classes; SSE and
+ * AVX instructions on a single float or double (the names end in ss or sd)
+ * count as floating point.
+ */
+static int mix_classify(instr_t *instr) {
+    if (instr_is_cti(instr)) {
+        return MIX_BRANCH;
+    }
+    int width = 0;
+    for (int i = 0; i < instr_num_srcs(instr) + instr_num_dsts(instr); i++) {
+        const opnd_t opnd = (i < instr_num_srcs(instr)) ? instr_get_src(instr, i) :
+            instr_get_dst(instr, i - instr_num_srcs(instr));
+        if (!opnd_is_reg(opnd)) {
+            continue;
+        }
+        const reg_id_t reg = opnd_get_reg(opnd);
+        if (reg_is_ymm(reg)) {
+            width = 256;
+        } else if (reg_is_xmm(reg)) {
+            width = (width > 128) ? width : 128;
+        } else if (reg_is_mmx(reg)) {
+            width = (width > 64) ? width : 64;
+        }
+    }
+    if (width >= 128) {
+        const char *name = decode_opcode_name(instr_get_opcode(instr));
+        const size_t len = strlen(name);
+        if (name[0] != 'p' && strncmp(name, "vp", 2ul) != 0 && len > 2 &&
+            (strcmp(name + len - 2, "ss") == 0 || strcmp(name + len - 2, "sd") == 0)) {
+            return MIX_FP;
+        }
+        return (width == 256) ? MIX_SIMD256 : MIX_SIMD128;
+    } else if (width == 64) {
+        return MIX_SIMD64;
+    }
+    return instr_is_floating(instr) ? MIX_FP : MIX_INT;
 }
 
 
-static void at_call(app_pc instr_addr, app_pc target_addr) {
-    void *drcontext = dr_get_current_drcontext();
-    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+/*
+ * mix_flops
+ * Floating point operations of one execution of instr: one per element of
+ * an arithmetic SSE/AVX instruction (two for fused multiply-add) and one per
+ * arithmetic x87 instruction. Comparisons, conversions and moves are not
+ * counted.
+ */
+static unsigned int mix_flops(instr_t *instr) {
+    static const char *const simd[] = { "add", "sub", "mul", "div", "sqrt" };
+    static const char *const fma[] = { "fmadd", "fmsub", "fnmadd", "fnmsub" };
+    static const char *const x87[] = { "fadd", "fsub", "fmul", "fdiv", "fsqrt", "fiadd", "fisub", "fimul", "fidiv" };
+    const char *name = decode_opcode_name(instr_get_opcode(instr));
+    const size_t len = strlen(name);
+
+    int width = 0;
+    for (int i = 0; i < instr_num_srcs(instr) + instr_num_dsts(instr); i++) {
+        const opnd_t opnd = (i < instr_num_srcs(instr)) ? instr_get_src(instr, i) :
+            instr_get_dst(instr, i - instr_num_srcs(instr));
+        if (opnd_is_reg(opnd)) {
+            const reg_id_t reg = opnd_get_reg(opnd);
+            width = reg_is_ymm(reg) ? 256 : ((reg_is_xmm(reg) && width < 128) ? 128 : width);
+        }
+    }
 
-    trace_ref_t trace;
-    trace.is_mem_ref = false;
-    trace.is_call = true;
-    trace.is_ind = false;
-    trace.instr_addr = instr_addr;
-    trace.target_addr = target_addr;
+    if (width >= 128 && len > 2) {
+        const char *op = (name[0] == 'v') ? name + 1 : name;
+        unsigned int ops = 0;
+        for (size_t i = 0; i < sizeof(fma) / sizeof(fma[0]) && ops == 0; i++) {
+            ops = (strncmp(op, fma[i], strlen(fma[i])) == 0) ? 2 : 0;
+        }
+        for (size_t i = 0; i < sizeof(simd) / sizeof(simd[0]) && ops == 0; i++) {
+            ops = (strncmp(op, simd[i], strlen(simd[i])) == 0) ? 1 : 0;
+        }
+        const char *suffix = name + len - 2;
+        if (strcmp(suffix, "ss") == 0 || strcmp(suffix, "sd") == 0) {
+            return ops;
+        } else if (strcmp(suffix, "ps") == 0) {
+            return ops * width / 32;
+        } else if (strcmp(suffix, "pd") == 0) {
+            return ops * width / 64;
+        }
+        return 0;
+    }
 
-    trace_storage[data->thread_idx].push_back(trace);
+    if (instr_is_floating(instr)) {
+        for (size_t i = 0; i < sizeof(x87) / sizeof(x87[0]); i++) {
+            // fadd, faddp, but not fld
+            if (strncmp(name, x87[i], strlen(x87[i])) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
 }
 
 
-static void at_call_ind(app_pc instr_addr, app_pc target_addr) {
-    void *drcontext = dr_get_current_drcontext();
-    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+/*
+ * instrument_mix_count
+ * Describes the block once, at its first translation, and counts its
+ * executions inline in the thread's slot counter.
+ */
+static void instrument_mix_count(void *drcontext, instrlist_t *ilist, instr_t *where) {
+    const uint64 pc = reinterpret_cast<uint64>(instr_get_app_pc(where));
+    dr_mutex_lock(mix_lock);
+    const int slot = mix_slots.Assign(pc);
+    if (slot < 0) {
+        mix_dropped++;
+    } else if (static_cast<size_t>(slot) == mix_blocks.size()) {
+        block_mix_t b;
+        memset(&b, 0, sizeof(b));
+        b.pc = pc;
+        for (instr_t *instr = instrlist_first_app(ilist); instr != NULL; instr = instr_get_next_app(instr)) {
+            b.instrs++;
+            b.classes[mix_classify(instr)]++;
+            b.loads += instr_reads_memory(instr) ? 1 : 0;
+            b.stores += instr_writes_memory(instr) ? 1 : 0;
+            b.flops += mix_flops(instr);
+            for (int i = 0; i < instr_num_srcs(instr); i++) {
+                mix_add_regs(instr_get_src(instr, i), b.regs_read);
+            }
+            for (int i = 0; i < instr_num_dsts(instr); i++) {
+                const opnd_t opnd = instr_get_dst(instr, i);
+                // the registers of an address are read
+                mix_add_regs(opnd, opnd_is_reg(opnd) ? b.regs_written : b.regs_read);
+            }
+        }
+        mix_blocks.push_back(b);
+    }
+    dr_mutex_unlock(mix_lock);
+    if (slot < 0) {
+        return;
+    }
 
-    trace_ref_t trace;
-    trace.is_mem_ref = false;
-    trace.is_call = true;
-    trace.is_ind = true;
-    trace.instr_addr = instr_addr;
-    trace.target_addr = target_addr;
+    reg_id_t reg_ptr;
+    if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS ||
+        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_ptr) != DRREG_SUCCESS) {
+        DR_ASSERT(false); /* cannot recover */
+        return;
+    }
 
-    trace_storage[data->thread_idx].push_back(trace);
+    instr_t *instr;
+    opnd_t opnd1, opnd2;
+
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg_ptr);
+    opnd1 = opnd_create_reg(reg_ptr);
+    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, mix_counts));
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+    opnd1 = OPND_CREATE_MEM64(reg_ptr, slot * static_cast<int>(sizeof(uint64)));
+    opnd2 = OPND_CREATE_INT32(1);
+    instr = INSTR_CREATE_add(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS ||
+        drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+        DR_ASSERT(false);
 }
 
 
-static void at_return(app_pc instr_addr, app_pc target_addr) {
-    void *drcontext = dr_get_current_drcontext();
-    per_thread_t *data = static_cast<per_thread_t *>(drmgr_get_tls_field(drcontext, tls_index));
+/*
+ * insert_loop_count
+ * Increments a loop counter of the thread without touching the arithmetic
+ * flags, so it can sit right in front of the conditional branch it counts.
+ * With a cmov opcode the increment only happens if the branch is taken.
+ */
+static void insert_loop_count(void *drcontext, instrlist_t *ilist, instr_t *where, const int index, const int cmov) {
+    reg_id_t reg_ptr, reg_val, reg_inc = DR_REG_NULL;
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_ptr) != DRREG_SUCCESS ||
+        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_val) != DRREG_SUCCESS ||
+        (cmov != OP_INVALID && drreg_reserve_register(drcontext, ilist, where, NULL, &reg_inc) != DRREG_SUCCESS)) {
+        DR_ASSERT(false); /* cannot recover */
+        return;
+    }
 
-    trace_ref_t trace;
-    trace.is_mem_ref = false;
-    trace.is_call = false;
-    trace.is_ind = false;
-    trace.instr_addr = instr_addr;
-    trace.target_addr = target_addr;
+    instr_t *instr;
+    opnd_t opnd1, opnd2;
+    const int disp = index * static_cast<int>(sizeof(ptr_uint_t));
+
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg_ptr);
+    opnd1 = opnd_create_reg(reg_ptr);
+    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, offsetof(per_thread_t, loop_counts));
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    opnd1 = opnd_create_reg(reg_val);
+    opnd2 = OPND_CREATE_MEMPTR(reg_ptr, disp);
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+    if (cmov != OP_INVALID) {
+        opnd1 = opnd_create_reg(reg_inc);
+        opnd2 = OPND_CREATE_MEM_lea(reg_val, DR_REG_NULL, 0, 1);
+        instr = INSTR_CREATE_lea(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+        instr = INSTR_CREATE_cmovcc(drcontext, cmov, opnd_create_reg(reg_val), opnd_create_reg(reg_inc));
+        instrlist_meta_preinsert(ilist, where, instr);
+    } else {
+        opnd1 = opnd_create_reg(reg_val);
+        opnd2 = OPND_CREATE_MEM_lea(reg_val, DR_REG_NULL, 0, 1);
+        instr = INSTR_CREATE_lea(drcontext, opnd1, opnd2);
+        instrlist_meta_preinsert(ilist, where, instr);
+    }
+    opnd1 = OPND_CREATE_MEMPTR(reg_ptr, disp);
+    opnd2 = opnd_create_reg(reg_val);
+    instr = INSTR_CREATE_mov_st(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
 
-    trace_storage[data->thread_idx].push_back(trace);
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS ||
+        drreg_unreserve_register(drcontext, ilist, where, reg_val) != DRREG_SUCCESS ||
+        (reg_inc != DR_REG_NULL && drreg_unreserve_register(drcontext, ilist, where, reg_inc) != DRREG_SUCCESS))
+        DR_ASSERT(false);
 }
 
 
 /*
- * event_app_instruction
+ * instrument_loop
+ * A direct branch back by at most LOOP_MAX_SPAN bytes closes a loop. The
+ * code of a new loop is flushed, so its references get the loop id when
+ * it is translated again. Heads count iterations, back edges count taken
+ * jumps (jcc through the matching cmov; loop/jecxz back edges are not
+ * counted). The farthest back edge of a loop also counts the times it
+ * falls through, i.e. leaves the loop (through the inverse cmov); once a
+ * farther one is found, the flush moves that count to it.
  */
+static void instrument_loop(void *drcontext, instrlist_t *ilist, instr_t *instr) {
+    const uint64 pc = reinterpret_cast<uint64>(instr_get_app_pc(instr));
+    int latch = -1;
+    uint64 head = 0, end = 0;
+    bool changed = false, last = false;
+
+    dr_mutex_lock(loop_lock);
+    const int loop = loop_table.Head(pc);
+    if ((instr_is_cbr(instr) || instr_is_ubr(instr)) && opnd_is_pc(instr_get_target(instr))) {
+        head = reinterpret_cast<uint64>(opnd_get_pc(instr_get_target(instr)));
+        if (head <= pc && pc - head <= LOOP_MAX_SPAN) {
+            end = pc + instr_length(drcontext, instr);
+            latch = loop_table.Add(head, end, changed);
+            last = latch >= 0 && loop_table.Get(latch).end == end;
+        }
+    }
+    dr_mutex_unlock(loop_lock);
+
+    if (changed) {
+        dr_delay_flush_region(reinterpret_cast<app_pc>(head), static_cast<size_t>(end - head), 0, NULL);
+    }
+    if (loop >= 0) {
+        insert_loop_count(drcontext, ilist, instr, LOOP_COUNTERS * loop, OP_INVALID);
+    }
+    if (latch >= 0) {
+        // cmovcc are in the same order as jcc, the inverse condition is the neighbor
+        const int opcode = instr_get_opcode(instr);
+        int cc = -1;
+        if (opcode >= OP_jo && opcode <= OP_jnle) {
+            cc = opcode - OP_jo;
+        } else if (opcode >= OP_jo_short && opcode <= OP_jnle_short) {
+            cc = opcode - OP_jo_short;
+        }
+        if (instr_is_ubr(instr)) {
+            insert_loop_count(drcontext, ilist, instr, LOOP_COUNTERS * latch + 1, OP_INVALID);
+        } else if (cc >= 0) {
+            insert_loop_count(drcontext, ilist, instr, LOOP_COUNTERS * latch + 1, OP_cmovo + cc);
+            if (last) {
+                insert_loop_count(drcontext, ilist, instr, LOOP_COUNTERS * latch + 2, OP_cmovo + (cc ^ 1));
+            }
+        }
+    }
+}
+
+
 static dr_emit_flags_t event_app_instruction(void *drcontext, void *tag,
     instrlist_t *bb, instr_t *instr, bool for_trace, bool translating,
     void *user_data) {
+    vector_shape_t shape;
+
     // instrument calls, returns, and MOVs
     if (instr_get_app_pc(instr) == NULL)
+        return emit_flags;
+
+    if ((options.bbv || !options.simpoints.empty()) && drmgr_is_first_instr(drcontext, instr)) {
+        instrument_block_count(drcontext, bb, instr);
+    }
+
+    // mix mode only counts blocks; slots are assigned per run
+    if ((options.mix || options.roofline) && drmgr_is_first_instr(drcontext, instr)) {
+        instrument_mix_count(drcontext, bb, instr);
+    }
+    if (options.mix) {
+        return DR_EMIT_DEFAULT;
+    }
+
+    // call graph mode leaves memory references and returns alone
+    if (options.callgraph) {
+        // slots are assigned per run, never persist these blocks
+        if (instr_is_call_direct(instr)) {
+            instrument_call_count(drcontext, bb, instr, false);
+            return DR_EMIT_DEFAULT;
+        } else if (instr_is_call_indirect(instr)) {
+            instrument_call_count(drcontext, bb, instr, true);
+            return DR_EMIT_DEFAULT;
+        }
+        return emit_flags;
+    }
+
+    // basic-block vector mode only counts blocks; slots are assigned per run
+    if (options.bbv) {
         return DR_EMIT_DEFAULT;
+    }
+
+    if (options.loops) {
+        instrument_loop(drcontext, bb, instr);
+    }
 
     if (instr_is_call_direct(instr)) {
         dr_insert_call_instrumentation(drcontext, bb, instr, (app_pc)at_call);
@@ -815,6 +3062,9 @@ static dr_emit_flags_t event_app_instruction(void *drcontext, void *tag,
     } else if (instr_is_return(instr)) {
         dr_insert_mbr_instrumentation(drcontext, bb, instr, (app_pc)at_return,
             SPILL_SLOT_1);
+    } else if (vector_shape(instr_get_opcode(instr), shape)) {
+        dr_insert_clean_call(drcontext, bb, instr, (void *)at_vector_mem, false, 1,
+            OPND_CREATE_INTPTR(instr_get_app_pc(instr)));
     } else if (instr_reads_memory(instr)) {
         int opcode = instr_get_opcode(instr);
         /*if (strncmp(decode_opcode_name(opcode), "mov", 3ul) == 0)*/
@@ -845,16 +3095,21 @@ static dr_emit_flags_t event_app_instruction(void *drcontext, void *tag,
         }
     }
 
-    return DR_EMIT_DEFAULT;
+    return emit_flags;
 }
 
 
 static dr_emit_flags_t
 event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
     bool for_trace, bool translating) {
+    // Blocks must look the same in -bbv and -simpoints runs, or the intervals differ.
+    // -mix counts the instructions of the application, not those of the expansion.
+    if ((options.callgraph || options.mix) && !options.bbv && options.simpoints.empty()) {
+        return emit_flags;
+    }
     if (!drutil_expand_rep_string(drcontext, bb)) {
         DR_ASSERT(false);
         /* in release build, carry on: we'll just miss per-iter refs */
     }
-    return DR_EMIT_DEFAULT;
+    return emit_flags;
 }
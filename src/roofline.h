@@ -0,0 +1,84 @@
+#ifndef REGINA_ROOFLINE_H_INCLUDED
+#define REGINA_ROOFLINE_H_INCLUDED
+
+#include <cstddef>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "cache_sim.h"
+
+#define ROOFLINE_DEFAULT_LLC (8 * 1024 * 1024)
+#define ROOFLINE_LLC_WAYS 16
+
+/*
+ * Bytes moved per PC, for the arithmetic intensity of functions. Next to
+ * the bytes the instructions access, the traffic to DRAM is estimated with
+ * a write-back LLC per thread: a missing line is filled (one line of
+ * traffic) and an evicted dirty line is written back (one more). Threads
+ * sharing the LLC and prefetchers are not modelled, so this is a rough
+ * figure for triage, not a replacement for hardware counters.
+ */
+typedef struct _roofline_stats_t {
+    uint64_t bytes;         //< accessed by the instructions
+    uint64_t dram;          //< estimated bytes from and to memory
+
+    inline _roofline_stats_t(void) : bytes(0), dram(0) { }
+
+    inline void Merge(const _roofline_stats_t &rhs) {
+        this->bytes += rhs.bytes;
+        this->dram += rhs.dram;
+    }
+} roofline_stats_t;
+
+
+class RooflineProfile {
+public:
+    /*
+     * The LLC is only allocated once the thread accesses memory, so the
+     * merged profile of all threads needs no size.
+     */
+    inline RooflineProfile(const size_t llc_size = 0) : llcSize(llc_size), llc(NULL), lastPc(0), last(NULL) { }
+
+    inline ~RooflineProfile(void) {
+        delete this->llc;
+    }
+
+    inline void Access(const uint64_t pc, const uint64_t addr, const unsigned int size, const bool is_write) {
+        if (pc != this->lastPc || this->last == NULL) {
+            this->last = &this->pcs[pc];
+            this->lastPc = pc;
+        }
+        if (this->llc == NULL) {
+            this->llc = new CacheSim(this->llcSize, ROOFLINE_LLC_WAYS);
+        }
+        unsigned int writebacks = 0;
+        const unsigned int misses = this->llc->Access(addr, size, is_write, writebacks);
+        this->last->bytes += size;
+        this->last->dram += static_cast<uint64_t>(misses + writebacks) * CACHE_SIM_LINE_SIZE;
+    }
+
+    /* Adds the statistics of another thread; the LLC stays per thread. */
+    inline void Merge(const RooflineProfile &rhs) {
+        for (auto it = rhs.pcs.begin(); it != rhs.pcs.end(); ++it) {
+            this->pcs[it->first].Merge(it->second);
+        }
+        this->last = NULL;
+    }
+
+    inline const std::unordered_map<uint64_t, roofline_stats_t> &Pcs(void) const {
+        return this->pcs;
+    }
+
+    RooflineProfile(const RooflineProfile &rhs) = delete;
+
+    RooflineProfile &operator=(const RooflineProfile &rhs) = delete;
+
+private:
+    size_t llcSize;
+    CacheSim *llc;
+    uint64_t lastPc;
+    roofline_stats_t *last;
+    std::unordered_map<uint64_t, roofline_stats_t> pcs;
+};
+
+#endif // end ifndef REGINA_ROOFLINE_H_INCLUDED
@@ -0,0 +1,233 @@
+#ifndef REGINA_SHARING_TABLE_H_INCLUDED
+#define REGINA_SHARING_TABLE_H_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#define SHARING_LINE_SIZE 64
+#define SHARING_MAX_PROBES 16
+#define SHARING_WRITER_PCS 4
+
+/*
+ * Cache-line ownership table for false/true sharing detection.
+ *
+ * Lines live in a fixed-size open-addressed table; slots are claimed with a
+ * CAS on the tag and every slot carries its own spin lock, so threads only
+ * contend when they touch the same line, which is exactly the case being
+ * measured. A transfer is counted whenever a thread accesses a line whose
+ * current copy was produced by another thread's write (or writes a line
+ * other threads hold). It is true sharing if the accessed bytes overlap the
+ * bytes touched by the other side, false sharing otherwise.
+ *
+ * Threads are tracked in a 64 bit sharer set (thread index modulo 64). The
+ * table is fed from the flushed per-thread buffers, a whole batch after the
+ * other, so the order of accesses is only known at batch granularity: the
+ * transfer counts are approximate, they can both miss transfers within a
+ * batch and count ping-pong that did not happen in that order.
+ */
+class SharingTable {
+public:
+    typedef struct _line_report_t {
+        uint64_t line;
+        uint64_t transfers;
+        uint64_t true_transfers;
+        uint64_t false_transfers;
+        uint32_t sharers;
+        uint64_t writer_pcs[SHARING_WRITER_PCS];
+    } line_report_t;
+
+    inline SharingTable(void) : lines(NULL), capacity(0), dropped(0) { }
+
+    inline ~SharingTable(void) {
+        delete[] this->lines;
+    }
+
+    /* capacity must be a power of two. */
+    inline void Init(const size_t capacity) {
+        delete[] this->lines;
+        this->capacity = capacity;
+        this->lines = new line_t[capacity];
+        for (size_t i = 0; i < capacity; i++) {
+            this->lines[i].clear();
+        }
+        this->dropped = 0;
+    }
+
+    inline void Access(const unsigned int thread, const uint64_t addr, const unsigned int size,
+        const bool is_write, const uint64_t pc) {
+        const uint64_t end = addr + (size > 0 ? size : 1);
+        for (uint64_t a = addr; a < end; a = (a & ~static_cast<uint64_t>(SHARING_LINE_SIZE - 1)) + SHARING_LINE_SIZE) {
+            const uint64_t line = a / SHARING_LINE_SIZE;
+            const unsigned int first = static_cast<unsigned int>(a % SHARING_LINE_SIZE);
+            const unsigned int last = static_cast<unsigned int>(std::min<uint64_t>(end - line * SHARING_LINE_SIZE, SHARING_LINE_SIZE));
+            const uint64_t mask = (last - first == 64) ? ~0ull : (((1ull << (last - first)) - 1) << first);
+            this->accessLine(thread, line, mask, is_write, pc);
+        }
+    }
+
+    /* Returns the lines with the most transfers, at most n of them. */
+    void Top(const size_t n, std::vector<line_report_t> &out) const;
+
+    inline uint64_t Dropped(void) const {
+        return this->dropped.load(std::memory_order_relaxed);
+    }
+
+    SharingTable(const SharingTable &rhs) = delete;
+
+    SharingTable &operator=(const SharingTable &rhs) = delete;
+
+private:
+    typedef struct _line_t {
+        std::atomic<uint64_t> tag;      //< line number + 1, 0 if empty
+        std::atomic<uint32_t> lock;
+        uint32_t last_writer;           //< thread + 1, 0 if never written
+        uint64_t holders;               //< threads with a valid copy
+        uint64_t sharers;               //< all threads that touched the line
+        uint64_t write_mask;            //< bytes written by last_writer
+        uint64_t read_mask;             //< bytes read by others since then
+        uint64_t transfers;
+        uint64_t true_transfers;
+        uint64_t false_transfers;
+        uint64_t writer_pcs[SHARING_WRITER_PCS];
+
+        inline void clear(void) {
+            this->tag.store(0, std::memory_order_relaxed);
+            this->lock.store(0, std::memory_order_relaxed);
+            this->last_writer = 0;
+            this->holders = this->sharers = 0;
+            this->write_mask = this->read_mask = 0;
+            this->transfers = this->true_transfers = this->false_transfers = 0;
+            for (int i = 0; i < SHARING_WRITER_PCS; i++) {
+                this->writer_pcs[i] = 0;
+            }
+        }
+    } line_t;
+
+    inline line_t *find(const uint64_t line) {
+        const uint64_t tag = line + 1;
+        size_t slot = static_cast<size_t>((line * 0x9E3779B97F4A7C15ull) >> 20) & (this->capacity - 1);
+        for (int probe = 0; probe < SHARING_MAX_PROBES; probe++) {
+            line_t &l = this->lines[slot];
+            uint64_t cur = l.tag.load(std::memory_order_acquire);
+            if (cur == tag) {
+                return &l;
+            }
+            if (cur == 0) {
+                if (l.tag.compare_exchange_strong(cur, tag, std::memory_order_acq_rel) || cur == tag) {
+                    return &l;
+                }
+            }
+            slot = (slot + 1) & (this->capacity - 1);
+        }
+        return NULL;
+    }
+
+    void accessLine(const unsigned int thread, const uint64_t line, const uint64_t mask,
+        const bool is_write, const uint64_t pc);
+
+    line_t *lines;
+    size_t capacity;
+    std::atomic<uint64_t> dropped;
+};
+
+
+inline void SharingTable::accessLine(const unsigned int thread, const uint64_t line, const uint64_t mask,
+    const bool is_write, const uint64_t pc) {
+    line_t *l = this->find(line);
+    if (l == NULL) {
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const uint64_t me = 1ull << (thread % 64);
+    const uint32_t writer = thread + 1;
+
+    uint32_t unlocked = 0;
+    while (!l->lock.compare_exchange_weak(unlocked, 1, std::memory_order_acquire)) {
+        unlocked = 0;
+    }
+
+    l->sharers |= me;
+    if (is_write) {
+        if ((l->holders & ~me) != 0) {
+            // Invalidate the copies of the other threads.
+            const uint64_t theirs = l->read_mask | ((l->last_writer != writer) ? l->write_mask : 0);
+            l->transfers++;
+            if ((theirs & mask) != 0) {
+                l->true_transfers++;
+            } else {
+                l->false_transfers++;
+            }
+        }
+        if (l->last_writer != writer) {
+            l->write_mask = 0;
+        }
+        l->last_writer = writer;
+        l->write_mask |= mask;
+        l->read_mask = 0;
+        l->holders = me;
+
+        for (int i = 0; i < SHARING_WRITER_PCS; i++) {
+            if (l->writer_pcs[i] == pc) {
+                break;
+            }
+            if (l->writer_pcs[i] == 0) {
+                l->writer_pcs[i] = pc;
+                break;
+            }
+        }
+
+    } else {
+        if ((l->holders & me) == 0 && l->last_writer != 0 && l->last_writer != writer) {
+            // Fetch the line written by another thread.
+            l->transfers++;
+            if ((l->write_mask & mask) != 0) {
+                l->true_transfers++;
+            } else {
+                l->false_transfers++;
+            }
+        }
+        if (l->last_writer != writer) {
+            l->read_mask |= mask;
+        }
+        l->holders |= me;
+    }
+
+    l->lock.store(0, std::memory_order_release);
+}
+
+
+inline void SharingTable::Top(const size_t n, std::vector<line_report_t> &out) const {
+    out.clear();
+    for (size_t i = 0; i < this->capacity; i++) {
+        const line_t &l = this->lines[i];
+        if (l.tag.load(std::memory_order_relaxed) == 0 || l.transfers == 0) {
+            continue;
+        }
+
+        line_report_t r;
+        r.line = (l.tag.load(std::memory_order_relaxed) - 1) * SHARING_LINE_SIZE;
+        r.transfers = l.transfers;
+        r.true_transfers = l.true_transfers;
+        r.false_transfers = l.false_transfers;
+        r.sharers = 0;
+        for (uint64_t s = l.sharers; s != 0; s &= s - 1) {
+            r.sharers++;
+        }
+        for (int j = 0; j < SHARING_WRITER_PCS; j++) {
+            r.writer_pcs[j] = l.writer_pcs[j];
+        }
+        out.push_back(r);
+    }
+
+    std::sort(out.begin(), out.end(), [](const line_report_t &a, const line_report_t &b) {
+        return a.transfers > b.transfers;
+    });
+    if (out.size() > n) {
+        out.resize(n);
+    }
+}
+
+#endif // end ifndef REGINA_SHARING_TABLE_H_INCLUDED
@@ -0,0 +1,180 @@
+#include "shm_ring.h"
+
+#include <cstdio>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Platform specific part of ShmRing. Kept out of the header, so the client
+ * sources never see windows.h next to dr_api.h.
+ */
+
+static void shm_ring_name(const char *name, char *out, const size_t size) {
+#ifdef _WIN32
+    std::snprintf(out, size, "Local\\regina.%s", name);
+#else
+    std::snprintf(out, size, "/regina.%s", name);
+#endif
+}
+
+
+void ShmRing::yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+
+void *ShmRing::map(const char *name, const size_t size, const bool create) {
+    char path[256];
+    shm_ring_name(name, path, sizeof(path));
+
+#ifdef _WIN32
+    HANDLE h;
+    if (create) {
+        const unsigned long long s = size;
+        h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+            static_cast<DWORD>(s >> 32), static_cast<DWORD>(s), path);
+    } else {
+        h = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path);
+    }
+    if (h == NULL) {
+        return NULL;
+    }
+    void *base = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (base == NULL) {
+        CloseHandle(h);
+        return NULL;
+    }
+    this->mapping = h;
+    return base;
+#else
+    const int fd = create ? shm_open(path, O_CREAT | O_RDWR, 0600) : shm_open(path, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (create && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (base == MAP_FAILED) ? NULL : base;
+#endif
+}
+
+
+void ShmRing::unmap(void) {
+#ifdef _WIN32
+    UnmapViewOfFile(this->header);
+    CloseHandle(static_cast<HANDLE>(this->mapping));
+#else
+    munmap(this->header, this->mapSize);
+#endif
+    this->header = NULL;
+    this->data = NULL;
+    this->mapping = NULL;
+    this->mapSize = 0;
+}
+
+
+bool ShmRing::Create(const char *name, const size_t capacity, const bool block, const uint32_t thread_idx) {
+    this->Close();
+
+    size_t cap = SHM_RING_MIN_SIZE;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+
+#ifndef _WIN32
+    // Do not inherit the size or state of a stale ring of a previous run.
+    ShmRing::Remove(name);
+#endif
+    void *base = this->map(name, sizeof(shm_ring_header_t) + cap, true);
+    if (base == NULL) {
+        return false;
+    }
+    this->mapSize = sizeof(shm_ring_header_t) + cap;
+    this->producer = true;
+
+    std::memset(base, 0, sizeof(shm_ring_header_t));
+    this->header = new (base) shm_ring_header_t();
+    this->data = static_cast<unsigned char *>(base) + sizeof(shm_ring_header_t);
+    this->header->version = SHM_RING_VERSION;
+    this->header->header_size = sizeof(shm_ring_header_t);
+    this->header->capacity = cap;
+    this->header->policy = block ? SHM_RING_BLOCK : SHM_RING_DROP;
+    this->header->thread_idx = thread_idx;
+    this->header->closed.store(0);
+    this->header->write_pos.store(0);
+    this->header->read_pos.store(0);
+    // The magic is set last, consumers wait for it.
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(this->header->magic, SHM_RING_MAGIC, sizeof(this->header->magic));
+
+    return true;
+}
+
+
+bool ShmRing::Attach(const char *name) {
+    this->Close();
+
+    // Map the header first to learn the size of the data area.
+    void *base = this->map(name, sizeof(shm_ring_header_t), false);
+    if (base == NULL) {
+        return false;
+    }
+    this->header = static_cast<shm_ring_header_t *>(base);
+    this->mapSize = sizeof(shm_ring_header_t);
+    const bool valid = std::memcmp(this->header->magic, SHM_RING_MAGIC, sizeof(this->header->magic)) == 0 &&
+        this->header->version == SHM_RING_VERSION;
+    const size_t size = static_cast<size_t>(this->header->header_size + this->header->capacity);
+    this->unmap();
+    if (!valid) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    base = this->map(name, size, false);
+    if (base == NULL) {
+        return false;
+    }
+    this->mapSize = size;
+    this->producer = false;
+    this->header = static_cast<shm_ring_header_t *>(base);
+    this->data = static_cast<unsigned char *>(base) + this->header->header_size;
+    return true;
+}
+
+
+void ShmRing::Close(void) {
+    if (this->header == NULL) {
+        return;
+    }
+    if (this->producer) {
+        this->header->closed.store(1, std::memory_order_release);
+    }
+    this->unmap();
+}
+
+
+void ShmRing::Remove(const char *name) {
+#ifdef _WIN32
+    // The mapping goes away with its last handle.
+    (void)name;
+#else
+    char path[256];
+    shm_ring_name(name, path, sizeof(path));
+    shm_unlink(path);
+#endif
+}
@@ -0,0 +1,260 @@
+#ifndef REGINA_SHM_RING_H_INCLUDED
+#define REGINA_SHM_RING_H_INCLUDED
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Shared memory ring buffer for streaming records to another process.
+ *
+ * The named mapping ("Local\regina.<name>" on Windows, "/regina.<name>"
+ * elsewhere) starts with a 256 byte shm_ring_header_t followed by the data
+ * area of `capacity` bytes (a power of two). All integers are little endian.
+ *
+ *   offset  field
+ *        0  char magic[8]        "REGSHMRB"
+ *        8  u32 version          SHM_RING_VERSION
+ *       12  u32 header_size      offset of the data area (256)
+ *       16  u64 capacity         size of the data area
+ *       24  u32 policy           0: drop frames if full, 1: block
+ *       28  u32 closed           set to 1 by the producer when it is done
+ *       32  u32 thread_idx       owning thread or 0xffffffff (all threads)
+ *       64  u64 write_pos        bytes produced, only written by the producer
+ *      128  u64 read_pos         bytes consumed, only written by the consumer
+ *      192  u64 records          records published
+ *      200  u64 dropped_records  records lost because the ring was full
+ *      208  u64 dropped_frames
+ *
+ * write_pos and read_pos increase monotonically, byte i of the stream lives
+ * at data[i & (capacity - 1)]. The producer copies a frame and then stores
+ * write_pos with release semantics; the consumer loads write_pos (acquire),
+ * copies the frame and stores read_pos (release). Frames may wrap around the
+ * end of the data area and are padded to a multiple of 8 bytes:
+ *
+ *   u32 size           payload bytes following this 24 byte frame header
+ *   u32 kind           SHM_FRAME_RECORDS or SHM_FRAME_SYMBOLS
+ *   u32 thread_idx
+ *   u32 count          records (or symbols) in the payload
+ *   u64 first_record   number of the first record within its thread
+ *
+ * A records payload is a sequence of .mmtrd records (see mmtrd_format.h),
+ * one frame per flushed batch; gaps in first_record reveal dropped frames.
+ * A symbols payload consists of "idx|name\n" lines, the same as the
+ * .mmtrd.txt file. Symbols are not lost when the ring is full: the records
+ * of the batch are dropped along with them and they are published again
+ * with a later batch, so every ring receives all of them before the first
+ * records using them.
+ *
+ * The consumer removes the mapping once it has drained a closed ring.
+ */
+
+#define SHM_RING_MAGIC "REGSHMRB"
+#define SHM_RING_VERSION 1
+#define SHM_RING_DEFAULT_SIZE (1 << 26)
+#define SHM_RING_ALL_THREADS 0xffffffffu
+
+#define SHM_RING_DROP 0
+#define SHM_RING_BLOCK 1
+
+#define SHM_FRAME_RECORDS 0
+#define SHM_FRAME_SYMBOLS 1
+
+/* Smallest ring, must hold a frame of a whole flushed batch. */
+#define SHM_RING_MIN_SIZE (1 << 20)
+
+typedef struct _shm_ring_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t capacity;
+    uint32_t policy;
+    std::atomic<uint32_t> closed;
+    uint32_t thread_idx;
+    uint32_t reserved0[7];
+    std::atomic<uint64_t> write_pos;    //< own cache line, producer
+    uint64_t reserved1[7];
+    std::atomic<uint64_t> read_pos;     //< own cache line, consumer
+    uint64_t reserved2[7];
+    uint64_t records;
+    uint64_t dropped_records;
+    uint64_t dropped_frames;
+    uint64_t reserved3[5];
+} shm_ring_header_t;
+
+typedef struct _shm_frame_t {
+    uint32_t size;
+    uint32_t kind;
+    uint32_t thread_idx;
+    uint32_t count;
+    uint64_t first_record;
+} shm_frame_t;
+
+static_assert(sizeof(shm_ring_header_t) == 256, "shm_ring_header_t must match the documented layout");
+static_assert(sizeof(shm_frame_t) == 24, "shm_frame_t must match the documented layout");
+
+
+/*
+ * One end of a ring. The producer side (Create) may be shared by several
+ * threads, Write() serializes them; the consumer side (Attach) is meant for
+ * a single reader. The mapping itself is handled in shm_ring.cpp.
+ */
+class ShmRing {
+public:
+    inline ShmRing(void) : header(NULL), data(NULL), mapping(NULL), mapSize(0), producer(false) {
+        this->lock.clear();
+    }
+
+    inline ~ShmRing(void) {
+        this->Close();
+    }
+
+    /* Creates (or takes over) the named ring as producer. */
+    bool Create(const char *name, const size_t capacity, const bool block, const uint32_t thread_idx);
+
+    /* Opens an existing ring as consumer. */
+    bool Attach(const char *name);
+
+    /* Unmaps the ring; the producer marks it as closed first. */
+    void Close(void);
+
+    /* Removes the name of the ring, existing mappings stay valid. */
+    static void Remove(const char *name);
+
+    /*
+     * Publishes one frame. If the ring is full, the frame is dropped (and
+     * counted) or the caller waits for the consumer, depending on the policy.
+     * Returns false if the frame has been dropped.
+     */
+    bool Write(const uint32_t kind, const uint32_t thread_idx, const uint64_t first_record,
+        const uint32_t count, const void *payload, const size_t bytes);
+
+    /* Counts a records frame that is not published, like a dropped one. */
+    void Drop(const uint32_t count);
+
+    /* Takes the next frame, returns false if the ring is empty. */
+    bool Read(shm_frame_t &frame, std::vector<unsigned char> &payload);
+
+    inline bool IsOpen(void) const {
+        return this->header != NULL;
+    }
+
+    inline bool Closed(void) const {
+        return this->header->closed.load(std::memory_order_acquire) != 0;
+    }
+
+    inline const shm_ring_header_t *Header(void) const {
+        return this->header;
+    }
+
+    ShmRing(const ShmRing &rhs) = delete;
+
+    ShmRing &operator=(const ShmRing &rhs) = delete;
+
+private:
+    static void yield(void);
+
+    void *map(const char *name, const size_t size, const bool create);
+
+    void unmap(void);
+
+    inline void copyIn(const uint64_t pos, const void *src, const size_t bytes) {
+        const size_t mask = static_cast<size_t>(this->header->capacity - 1);
+        const size_t at = static_cast<size_t>(pos) & mask;
+        const size_t first = (bytes < this->header->capacity - at) ? bytes : static_cast<size_t>(this->header->capacity - at);
+        std::memcpy(this->data + at, src, first);
+        std::memcpy(this->data, static_cast<const unsigned char *>(src) + first, bytes - first);
+    }
+
+    inline void copyOut(const uint64_t pos, void *dst, const size_t bytes) const {
+        const size_t mask = static_cast<size_t>(this->header->capacity - 1);
+        const size_t at = static_cast<size_t>(pos) & mask;
+        const size_t first = (bytes < this->header->capacity - at) ? bytes : static_cast<size_t>(this->header->capacity - at);
+        std::memcpy(dst, this->data + at, first);
+        std::memcpy(static_cast<unsigned char *>(dst) + first, this->data, bytes - first);
+    }
+
+    shm_ring_header_t *header;
+    unsigned char *data;
+    void *mapping;
+    size_t mapSize;
+    bool producer;
+    std::atomic_flag lock;
+};
+
+
+inline bool ShmRing::Write(const uint32_t kind, const uint32_t thread_idx, const uint64_t first_record,
+    const uint32_t count, const void *payload, const size_t bytes) {
+    const uint64_t frameSize = (sizeof(shm_frame_t) + bytes + 7) & ~static_cast<uint64_t>(7);
+
+    while (this->lock.test_and_set(std::memory_order_acquire)) {
+        ShmRing::yield();
+    }
+
+    bool written = false;
+    if (frameSize <= this->header->capacity) {
+        const uint64_t pos = this->header->write_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            const uint64_t used = pos - this->header->read_pos.load(std::memory_order_acquire);
+            if (this->header->capacity - used >= frameSize) {
+                written = true;
+                break;
+            }
+            if (this->header->policy != SHM_RING_BLOCK) {
+                break;
+            }
+            ShmRing::yield();
+        }
+
+        if (written) {
+            shm_frame_t frame;
+            frame.size = static_cast<uint32_t>(bytes);
+            frame.kind = kind;
+            frame.thread_idx = thread_idx;
+            frame.count = count;
+            frame.first_record = first_record;
+            this->copyIn(pos, &frame, sizeof(frame));
+            this->copyIn(pos + sizeof(frame), payload, bytes);
+            this->header->write_pos.store(pos + frameSize, std::memory_order_release);
+        }
+    }
+
+    if (kind == SHM_FRAME_RECORDS) {
+        if (written) {
+            this->header->records += count;
+        } else {
+            this->header->dropped_records += count;
+            this->header->dropped_frames++;
+        }
+    }
+
+    this->lock.clear(std::memory_order_release);
+    return written;
+}
+
+
+inline void ShmRing::Drop(const uint32_t count) {
+    while (this->lock.test_and_set(std::memory_order_acquire)) {
+        ShmRing::yield();
+    }
+    this->header->dropped_records += count;
+    this->header->dropped_frames++;
+    this->lock.clear(std::memory_order_release);
+}
+
+
+inline bool ShmRing::Read(shm_frame_t &frame, std::vector<unsigned char> &payload) {
+    const uint64_t pos = this->header->read_pos.load(std::memory_order_relaxed);
+    if (this->header->write_pos.load(std::memory_order_acquire) == pos) {
+        return false;
+    }
+    this->copyOut(pos, &frame, sizeof(frame));
+    payload.resize(frame.size);
+    this->copyOut(pos + sizeof(frame), payload.data(), frame.size);
+    const uint64_t frameSize = (sizeof(shm_frame_t) + frame.size + 7) & ~static_cast<uint64_t>(7);
+    this->header->read_pos.store(pos + frameSize, std::memory_order_release);
+    return true;
+}
+
+#endif // end ifndef REGINA_SHM_RING_H_INCLUDED
@@ -0,0 +1,256 @@
+#ifndef REGINA_SIMPOINT_H_INCLUDED
+#define REGINA_SIMPOINT_H_INCLUDED
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <stdint.h>
+
+#include "bbv.h"
+
+/*
+ * SimPoint-style selection of representative intervals: the basic-block
+ * vectors are normalized, randomly projected to SIMPOINT_DIMS dimensions
+ * and clustered with k-means for k = 1..max_k. The smallest k whose BIC
+ * reaches 90% of the range of scores wins; of each cluster the interval
+ * closest to the centroid represents it, weighted by the instructions of
+ * the cluster. Everything is seeded deterministically.
+ */
+
+#define SIMPOINT_DIMS 15
+#define SIMPOINT_SEEDS 5
+#define SIMPOINT_ITERATIONS 100
+#define SIMPOINT_BIC_THRESHOLD 0.9
+
+typedef struct _simpoint_t {
+    size_t interval;    //< index into the intervals
+    size_t cluster;
+    double weight;      //< share of all instructions
+} simpoint_t;
+
+typedef struct _simpoint_vec_t {
+    double v[SIMPOINT_DIMS];
+} simpoint_vec_t;
+
+/* An interval as kept for the clustering, its vector already projected. */
+typedef struct _simpoint_interval_t {
+    uint32_t thread_idx;
+    uint64_t index;         //< interval within the thread
+    uint64_t instrs;        //< instructions executed in the interval
+    simpoint_vec_t point;
+} simpoint_interval_t;
+
+
+inline uint64_t simpoint_mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+
+/* Entry of the projection matrix, uniform in [-1, 1]. */
+inline double simpoint_projection(const uint32_t slot, const size_t dim) {
+    const uint64_t h = simpoint_mix(static_cast<uint64_t>(slot) * SIMPOINT_DIMS + dim);
+    return static_cast<double>(h >> 11) / static_cast<double>(1ull << 52) - 1.0;
+}
+
+
+inline double simpoint_distance(const simpoint_vec_t &a, const simpoint_vec_t &b) {
+    double d = 0.0;
+    for (size_t i = 0; i < SIMPOINT_DIMS; i++) {
+        d += (a.v[i] - b.v[i]) * (a.v[i] - b.v[i]);
+    }
+    return d;
+}
+
+
+/* Normalizes the vector of an interval and projects it to SIMPOINT_DIMS dimensions. */
+inline void simpoint_project(const bbv_interval_t &interval, simpoint_vec_t &out) {
+    for (size_t d = 0; d < SIMPOINT_DIMS; d++) {
+        out.v[d] = 0.0;
+    }
+    double total = 0.0;
+    for (size_t j = 0; j < interval.counts.size(); j++) {
+        total += static_cast<double>(interval.counts[j].second);
+    }
+    if (total == 0.0) {
+        return;
+    }
+    for (size_t j = 0; j < interval.counts.size(); j++) {
+        const double w = static_cast<double>(interval.counts[j].second) / total;
+        for (size_t d = 0; d < SIMPOINT_DIMS; d++) {
+            out.v[d] += w * simpoint_projection(interval.counts[j].first, d);
+        }
+    }
+}
+
+
+/*
+ * One k-means run with k-means++ seeding. Returns the sum of squared
+ * distances, assign and centroids hold the clustering.
+ */
+inline double simpoint_kmeans(const std::vector<simpoint_vec_t> &points, const size_t k, uint64_t seed,
+    std::vector<size_t> &assign, std::vector<simpoint_vec_t> &centroids) {
+    const size_t n = points.size();
+    std::vector<double> nearest(n, std::numeric_limits<double>::max());
+    centroids.clear();
+    centroids.push_back(points[(seed = simpoint_mix(seed)) % n]);
+    while (centroids.size() < k) {
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            const double d = simpoint_distance(points[i], centroids.back());
+            nearest[i] = (d < nearest[i]) ? d : nearest[i];
+            sum += nearest[i];
+        }
+        // Pick the next centroid proportionally to the squared distance.
+        double r = sum * static_cast<double>((seed = simpoint_mix(seed)) >> 11) / static_cast<double>(1ull << 53);
+        size_t next = n - 1;
+        for (size_t i = 0; i < n; i++) {
+            if ((r -= nearest[i]) < 0.0) {
+                next = i;
+                break;
+            }
+        }
+        centroids.push_back(points[next]);
+    }
+
+    assign.assign(n, 0);
+    double sse = 0.0;
+    for (size_t it = 0; it < SIMPOINT_ITERATIONS; it++) {
+        bool changed = (it == 0);
+        sse = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            size_t best = 0;
+            double bestDist = std::numeric_limits<double>::max();
+            for (size_t c = 0; c < k; c++) {
+                const double d = simpoint_distance(points[i], centroids[c]);
+                if (d < bestDist) {
+                    bestDist = d;
+                    best = c;
+                }
+            }
+            changed |= (assign[i] != best);
+            assign[i] = best;
+            sse += bestDist;
+        }
+        if (!changed) {
+            break;
+        }
+        std::vector<size_t> sizes(k, 0);
+        for (size_t c = 0; c < k; c++) {
+            for (size_t d = 0; d < SIMPOINT_DIMS; d++) {
+                centroids[c].v[d] = 0.0;
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            sizes[assign[i]]++;
+            for (size_t d = 0; d < SIMPOINT_DIMS; d++) {
+                centroids[assign[i]].v[d] += points[i].v[d];
+            }
+        }
+        for (size_t c = 0; c < k; c++) {
+            for (size_t d = 0; d < SIMPOINT_DIMS && sizes[c] > 0; d++) {
+                centroids[c].v[d] /= static_cast<double>(sizes[c]);
+            }
+        }
+    }
+    return sse;
+}
+
+
+/* Bayesian information criterion of a clustering (spherical Gaussians, as in X-means). */
+inline double simpoint_bic(const std::vector<size_t> &assign, const size_t k, const double sse) {
+    const double r = static_cast<double>(assign.size());
+    const double m = static_cast<double>(SIMPOINT_DIMS);
+    double variance = (assign.size() > k) ? sse / (m * (r - static_cast<double>(k))) : 0.0;
+    variance = (variance > 1e-12) ? variance : 1e-12;
+
+    std::vector<size_t> sizes(k, 0);
+    for (size_t i = 0; i < assign.size(); i++) {
+        sizes[assign[i]]++;
+    }
+    double likelihood = -r * m / 2.0 * std::log(2.0 * 3.14159265358979323846 * variance) -
+        m * (r - static_cast<double>(k)) / 2.0;
+    for (size_t c = 0; c < k; c++) {
+        if (sizes[c] > 0) {
+            likelihood += static_cast<double>(sizes[c]) * std::log(static_cast<double>(sizes[c]) / r);
+        }
+    }
+    const double params = static_cast<double>(k - 1) + m * static_cast<double>(k) + 1.0;
+    return likelihood - params / 2.0 * std::log(r);
+}
+
+
+/* Picks representative intervals, returns the number of clusters. */
+inline size_t simpoint_select(const std::vector<simpoint_interval_t> &intervals, size_t max_k, std::vector<simpoint_t> &out) {
+    out.clear();
+    if (intervals.empty()) {
+        return 0;
+    }
+    std::vector<simpoint_vec_t> points(intervals.size());
+    for (size_t i = 0; i < intervals.size(); i++) {
+        points[i] = intervals[i].point;
+    }
+    max_k = (max_k < points.size()) ? max_k : points.size();
+    max_k = (max_k > 0) ? max_k : 1;
+
+    // Best of several seeds per k.
+    std::vector<std::vector<size_t> > assigns(max_k + 1);
+    std::vector<std::vector<simpoint_vec_t> > centers(max_k + 1);
+    std::vector<double> bics(max_k + 1);
+    std::vector<size_t> assign;
+    std::vector<simpoint_vec_t> centroids;
+    for (size_t k = 1; k <= max_k; k++) {
+        double best = std::numeric_limits<double>::max();
+        for (uint64_t seed = 0; seed < SIMPOINT_SEEDS; seed++) {
+            const double sse = simpoint_kmeans(points, k, k * SIMPOINT_SEEDS + seed, assign, centroids);
+            if (sse < best) {
+                best = sse;
+                assigns[k].swap(assign);
+                centers[k].swap(centroids);
+            }
+        }
+        bics[k] = simpoint_bic(assigns[k], k, best);
+    }
+
+    double lo = bics[1], hi = bics[1];
+    for (size_t k = 2; k <= max_k; k++) {
+        lo = (bics[k] < lo) ? bics[k] : lo;
+        hi = (bics[k] > hi) ? bics[k] : hi;
+    }
+    size_t k = 1;
+    while (k < max_k && bics[k] < lo + SIMPOINT_BIC_THRESHOLD * (hi - lo)) {
+        k++;
+    }
+
+    double total = 0.0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        total += static_cast<double>(intervals[i].instrs);
+    }
+    for (size_t c = 0; c < k; c++) {
+        simpoint_t sp;
+        sp.interval = intervals.size();
+        sp.cluster = c;
+        sp.weight = 0.0;
+        double nearest = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < intervals.size(); i++) {
+            if (assigns[k][i] != c) {
+                continue;
+            }
+            sp.weight += static_cast<double>(intervals[i].instrs);
+            const double d = simpoint_distance(points[i], centers[k][c]);
+            if (d < nearest) {
+                nearest = d;
+                sp.interval = i;
+            }
+        }
+        if (sp.interval < intervals.size()) {
+            sp.weight = (total > 0.0) ? sp.weight / total : 0.0;
+            out.push_back(sp);
+        }
+    }
+    return k;
+}
+
+#endif // end ifndef REGINA_SIMPOINT_H_INCLUDED
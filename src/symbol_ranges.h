@@ -0,0 +1,87 @@
+#ifndef REGINA_SYMBOL_RANGES_H_INCLUDED
+#define REGINA_SYMBOL_RANGES_H_INCLUDED
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define SYMBOL_ID_NONE static_cast<size_t>(-1)
+
+/*
+ * Symbols of a single module, sorted by module offset. An offset belongs to
+ * the closest symbol below it (as with drsym_lookup_address). Each entry
+ * caches the symbol index the symbol got when it was first resolved, so
+ * repeated lookups are a binary search without building or hashing names.
+ */
+class SymbolRanges {
+public:
+    typedef struct _symbol_entry_t {
+        size_t offs;
+        size_t name;        //< offset into the name pool
+        size_t id;          //< SYMBOL_ID_NONE until first resolved
+
+        inline bool operator<(const _symbol_entry_t &rhs) const {
+            return this->offs < rhs.offs;
+        }
+    } symbol_entry_t;
+
+    inline SymbolRanges(void) { }
+
+    inline void Add(const size_t offs, const char *name) {
+        if (name == NULL) {
+            return;
+        }
+        symbol_entry_t entry;
+        entry.offs = offs;
+        entry.name = this->names.size();
+        entry.id = SYMBOL_ID_NONE;
+        this->names.append(name);
+        this->names.push_back('\0');
+        this->entries.push_back(entry);
+    }
+
+    /* Sorts the entries, of aliases the first one is kept. */
+    inline void Finalize(void) {
+        std::stable_sort(this->entries.begin(), this->entries.end());
+        this->entries.erase(std::unique(this->entries.begin(), this->entries.end(),
+            [](const symbol_entry_t &l, const symbol_entry_t &r) { return l.offs == r.offs; }),
+            this->entries.end());
+        this->entries.shrink_to_fit();
+        // The search only touches this dense array of offsets.
+        this->offsets.resize(this->entries.size());
+        for (size_t i = 0; i < this->entries.size(); i++) {
+            this->offsets[i] = this->entries[i].offs;
+        }
+    }
+
+    inline symbol_entry_t *Lookup(const size_t offs) {
+        const size_t *base = this->offsets.data();
+        size_t n = this->offsets.size();
+        if (n == 0 || offs < base[0]) {
+            return NULL;
+        }
+        // Branch-free search for the last offset <= offs.
+        while (n > 1) {
+            const size_t half = n / 2;
+            base = (base[half] <= offs) ? base + half : base;
+            n -= half;
+        }
+        return &this->entries[base - this->offsets.data()];
+    }
+
+    inline const char *Name(const symbol_entry_t *entry) const {
+        return this->names.c_str() + entry->name;
+    }
+
+    inline size_t Size(void) const {
+        return this->entries.size();
+    }
+
+private:
+    std::vector<symbol_entry_t> entries;
+    std::vector<size_t> offsets;
+    std::string names;
+};
+
+#endif // end ifndef REGINA_SYMBOL_RANGES_H_INCLUDED
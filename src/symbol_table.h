@@ -0,0 +1,111 @@
+#ifndef REGINA_SYMBOL_TABLE_H_INCLUDED
+#define REGINA_SYMBOL_TABLE_H_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Interned symbol names. Indices are handed out in order of first use and
+ * end up in the records; the table is written as "idx|name" lines to the
+ * .mmtrd.txt file. The names and the table live in Alloc; lookups go
+ * through a reused key, so only new names allocate. Not synchronized.
+ */
+template<class Alloc = std::allocator<char> >
+class BasicSymbolTable {
+public:
+    typedef std::basic_string<char, std::char_traits<char>, Alloc> string_t;
+
+    inline BasicSymbolTable(const Alloc &alloc = Alloc()) :
+        lookup(16, hash_t(), std::equal_to<string_t>(), map_alloc_t(alloc)), key(alloc), next(0) { }
+
+    /* Returns the index of name, inserted tells whether it is new. */
+    inline size_t Intern(const char *name, const size_t len, bool &inserted) {
+        this->key.assign(name, len);
+        auto it = this->lookup.find(this->key);
+        if (it != this->lookup.end()) {
+            inserted = false;
+            return it->second;
+        }
+        inserted = true;
+        this->lookup.insert(std::make_pair(this->key, this->next));
+        return this->next++;
+    }
+
+    inline size_t Intern(const std::string &name, bool &inserted) {
+        return this->Intern(name.data(), name.size(), inserted);
+    }
+
+    inline size_t Size(void) const {
+        return this->lookup.size();
+    }
+
+    inline void Write(FILE *f) const {
+        for (auto it = this->lookup.begin(); it != this->lookup.end(); ++it) {
+            std::fprintf(f, "%llu|%s\n", static_cast<unsigned long long>(it->second), it->first.c_str());
+        }
+    }
+
+    BasicSymbolTable(const BasicSymbolTable &rhs) = delete;
+
+    BasicSymbolTable &operator=(const BasicSymbolTable &rhs) = delete;
+
+private:
+    /* FNV-1a, std::hash only covers the standard allocator. */
+    struct hash_t {
+        inline size_t operator()(const string_t &s) const {
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (size_t i = 0; i < s.size(); i++) {
+                h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001b3ull;
+            }
+            return static_cast<size_t>(h);
+        }
+    };
+
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<const string_t, size_t> > map_alloc_t;
+
+    std::unordered_map<string_t, size_t, hash_t, std::equal_to<string_t>, map_alloc_t> lookup;
+    string_t key;       //< reused for lookups
+    size_t next;
+};
+
+typedef BasicSymbolTable<> SymbolTable;
+
+
+/*
+ * Reads a table written by SymbolTable::Write, names[idx] is the name of
+ * symbol idx. Indices without a line get an empty name.
+ */
+inline bool symbol_table_read(const char *path, std::vector<std::string> &names) {
+    FILE *f = std::fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[4096];
+    while (std::fgets(line, sizeof(line), f) != NULL) {
+        char *sep = std::strchr(line, '|');
+        if (sep == NULL) {
+            continue;
+        }
+        const size_t idx = static_cast<size_t>(std::strtoull(line, NULL, 10));
+        char *end = sep + std::strlen(sep);
+        while (end > sep + 1 && (end[-1] == '\n' || end[-1] == '\r')) {
+            *--end = '\0';
+        }
+        if (idx >= names.size()) {
+            names.resize(idx + 1);
+        }
+        names[idx] = sep + 1;
+    }
+    std::fclose(f);
+    return true;
+}
+
+#endif // end ifndef REGINA_SYMBOL_TABLE_H_INCLUDED
@@ -0,0 +1,20 @@
+#include "trace_container.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+/*
+ * Platform specific part of TraceContainer, kept out of the header for the
+ * same reason as in shm_ring.cpp.
+ */
+
+void TraceContainer::yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
@@ -0,0 +1,106 @@
+#ifndef REGINA_TRACE_CONTAINER_H_INCLUDED
+#define REGINA_TRACE_CONTAINER_H_INCLUDED
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "mmtrd_format.h"
+
+/*
+ * Writer of a container (see mmtrd_format.h): one file for the traces of
+ * all threads. Threads collect a chunk in memory and hand it over when it
+ * is complete; Append() serializes them, so the file is written by one
+ * thread at a time in large blocks. The index is kept in memory and
+ * written by Close(), after the last thread is done.
+ */
+class TraceContainer {
+public:
+    inline TraceContainer(void) : f(NULL), offset(0), records(0), chunkSize(MMTRD_DEFAULT_CHUNK_SIZE) {
+        this->lock.clear();
+    }
+
+    inline ~TraceContainer(void) {
+        this->Close();
+    }
+
+    inline bool Open(const char *filename, const uint32_t chunk_size = MMTRD_DEFAULT_CHUNK_SIZE) {
+        this->Close();
+        this->f = std::fopen(filename, "wb");
+        if (this->f == NULL) {
+            return false;
+        }
+        std::fwrite(MMTRD_CONTAINER_MAGIC, 8, 1, this->f);
+        this->offset = 8;
+        this->records = 0;
+        this->chunkSize = chunk_size;
+        this->index.clear();
+        return true;
+    }
+
+    /*
+     * Writes a complete chunk of a thread, chunk.size bytes at data. The
+     * offset of the chunk is set to its place in the container.
+     */
+    inline void Append(mmtrd_chunk_t &chunk, const unsigned char *data) {
+        while (this->lock.test_and_set(std::memory_order_acquire)) {
+            TraceContainer::yield();
+        }
+        if (this->f != NULL) {
+            chunk.offset = this->offset + sizeof(mmtrd_chunk_t);
+            std::fwrite(&chunk, sizeof(chunk), 1, this->f);
+            std::fwrite(data, 1, static_cast<size_t>(chunk.size), this->f);
+            this->offset += sizeof(chunk) + chunk.size;
+            this->records += chunk.record_count;
+            this->index.push_back(chunk);
+        }
+        this->lock.clear(std::memory_order_release);
+    }
+
+    /* Writes index and footer; no thread may append any more. */
+    inline void Close(void) {
+        if (this->f == NULL) {
+            return;
+        }
+
+        mmtrd_footer_t footer;
+        std::memset(&footer, 0, sizeof(footer));
+        footer.index_offset = this->offset;
+        footer.chunk_count = this->index.size();
+        footer.record_count = this->records;
+        footer.chunk_size = this->chunkSize;
+        footer.version = MMTRD_FORMAT_VERSION;
+        std::memcpy(footer.magic, MMTRD_FOOTER_MAGIC, sizeof(footer.magic));
+
+        if (!this->index.empty()) {
+            std::fwrite(this->index.data(), sizeof(mmtrd_chunk_t), this->index.size(), this->f);
+        }
+        std::fwrite(&footer, sizeof(footer), 1, this->f);
+
+        std::fclose(this->f);
+        this->f = NULL;
+        this->index.clear();
+    }
+
+    inline bool IsOpen(void) const {
+        return this->f != NULL;
+    }
+
+    TraceContainer(const TraceContainer &rhs) = delete;
+
+    TraceContainer &operator=(const TraceContainer &rhs) = delete;
+
+private:
+    static void yield(void);
+
+    FILE *f;
+    uint64_t offset;
+    uint64_t records;
+    uint32_t chunkSize;
+    std::vector<mmtrd_chunk_t> index;
+    std::atomic_flag lock;
+};
+
+#endif // end ifndef REGINA_TRACE_CONTAINER_H_INCLUDED
@@ -0,0 +1,197 @@
+#ifndef REGINA_TRACE_FLUSH_H_INCLUDED
+#define REGINA_TRACE_FLUSH_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "trace_ref_t.h"
+
+#define FLUSH_MIN_TABLE 1024    //< initial slots of the pc table, a power of two
+
+/*
+ * Reusable state of trace_flush: the distinct PCs of a batch and their
+ * symbols. PCs are found with an open addressing table that is emptied by
+ * bumping a generation instead of clearing it, so a flush allocates only
+ * while the batches of the thread still grow. Not synchronized, one per
+ * thread.
+ */
+class FlushBatch {
+public:
+    inline FlushBatch(void) : generation(0), mask(FLUSH_MIN_TABLE - 1) {
+        this->table.resize(FLUSH_MIN_TABLE);
+    }
+
+    /*
+     * Collects the distinct PCs of trace, instructions and call/return
+     * targets, and remembers the unique slot of each of them per record.
+     */
+    template<class Trace>
+    inline void Collect(const Trace &trace) {
+        this->Begin();
+        this->refs.resize(2 * trace.size());
+        uint32_t *ref = this->refs.data();
+        for (size_t i = 0; i < trace.size(); i++, ref += 2) {
+            const trace_ref_t &tmp = trace[i];
+            ref[0] = this->Slot(tmp.instr_addr);
+            ref[1] = tmp.is_mem_ref ? ref[0] : this->Slot(tmp.target_addr);
+        }
+    }
+
+    /*
+     * Calls intern(pc, name) once per distinct PC; names are kept only if
+     * the output needs them.
+     */
+    template<class Intern>
+    inline void Resolve(Intern &intern, const bool withNames) {
+        this->symbols.resize(this->pcs.size());
+        if (withNames && this->names.size() < this->pcs.size()) {
+            this->names.resize(this->pcs.size());
+        }
+        for (size_t u = 0; u < this->pcs.size(); u++) {
+            this->symbols[u] = intern(this->pcs[u], withNames ? &this->names[u] : NULL);
+        }
+    }
+
+    /* Unique slots of instruction and target of record i. */
+    inline const uint32_t *Refs(const size_t i) const {
+        return this->refs.data() + 2 * i;
+    }
+
+    inline size_t Symbol(const uint32_t slot) const {
+        return this->symbols[slot];
+    }
+
+    inline const std::string &Name(const uint32_t slot) const {
+        return this->names[slot];
+    }
+
+    /* Distinct PCs of the last batch. */
+    inline size_t Size(void) const {
+        return this->pcs.size();
+    }
+
+    FlushBatch(const FlushBatch &rhs) = delete;
+
+    FlushBatch &operator=(const FlushBatch &rhs) = delete;
+
+private:
+    typedef struct _entry_t {
+        unsigned char *pc;
+        uint32_t generation;    //< the entry is empty unless it matches
+        uint32_t slot;
+    } entry_t;
+
+    inline void Begin(void) {
+        this->pcs.clear();
+        if (++this->generation == 0) {
+            // Wrapped around, stale entries could match again.
+            for (size_t i = 0; i < this->table.size(); i++) {
+                this->table[i].generation = 0;
+            }
+            this->generation = 1;
+        }
+    }
+
+    inline uint32_t Slot(unsigned char *pc) {
+        const uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pc)) * 0x9e3779b97f4a7c15ull;
+        size_t i = static_cast<size_t>(h >> 32) & this->mask;
+        for (;;) {
+            entry_t &e = this->table[i];
+            if (e.generation != this->generation) {
+                e.pc = pc;
+                e.generation = this->generation;
+                e.slot = static_cast<uint32_t>(this->pcs.size());
+                this->pcs.push_back(pc);
+                if (2 * this->pcs.size() > this->table.size()) {
+                    this->Grow();
+                }
+                return static_cast<uint32_t>(this->pcs.size() - 1);
+            }
+            if (e.pc == pc) {
+                return e.slot;
+            }
+            i = (i + 1) & this->mask;
+        }
+    }
+
+    /* Doubles the table and enters the PCs of this batch again. */
+    inline void Grow(void) {
+        this->table.assign(2 * this->table.size(), entry_t());
+        this->mask = this->table.size() - 1;
+        this->generation = 1;
+        for (size_t u = 0; u < this->pcs.size(); u++) {
+            const uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(this->pcs[u])) * 0x9e3779b97f4a7c15ull;
+            size_t i = static_cast<size_t>(h >> 32) & this->mask;
+            while (this->table[i].generation == this->generation) {
+                i = (i + 1) & this->mask;
+            }
+            this->table[i].pc = this->pcs[u];
+            this->table[i].generation = this->generation;
+            this->table[i].slot = static_cast<uint32_t>(u);
+        }
+    }
+
+    std::vector<entry_t> table;
+    uint32_t generation;
+    size_t mask;
+    std::vector<unsigned char *> pcs;   //< distinct PCs in order of appearance
+    std::vector<size_t> symbols;        //< symbol index per distinct PC
+    std::vector<std::string> names;     //< symbol string per distinct PC
+    std::vector<uint32_t> refs;         //< distinct PC slots, two per record
+};
+
+
+/*
+ * Writes a batch of buffered references (a vector of trace_ref_t with any
+ * allocator) through filer to out. intern is called as intern(pc, name)
+ * and returns the symbol index of pc; name receives the symbol string and
+ * is NULL unless FileIOType::SymbolNames.
+ *
+ * The batch is written in three passes: the distinct PCs are collected,
+ * each of them is symbolized once, then the records are encoded with the
+ * symbols looked up by slot. The record structs are reused, so the encode
+ * pass copies no strings for binary outputs.
+ *
+ * Kept free of DynamoRIO, so the flush path can be measured on its own
+ * (see bench/).
+ */
+template<class FileIOType, class Trace, class Output, class Intern>
+inline void trace_flush(const Trace &trace, FileIOType &filer, Output *out, Intern &intern, FlushBatch &batch) {
+    typedef typename FileIOType::Super Super;
+
+    batch.Collect(trace);
+    batch.Resolve(intern, FileIOType::SymbolNames);
+
+    typename Super::MemRef_t mrt;
+    typename Super::CallRetRef_t crt;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const trace_ref_t &tmp = trace[i];
+        const uint32_t *ref = batch.Refs(i);
+        if (tmp.is_mem_ref) {
+            mrt.is_write = tmp.is_write != 0;
+            mrt.instr = tmp.instr_addr;
+            mrt.size = static_cast<unsigned char>(tmp.size);
+            mrt.data = tmp.data_addr;
+            mrt.symIdx = batch.Symbol(ref[0]);
+            if (FileIOType::SymbolNames) {
+                mrt.instrSym = batch.Name(ref[0]);
+            }
+            filer.Print(out, Super::RefType::MemRef, &mrt);
+        } else {
+            crt.instr = tmp.instr_addr;
+            crt.target = tmp.target_addr;
+            crt.instrSymIdx = batch.Symbol(ref[0]);
+            crt.targetSymIdx = batch.Symbol(ref[1]);
+            if (FileIOType::SymbolNames) {
+                crt.instrSym = batch.Name(ref[0]);
+                crt.targetSym = batch.Name(ref[1]);
+            }
+            const typename Super::RefType type = !tmp.is_call ? Super::RefType::RetRef
+                : (tmp.is_ind ? Super::RefType::CallIndRef : Super::RefType::CallRef);
+            filer.Print(out, type, &crt);
+        }
+    }
+}
+
+#endif // end ifndef REGINA_TRACE_FLUSH_H_INCLUDED
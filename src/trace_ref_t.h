@@ -4,18 +4,19 @@
 #include <vector>
 #include <stdint.h>
 
-#include "dr_api.h"
-
 #pragma pack(1) //< TODO Christoph ist sich net sicher
 typedef struct _trace_ref_t {
     int32_t is_mem_ref;
     int32_t is_write;
     int32_t is_call;
     int32_t is_ind;
+    int32_t has_value;
+    int32_t loop;                  //< 1 + id of the innermost loop, 0 outside loops (-loops)
     void *data_addr;
-    uint size;
-    app_pc instr_addr;
-    app_pc target_addr;
+    unsigned int size;
+    unsigned char *instr_addr;     //< app_pc
+    unsigned char *target_addr;    //< app_pc
+    uint64_t value;                //< memory contents before the access (-values)
 
     _trace_ref_t() { };
 
@@ -24,11 +25,16 @@ typedef struct _trace_ref_t {
         this->is_write = rhs.is_write;
         this->is_call = rhs.is_call;
         this->is_ind = rhs.is_ind;
+        this->has_value = rhs.has_value;
+        this->loop = rhs.loop;
         this->data_addr = rhs.data_addr;
         this->size = rhs.size;
         this->instr_addr = rhs.instr_addr;
         this->target_addr = rhs.target_addr;
+        this->value = rhs.value;
     }
+
+    _trace_ref_t &operator=(const _trace_ref_t &rhs) = default;
 } trace_ref_t;
 
 typedef std::vector<trace_ref_t> thr_trc_str;
@@ -0,0 +1,126 @@
+#ifndef REGINA_VALUE_PROFILE_H_INCLUDED
+#define REGINA_VALUE_PROFILE_H_INCLUDED
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#define VALUE_SHADOW_ENTRIES (1 << 20)
+
+/*
+ * Silent stores and redundant loads per PC. Every captured access carries
+ * the memory contents before it, so for a load that is the value loaded
+ * and for a store the value it overwrites. The value a store wrote is
+ * what the next access to the same address finds, hence stores are
+ * resolved lazily: a store is silent if the next access of the thread sees
+ * the value the store overwrote. A load is redundant if the previous
+ * access to the address was a load of the same value.
+ *
+ * The shadow state is per thread and matches accesses by address and
+ * size; it is dropped when it exceeds VALUE_SHADOW_ENTRIES addresses.
+ * Writes of other threads make stores look non-silent.
+ */
+typedef struct _value_stats_t {
+    uint64_t loads;
+    uint64_t redundant;     //< loads of the value loaded before
+    uint64_t stores;
+    uint64_t resolved;      //< stores followed by another access
+    uint64_t silent;        //< resolved stores that left the value unchanged
+
+    inline _value_stats_t(void) : loads(0), redundant(0), stores(0), resolved(0), silent(0) { }
+
+    inline void Merge(const _value_stats_t &rhs) {
+        this->loads += rhs.loads;
+        this->redundant += rhs.redundant;
+        this->stores += rhs.stores;
+        this->resolved += rhs.resolved;
+        this->silent += rhs.silent;
+    }
+
+    /* Accesses that could have been avoided. */
+    inline uint64_t Wasted(void) const {
+        return this->redundant + this->silent;
+    }
+} value_stats_t;
+
+
+class ValueProfile {
+public:
+    inline ValueProfile(void) { }
+
+    inline void Access(const uint64_t pc, const uint64_t addr, const unsigned int size, const uint64_t value,
+        const bool is_write) {
+        if (this->shadow.size() >= VALUE_SHADOW_ENTRIES) {
+            this->shadow.clear();
+        }
+        shadow_t &s = this->shadow[addr];
+        const bool known = (s.size == size);
+        if (known && s.stored) {
+            value_stats_t &prev = this->stats[s.pc];
+            prev.resolved++;
+            prev.silent += (value == s.value) ? 1 : 0;
+        }
+
+        value_stats_t &st = this->stats[pc];
+        if (is_write) {
+            st.stores++;
+            s.stored = true;
+            s.pc = pc;
+        } else {
+            st.loads++;
+            st.redundant += (known && !s.stored && value == s.value) ? 1 : 0;
+            s.stored = false;
+        }
+        s.value = value;
+        s.size = size;
+    }
+
+    /* Adds the statistics of another thread; the shadow state stays per thread. */
+    inline void Merge(const ValueProfile &rhs) {
+        for (auto it = rhs.stats.begin(); it != rhs.stats.end(); ++it) {
+            this->stats[it->first].Merge(it->second);
+        }
+    }
+
+    /* PCs by avoidable accesses, then by accesses. */
+    inline void Sorted(std::vector<std::pair<uint64_t, const value_stats_t *>> &out) const {
+        out.clear();
+        for (auto it = this->stats.begin(); it != this->stats.end(); ++it) {
+            out.push_back(std::make_pair(it->first, &it->second));
+        }
+        std::sort(out.begin(), out.end(), [](const std::pair<uint64_t, const value_stats_t *> &l,
+            const std::pair<uint64_t, const value_stats_t *> &r) {
+            if (l.second->Wasted() != r.second->Wasted()) {
+                return l.second->Wasted() > r.second->Wasted();
+            }
+            const uint64_t lc = l.second->loads + l.second->stores;
+            const uint64_t rc = r.second->loads + r.second->stores;
+            return (lc != rc) ? lc > rc : l.first < r.first;
+        });
+    }
+
+    inline size_t Size(void) const {
+        return this->stats.size();
+    }
+
+    ValueProfile(const ValueProfile &rhs) = delete;
+
+    ValueProfile &operator=(const ValueProfile &rhs) = delete;
+
+private:
+    typedef struct _shadow_t {
+        uint64_t value;     //< contents after a load, before a pending store
+        uint64_t pc;        //< the pending store
+        unsigned int size;
+        bool stored;
+
+        inline _shadow_t(void) : value(0), pc(0), size(0), stored(false) { }
+    } shadow_t;
+
+    std::unordered_map<uint64_t, value_stats_t> stats;
+    std::unordered_map<uint64_t, shadow_t> shadow;
+};
+
+#endif // end ifndef REGINA_VALUE_PROFILE_H_INCLUDED
@@ -0,0 +1,76 @@
+#ifndef REGINA_WATCH_RANGES_H_INCLUDED
+#define REGINA_WATCH_RANGES_H_INCLUDED
+
+#include <map>
+#include <stdint.h>
+
+/*
+ * Smallest interval covering all watch ranges. The instrumentation compares
+ * every data address against it inline; only references inside reach the
+ * clean call, where WatchRanges::Contains() decides exactly.
+ */
+typedef struct _watch_envelope_t {
+    uint64_t lo;
+    uint64_t hi;    //< exclusive
+} watch_envelope_t;
+
+
+/*
+ * Data address ranges whose references are traced. Ranges are keyed by
+ * their start; adding a range with an existing start replaces it. Ranges
+ * are not expected to overlap, an address is only matched against the
+ * range starting closest below it. Not synchronized.
+ */
+class WatchRanges {
+public:
+    inline void Add(const uint64_t start, const uint64_t size) {
+        if (size == 0) {
+            return;
+        }
+        this->ranges[start] = start + size;
+    }
+
+    /* Removes the range starting at start, returns false if there is none. */
+    inline bool Remove(const uint64_t start) {
+        return this->ranges.erase(start) > 0;
+    }
+
+    /* Removes the ranges starting in [lo, hi), e.g. of an unloaded module. */
+    inline void RemoveWithin(const uint64_t lo, const uint64_t hi) {
+        this->ranges.erase(this->ranges.lower_bound(lo), this->ranges.lower_bound(hi));
+    }
+
+    inline bool Contains(const uint64_t addr) const {
+        auto it = this->ranges.upper_bound(addr);
+        if (it == this->ranges.begin()) {
+            return false;
+        }
+        --it;
+        return addr < it->second;
+    }
+
+    /* An empty set yields an envelope no address falls into. */
+    inline watch_envelope_t Envelope(void) const {
+        watch_envelope_t env;
+        env.lo = UINT64_MAX;
+        env.hi = 0;
+        for (auto it = this->ranges.begin(); it != this->ranges.end(); ++it) {
+            if (it->first < env.lo) {
+                env.lo = it->first;
+            }
+            if (it->second > env.hi) {
+                env.hi = it->second;
+            }
+        }
+        return env;
+    }
+
+    inline size_t Size(void) const {
+        return this->ranges.size();
+    }
+
+private:
+    std::map<uint64_t, uint64_t> ranges;    //< start -> end
+};
+
+#endif // end ifndef REGINA_WATCH_RANGES_H_INCLUDED
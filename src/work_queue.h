@@ -0,0 +1,71 @@
+#ifndef REGINA_WORK_QUEUE_H_INCLUDED
+#define REGINA_WORK_QUEUE_H_INCLUDED
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * Work-stealing task queues for the offline tools, one per worker. A
+ * worker takes tasks from the front of its own queue and, once that is
+ * empty, steals from the back of the others. Tasks are coarse (a trace
+ * chunk), so every queue simply has its own mutex. All tasks are pushed
+ * before the workers start.
+ */
+template<class Task>
+class WorkQueues {
+public:
+    inline WorkQueues(const size_t workers) {
+        for (size_t i = 0; i < workers; i++) {
+            this->queues.push_back(std::unique_ptr<queue_t>(new queue_t()));
+        }
+    }
+
+    inline size_t Workers(void) const {
+        return this->queues.size();
+    }
+
+    inline void Push(const size_t worker, const Task &task) {
+        queue_t &q = *this->queues[worker % this->queues.size()];
+        std::lock_guard<std::mutex> lock(q.lock);
+        q.tasks.push_back(task);
+    }
+
+    /* Returns false once all queues are empty. */
+    inline bool Pop(const size_t worker, Task &task) {
+        {
+            queue_t &own = *this->queues[worker];
+            std::lock_guard<std::mutex> lock(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < this->queues.size(); i++) {
+            queue_t &victim = *this->queues[(worker + i) % this->queues.size()];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    WorkQueues(const WorkQueues &rhs) = delete;
+
+    WorkQueues &operator=(const WorkQueues &rhs) = delete;
+
+private:
+    typedef struct _queue_t {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    } queue_t;
+
+    std::vector<std::unique_ptr<queue_t>> queues;
+};
+
+#endif // end ifndef REGINA_WORK_QUEUE_H_INCLUDED
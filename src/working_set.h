@@ -0,0 +1,191 @@
+#ifndef REGINA_WORKING_SET_H_INCLUDED
+#define REGINA_WORKING_SET_H_INCLUDED
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "hyperloglog.h"
+
+#define WS_LINE_SHIFT 6
+#define WS_PAGE_SHIFT 12
+#define WS_PRECISION 10
+#define WS_SYMBOL_PRECISION 8
+#define WS_MAX_SYMBOLS 64
+#define WS_OTHER_SYMBOL static_cast<size_t>(-1)
+
+/*
+ * Distinct cache lines and pages touched by one thread in the current time
+ * window. Memory is bounded: two sketches for the thread plus at most
+ * WS_MAX_SYMBOLS small per-symbol sketches, the remaining symbols share one.
+ */
+class WorkingSet {
+public:
+    inline WorkingSet(const int thread, const bool symbols) :
+        thread(thread), symbols(symbols), window(0), refs(0),
+        lines(WS_PRECISION), pages(WS_PRECISION) { }
+
+    inline ~WorkingSet(void) {
+        this->clearSymbols();
+    }
+
+    inline void Add(const uint64_t addr, const size_t sym) {
+        const uint64_t line = addr >> WS_LINE_SHIFT;
+        const uint64_t lineHash = hll_hash(line);
+        this->lines.Add(lineHash);
+        this->pages.Add(hll_hash(addr >> WS_PAGE_SHIFT));
+        this->refs++;
+
+        if (this->symbols) {
+            auto it = this->symbolLines.find(sym);
+            if (it == this->symbolLines.end()) {
+                const size_t key = (this->symbolLines.size() < WS_MAX_SYMBOLS) ? sym : WS_OTHER_SYMBOL;
+                it = this->symbolLines.find(key);
+                if (it == this->symbolLines.end()) {
+                    it = this->symbolLines.insert(std::make_pair(key, new HyperLogLog(WS_SYMBOL_PRECISION))).first;
+                }
+            }
+            it->second->Add(lineHash);
+        }
+    }
+
+    /* Writes the rows of the current window (see WorkingSetSeries). */
+    inline void Write(FILE *f, const uint64_t window_ms) const {
+        std::fprintf(f, "t|%d|%llu|%llu|%llu|%.0f|%.0f\n", this->thread,
+            static_cast<unsigned long long>(this->window),
+            static_cast<unsigned long long>(this->window * window_ms),
+            static_cast<unsigned long long>(this->refs), this->lines.Estimate(), this->pages.Estimate());
+        for (auto it = this->symbolLines.begin(); it != this->symbolLines.end(); ++it) {
+            std::fprintf(f, "s|%d|%llu|%lld|%.0f\n", this->thread,
+                static_cast<unsigned long long>(this->window),
+                static_cast<long long>(it->first), it->second->Estimate());
+        }
+    }
+
+    inline void Reset(const uint64_t window) {
+        this->window = window;
+        this->refs = 0;
+        this->lines.Clear();
+        this->pages.Clear();
+        this->clearSymbols();
+    }
+
+    inline uint64_t Window(void) const {
+        return this->window;
+    }
+
+    inline uint64_t Refs(void) const {
+        return this->refs;
+    }
+
+    inline const HyperLogLog &Lines(void) const {
+        return this->lines;
+    }
+
+    inline const HyperLogLog &Pages(void) const {
+        return this->pages;
+    }
+
+    WorkingSet(const WorkingSet &rhs) = delete;
+
+    WorkingSet &operator=(const WorkingSet &rhs) = delete;
+
+private:
+    inline void clearSymbols(void) {
+        for (auto it = this->symbolLines.begin(); it != this->symbolLines.end(); ++it) {
+            delete it->second;
+        }
+        this->symbolLines.clear();
+    }
+
+    int thread;
+    bool symbols;
+    uint64_t window;
+    uint64_t refs;
+    HyperLogLog lines;
+    HyperLogLog pages;
+    std::unordered_map<size_t, HyperLogLog *> symbolLines;
+};
+
+
+/*
+ * Working set of all threads, merged per window. Each thread reports the
+ * window it is in; a window is written and dropped as soon as all threads
+ * have passed it, so only the windows still open in some thread cost two
+ * sketches (2 * 2^WS_PRECISION bytes) each.
+ *
+ * Rows written to the series file:
+ *   t|thread|window|ms|refs|lines|pages    one thread, one window
+ *   s|thread|window|sym|lines              one symbol (-1: other symbols)
+ *   m|window|ms|refs|lines|pages           all threads, one window
+ */
+class WorkingSetSeries {
+public:
+    /* From now on, the thread only merges windows from window on. */
+    inline void Enter(const int thread, const uint64_t window) {
+        this->threads[thread] = window;
+    }
+
+    inline void Leave(const int thread) {
+        this->threads.erase(thread);
+    }
+
+    inline void Merge(const WorkingSet &ws) {
+        auto it = this->windows.find(ws.Window());
+        if (it == this->windows.end()) {
+            it = this->windows.insert(std::make_pair(ws.Window(), merged_t())).first;
+        }
+        it->second.refs += ws.Refs();
+        it->second.lines.Merge(ws.Lines());
+        it->second.pages.Merge(ws.Pages());
+    }
+
+    /*
+     * Writes and drops the windows before current (the window of the
+     * present time, no thread enters an earlier one) that all threads have
+     * passed.
+     */
+    inline void Flush(FILE *f, const uint64_t window_ms, uint64_t current) {
+        for (auto it = this->threads.begin(); it != this->threads.end(); ++it) {
+            current = (it->second < current) ? it->second : current;
+        }
+        auto end = this->windows.lower_bound(current);
+        this->write(f, window_ms, this->windows.begin(), end);
+        this->windows.erase(this->windows.begin(), end);
+    }
+
+    /* Writes the remaining windows. */
+    inline void Write(FILE *f, const uint64_t window_ms) {
+        this->write(f, window_ms, this->windows.begin(), this->windows.end());
+        this->windows.clear();
+    }
+
+private:
+    typedef struct _merged_t {
+        uint64_t refs;
+        HyperLogLog lines;
+        HyperLogLog pages;
+
+        inline _merged_t(void) : refs(0), lines(WS_PRECISION), pages(WS_PRECISION) { }
+    } merged_t;
+
+    typedef std::map<uint64_t, merged_t> window_map_t;
+
+    inline void write(FILE *f, const uint64_t window_ms, window_map_t::const_iterator it,
+            const window_map_t::const_iterator end) const {
+        for (; it != end; ++it) {
+            std::fprintf(f, "m|%llu|%llu|%llu|%.0f|%.0f\n",
+                static_cast<unsigned long long>(it->first),
+                static_cast<unsigned long long>(it->first * window_ms),
+                static_cast<unsigned long long>(it->second.refs),
+                it->second.lines.Estimate(), it->second.pages.Estimate());
+        }
+    }
+
+    window_map_t windows;
+    std::map<int, uint64_t> threads;    //< window each live thread is in
+};
+
+#endif // end ifndef REGINA_WORKING_SET_H_INCLUDED
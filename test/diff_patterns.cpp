@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <iostream>
+#include <stdint.h>
+
+#include "access_pattern.h"
+
+// Checks the stride patterns regina_diff reports per symbol. The records
+// of a trace carry no PC, so all loads of a function feed one symbol. The
+// bad and good loop orders of test/matrix.cpp are replayed on two arrays
+// that are read in the same loop; the bad order has to come out strided
+// by a row, the good one sequential. Runs without DynamoRIO, returns 0 if
+// both are recognized.
+
+const size_t N = 64;
+
+typedef float memory_T;
+
+const uint64_t memA = 0x10000000;
+const uint64_t memB = memA + N * N * sizeof(memory_T) + 64;
+
+pattern_t loop_interchange(bool good) {
+    pattern_streams_t sym;
+    for (size_t o = 0; o < N; o++) {
+        for (size_t p = 0; p < N; p++) {
+            const size_t i = good ? o : p;
+            const size_t j = good ? p : o;
+            sym.Access(memA + (i * N + j) * sizeof(memory_T), sizeof(memory_T));
+            sym.Access(memB + (i * N + j) * sizeof(memory_T), sizeof(memory_T));
+        }
+    }
+    return sym.Pattern();
+}
+
+bool check(const char *name, const pattern_t &p, const pattern_class_t expected, const int64_t stride) {
+    const pattern_class_t c = p.Classify();
+    const int64_t s = p.strides[p.DominantStride()];
+    std::cout << name << ": " << pattern_class_name(c) << " " << s << std::endl;
+    return c == expected && s == stride;
+}
+
+int main(void) {
+    bool ok = check("loop_interchange_bad", loop_interchange(false), PATTERN_STRIDED,
+        static_cast<int64_t>(N * sizeof(memory_T)));
+    ok = check("loop_interchange_good", loop_interchange(true), PATTERN_SEQUENTIAL,
+        static_cast<int64_t>(sizeof(memory_T))) && ok;
+    std::cout << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
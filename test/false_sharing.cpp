@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// Every thread increments its own counter. With the counters packed into
+// one cache line the line bounces between the cores although no value is
+// shared; padding each counter to a line of its own removes that.
+
+const size_t ITERATIONS = 1 << 20;
+const size_t cacheline_size = 64;
+
+typedef int64_t compute_T;
+
+struct packed_T {
+    volatile compute_T value;
+};
+
+struct padded_T {
+    volatile compute_T value;
+    char padding[cacheline_size - sizeof(compute_T)];
+};
+
+template<class T>
+void count(T* counters, size_t t) {
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        counters[t].value = counters[t].value + 1;
+    }
+}
+
+template<class T>
+compute_T run(size_t threads) {
+    // one more line, to align the counters to lines
+    std::vector<char> mem((threads + 1) * sizeof(T) + cacheline_size, 0);
+    T* counters = reinterpret_cast<T*>((reinterpret_cast<uintptr_t>(mem.data()) + cacheline_size - 1)
+        & ~static_cast<uintptr_t>(cacheline_size - 1));
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.push_back(std::thread(count<T>, counters, t));
+    }
+    compute_T sum = 0;
+    for (size_t t = 0; t < threads; t++) {
+        workers[t].join();
+        sum += counters[t].value;
+    }
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    const size_t T = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    const size_t threads = (T > 0) ? T : 1;
+
+    compute_T result = run<packed_T>(threads);
+    std::cout << "false_sharing_on(" << threads << "): " << result << std::endl;
+
+    result = run<padded_T>(threads);
+    std::cout << "false_sharing_off(" << threads << "): " << result << std::endl;
+
+    return 0;
+}
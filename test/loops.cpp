@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdint.h>
+
+// Loops of known shape for -loops. Every loop is entered OUTER times and
+// runs INNER iterations per entry, so regina.loops.txt should report a trip
+// count of INNER for each of them. Unoptimized builds (gcc -O0, MSVC Debug)
+// compile for and while loops as a jump to the condition at the bottom,
+// i.e. the head is only ever reached through the back edge.
+
+const size_t OUTER = 100;
+const size_t INNER = 1000;
+
+typedef int64_t compute_T;
+
+volatile compute_T memA[INNER];
+
+compute_T jump_to_condition(size_t n) {
+    compute_T sum = 0;
+    size_t i = 0;
+    while (i < n) {
+        sum += memA[i];
+        i++;
+    }
+    return sum;
+}
+
+compute_T rotated(size_t n) {
+    compute_T sum = 0;
+    size_t i = 0;
+    do {
+        sum += memA[i];
+        i++;
+    } while (i < n);
+    return sum;
+}
+
+compute_T left_by_break(size_t n) {
+    compute_T sum = 0;
+    size_t i = 0;
+    do {
+        sum += memA[i];
+        if (++i == n) {
+            break;
+        }
+    } while (true);
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    const size_t n = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : INNER;
+    const size_t inner = (n > 0 && n <= INNER) ? n : INNER;
+
+    for (size_t i = 0; i < INNER; i++) {
+        memA[i] = static_cast<compute_T>(rand() % 10);
+    }
+
+    compute_T result = 0;
+    for (size_t o = 0; o < OUTER; o++) {
+        result += jump_to_condition(inner);
+    }
+    std::cout << "jump_to_condition(" << inner << "): " << result << std::endl;
+
+    result = 0;
+    for (size_t o = 0; o < OUTER; o++) {
+        result += rotated(inner);
+    }
+    std::cout << "rotated(" << inner << "): " << result << std::endl;
+
+    result = 0;
+    for (size_t o = 0; o < OUTER; o++) {
+        result += left_by_break(inner);
+    }
+    std::cout << "left_by_break(" << inner << "): " << result << std::endl;
+
+    return 0;
+}
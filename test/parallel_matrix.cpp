@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Matrix product with the rows of C split among the threads: every thread
+// reads all of B and writes only its own rows.
+
+const size_t N = 128;
+
+typedef float memory_T;
+typedef double compute_T;
+
+std::vector<memory_T> memA, memB, memC;
+
+void initMem(std::vector<memory_T>& stuff) {
+    stuff.resize(N * N);
+    for (size_t i = 0; i < N * N; i++) {
+        stuff[i] = static_cast<memory_T>(rand() % 10);
+    }
+}
+
+void multiply_rows(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        for (size_t j = 0; j < N; j++) {
+            compute_T sum = static_cast<compute_T>(0);
+            for (size_t k = 0; k < N; k++) {
+                sum += memA[i * N + k] * memB[k * N + j];
+            }
+            memC[i * N + j] = static_cast<memory_T>(sum);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t T = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    const size_t threads = (T > 0) ? T : 1;
+    srand(42);
+
+    initMem(memA);
+    initMem(memB);
+    memC.assign(N * N, static_cast<memory_T>(0));
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.push_back(std::thread(multiply_rows, N * t / threads, N * (t + 1) / threads));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+
+    compute_T result = static_cast<compute_T>(0);
+    for (size_t i = 0; i < N * N; i++) {
+        result += memC[i];
+    }
+    std::cout << "parallel_matrix(" << threads << "): " << result << std::endl;
+
+    return 0;
+}
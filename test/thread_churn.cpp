@@ -0,0 +1,47 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// Waves of short-lived threads: each touches a small buffer of its own and
+// exits, so thread start and exit dominate the run.
+
+const size_t WAVES = 64;
+const size_t N = 4096;
+
+typedef int32_t memory_T;
+typedef int64_t compute_T;
+
+std::atomic<compute_T> result(0);
+
+void touch(size_t seed) {
+    std::vector<memory_T> mem(N);
+    compute_T sum = 0;
+    for (size_t i = 0; i < N; i++) {
+        mem[i] = static_cast<memory_T>((seed + i) % 10);
+        sum += mem[i];
+    }
+    result += sum;
+}
+
+int main(int argc, char** argv) {
+    const size_t T = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    const size_t threads = (T > 0) ? T : 1;
+
+    for (size_t w = 0; w < WAVES; w++) {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.push_back(std::thread(touch, w * threads + t));
+        }
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+    }
+
+    std::cout << "thread_churn(" << threads << "x" << WAVES << "): " << result << std::endl;
+
+    return 0;
+}
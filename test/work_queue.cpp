@@ -0,0 +1,86 @@
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// One producer and a pool of workers around a queue behind a single mutex:
+// the queue, its lock and the result are shared by all threads.
+
+const size_t JOBS = 4096;
+const size_t JOB_SIZE = 1024;
+
+typedef int32_t memory_T;
+typedef int64_t compute_T;
+
+std::deque<size_t> queue;
+std::mutex queue_lock;
+std::condition_variable queue_cond;
+bool done = false;
+
+std::vector<memory_T> memA;
+compute_T result = 0;
+std::mutex result_lock;
+
+void produce() {
+    for (size_t j = 0; j < JOBS; j++) {
+        std::lock_guard<std::mutex> lock(queue_lock);
+        queue.push_back(j);
+        queue_cond.notify_one();
+    }
+    std::lock_guard<std::mutex> lock(queue_lock);
+    done = true;
+    queue_cond.notify_all();
+}
+
+void work() {
+    for (;;) {
+        size_t job;
+        {
+            std::unique_lock<std::mutex> lock(queue_lock);
+            queue_cond.wait(lock, [] { return !queue.empty() || done; });
+            if (queue.empty()) {
+                return;
+            }
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        // jobs overlap by half, neighbouring jobs share their data
+        compute_T sum = 0;
+        const size_t begin = (job * JOB_SIZE / 2) % (memA.size() - JOB_SIZE);
+        for (size_t i = begin; i < begin + JOB_SIZE; i++) {
+            sum += memA[i];
+        }
+        std::lock_guard<std::mutex> lock(result_lock);
+        result += sum;
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t T = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    const size_t threads = (T > 0) ? T : 1;
+    srand(42);
+
+    memA.resize(JOBS * JOB_SIZE / 4);
+    for (size_t i = 0; i < memA.size(); i++) {
+        memA[i] = static_cast<memory_T>(rand() % 10);
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.push_back(std::thread(work));
+    }
+    produce();
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+
+    std::cout << "work_queue(" << threads << "): " << result << std::endl;
+
+    return 0;
+}
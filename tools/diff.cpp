@@ -0,0 +1,318 @@
+/*
+ * regina_diff -- compares the memory behavior of two regina runs per symbol.
+ *
+ * Usage: regina_diff [-cache <bytes>] [-ways <n>] [-top <n>] <run A> <run B>
+ *
+ * A run is the directory regina wrote to: the container regina.mmtrd (or
+ * regina.N.mmtrd traces) and the symbol table regina.0.mmtrd.txt.
+ * Symbols are matched by name, so the two runs may come from different
+ * builds. Records without a symbol name are only known by their index in
+ * their own run; they are reported per run (A#N, B#N) and never matched.
+ * For every symbol the report holds accesses, bytes, distinct cache lines
+ * (estimated), misses of a simulated cache (one per thread, default 32 KiB
+ * 8-way) and the dominant stride pattern, ordered by the change in misses.
+ * Memory records carry no PC, so the stride pattern of a symbol comes from
+ * its accesses split into address streams (see pattern_streams_t); it is
+ * an approximation of the per-instruction patterns of -patterns.
+ *
+ * The traces of both runs are decoded in parallel, one worker per thread
+ * trace; the chunks of a trace are decoded in order by its worker, since
+ * the cache and stride state carries over from one chunk to the next. A
+ * single-threaded run thus takes one worker per run.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "access_pattern.h"
+#include "cache_sim.h"
+#include "hyperloglog.h"
+#include "mmtrd_format.h"
+#include "mmtrd_reader.h"
+#include "symbol_table.h"
+
+#define DIFF_PRECISION 10
+
+
+typedef struct _diff_stats_t {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t misses;
+    HyperLogLog lines;
+
+    inline _diff_stats_t(void) : reads(0), writes(0), bytes(0), misses(0), lines(DIFF_PRECISION) { }
+
+    inline void Merge(const _diff_stats_t &rhs) {
+        this->reads += rhs.reads;
+        this->writes += rhs.writes;
+        this->bytes += rhs.bytes;
+        this->misses += rhs.misses;
+        this->lines.Merge(rhs.lines);
+    }
+} diff_stats_t;
+
+
+/* Statistics of one thread, keyed by symbol index. */
+typedef struct _diff_job_t {
+    int run;
+    std::string path;
+    int64_t thread;     //< stream in a container, -1 for a trace of its own
+    bool ok;
+    std::unordered_map<uint64_t, diff_stats_t> stats;
+    std::unordered_map<uint64_t, pattern_streams_t> *patterns;  //< keyed by symbol index, records have no PC
+} diff_job_t;
+
+
+/* Statistics of one run, keyed by symbol name. */
+typedef struct _diff_symbol_t {
+    diff_stats_t stats;
+    pattern_t pattern;
+} diff_symbol_t;
+
+
+static bool file_exists(const std::string &path) {
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (f == NULL) {
+        return false;
+    }
+    std::fclose(f);
+    return true;
+}
+
+
+static void scan_trace(diff_job_t &job, const size_t cache_size, const unsigned int ways) {
+    MmtrdReader reader;
+    job.ok = reader.Open(job.path.c_str());
+    if (!job.ok) {
+        return;
+    }
+    if (job.thread >= 0) {
+        reader.Select(static_cast<uint32_t>(job.thread));
+    }
+
+    CacheSim cache(cache_size, ways);
+    std::vector<unsigned char> data;
+    mmtrd_record_t rec;
+    uint64_t lastSym = UINT64_MAX;
+    diff_stats_t *last = NULL;
+    pattern_streams_t *lastStreams = NULL;
+    for (size_t c = 0; c < reader.Chunks().size(); c++) {
+        if (!reader.ReadChunk(c, data)) {
+            job.ok = false;
+            return;
+        }
+        const uint32_t flags = reader.Chunks()[c].flags;
+        const unsigned char *p = data.data();
+        const unsigned char *end = p + data.size();
+        mmtrd_delta_t delta;
+        mmtrd_delta_init(delta);
+        size_t len;
+        while ((len = mmtrd_decode_next(p, end, flags, rec, delta)) > 0) {
+            p += len;
+            if (rec.type != MMTRD_RECORD_MEM) {
+                continue;
+            }
+            // Consecutive records mostly belong to the same symbol.
+            if (rec.sym != lastSym || last == NULL) {
+                last = &job.stats[rec.sym];
+                lastStreams = &(*job.patterns)[rec.sym];
+                lastSym = rec.sym;
+            }
+            if (rec.subtype == MMTRD_MEM_WRITE) {
+                last->writes++;
+            } else {
+                last->reads++;
+            }
+            last->bytes += rec.size;
+            last->lines.Add(hll_hash(rec.data / CACHE_SIM_LINE_SIZE));
+            last->misses += cache.Access(rec.data, rec.size);
+            lastStreams->Access(rec.data, rec.size);
+        }
+    }
+}
+
+
+static void merge_job(const diff_job_t &job, const std::vector<std::string> &names,
+    std::map<std::string, diff_symbol_t> &out) {
+    // Indices without a name differ between runs, the run keeps them apart.
+    const char run = static_cast<char>('A' + job.run);
+    char unknown[32];
+    for (auto it = job.stats.begin(); it != job.stats.end(); ++it) {
+        const std::string *name = (it->first < names.size()) ? &names[it->first] : NULL;
+        if (name == NULL || name->empty()) {
+            std::snprintf(unknown, sizeof(unknown), "%c#%llu", run, static_cast<unsigned long long>(it->first));
+        }
+        out[(name == NULL || name->empty()) ? std::string(unknown) : *name].stats.Merge(it->second);
+    }
+    for (auto it = job.patterns->begin(); it != job.patterns->end(); ++it) {
+        const uint64_t sym = it->first;
+        if (sym < names.size() && !names[sym].empty()) {
+            out[names[sym]].pattern.Merge(it->second.Pattern());
+        } else {
+            std::snprintf(unknown, sizeof(unknown), "%c#%llu", run, static_cast<unsigned long long>(sym));
+            out[unknown].pattern.Merge(it->second.Pattern());
+        }
+    }
+}
+
+
+static std::string describe_pattern(const pattern_t &p) {
+    if (p.count == 0) {
+        return "-";
+    }
+    const pattern_class_t c = p.Classify();
+    char buf[64];
+    if (c == PATTERN_SEQUENTIAL || c == PATTERN_STRIDED) {
+        std::snprintf(buf, sizeof(buf), "%s %lld", pattern_class_name(c),
+            static_cast<long long>(p.strides[p.DominantStride()]));
+    } else {
+        std::snprintf(buf, sizeof(buf), "%s", pattern_class_name(c));
+    }
+    return buf;
+}
+
+
+static std::string percent(const uint64_t a, const uint64_t b) {
+    char buf[32];
+    if (a == 0) {
+        return (b == 0) ? "0%" : "new";
+    }
+    std::snprintf(buf, sizeof(buf), "%+.1f%%", 100.0 * (static_cast<double>(b) - static_cast<double>(a)) / static_cast<double>(a));
+    return buf;
+}
+
+
+static void print_row(const char *name, const diff_symbol_t &a, const diff_symbol_t &b) {
+    const uint64_t accA = a.stats.reads + a.stats.writes;
+    const uint64_t accB = b.stats.reads + b.stats.writes;
+    std::printf("%s|%llu|%llu|%s|%llu|%llu|%.0f|%.0f|%llu|%llu|%s|%s|%s\n", name,
+        static_cast<unsigned long long>(accA), static_cast<unsigned long long>(accB), percent(accA, accB).c_str(),
+        static_cast<unsigned long long>(a.stats.bytes), static_cast<unsigned long long>(b.stats.bytes),
+        accA > 0 ? a.stats.lines.Estimate() : 0.0, accB > 0 ? b.stats.lines.Estimate() : 0.0,
+        static_cast<unsigned long long>(a.stats.misses), static_cast<unsigned long long>(b.stats.misses),
+        percent(a.stats.misses, b.stats.misses).c_str(),
+        describe_pattern(a.pattern).c_str(), describe_pattern(b.pattern).c_str());
+}
+
+
+int main(int argc, char **argv) {
+    size_t cacheSize = CACHE_SIM_DEFAULT_SIZE;
+    unsigned int ways = CACHE_SIM_DEFAULT_WAYS;
+    size_t top = SIZE_MAX;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if (std::strcmp(argv[arg], "-cache") == 0) {
+            cacheSize = static_cast<size_t>(std::strtoull(argv[arg + 1], NULL, 0));
+        } else if (std::strcmp(argv[arg], "-ways") == 0) {
+            ways = static_cast<unsigned int>(std::strtoul(argv[arg + 1], NULL, 0));
+        } else if (std::strcmp(argv[arg], "-top") == 0) {
+            top = static_cast<size_t>(std::strtoull(argv[arg + 1], NULL, 0));
+        } else {
+            break;
+        }
+    }
+    if (arg + 2 != argc) {
+        std::fprintf(stderr, "Usage: %s [-cache <bytes>] [-ways <n>] [-top <n>] <run A> <run B>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> names[2];
+    std::vector<diff_job_t> jobs;
+    for (int run = 0; run < 2; run++) {
+        const std::string dir = std::string(argv[arg + run]) + "/";
+        if (!symbol_table_read((dir + "regina.0.mmtrd.txt").c_str(), names[run])) {
+            std::fprintf(stderr, "Cannot read %sregina.0.mmtrd.txt\n", dir.c_str());
+            return 1;
+        }
+        // One job per thread of the container, if there is one.
+        MmtrdReader container;
+        if (container.Open((dir + "regina.mmtrd").c_str())) {
+            std::vector<uint32_t> threads;
+            container.Threads(threads);
+            for (size_t t = 0; t < threads.size(); t++) {
+                jobs.push_back(diff_job_t());
+                jobs.back().run = run;
+                jobs.back().path = dir + "regina.mmtrd";
+                jobs.back().thread = threads[t];
+            }
+            continue;
+        }
+        // Threads are numbered without gaps.
+        char filename[64];
+        for (int thread = 0; ; thread++) {
+            std::snprintf(filename, sizeof(filename), "regina.%d.mmtrd", thread);
+            if (!file_exists(dir + filename)) {
+                break;
+            }
+            jobs.push_back(diff_job_t());
+            jobs.back().run = run;
+            jobs.back().path = dir + filename;
+            jobs.back().thread = -1;
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    const unsigned int hw = std::thread::hardware_concurrency();
+    const size_t count = std::min(jobs.size(), static_cast<size_t>(hw > 0 ? hw : 4));
+    for (size_t w = 0; w < count; w++) {
+        workers.push_back(std::thread([&]() {
+            for (size_t j; (j = next++) < jobs.size(); ) {
+                jobs[j].patterns = new std::unordered_map<uint64_t, pattern_streams_t>();
+                scan_trace(jobs[j], cacheSize, ways);
+            }
+        }));
+    }
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w].join();
+    }
+
+    std::map<std::string, diff_symbol_t> symbols[2];
+    diff_symbol_t total[2];
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (!jobs[j].ok) {
+            std::fprintf(stderr, "Cannot read %s\n", jobs[j].path.c_str());
+            return 1;
+        }
+        merge_job(jobs[j], names[jobs[j].run], symbols[jobs[j].run]);
+        delete jobs[j].patterns;
+    }
+
+    // Union of both runs, largest change in misses first.
+    std::vector<std::pair<uint64_t, std::string>> order;
+    for (int run = 0; run < 2; run++) {
+        for (auto it = symbols[run].begin(); it != symbols[run].end(); ++it) {
+            total[run].stats.Merge(it->second.stats);
+        }
+    }
+    for (int run = 0; run < 2; run++) {
+        for (auto it = symbols[run].begin(); it != symbols[run].end(); ++it) {
+            if (run == 1 && symbols[0].find(it->first) != symbols[0].end()) {
+                continue;
+            }
+            const uint64_t a = symbols[0][it->first].stats.misses;
+            const uint64_t b = symbols[1][it->first].stats.misses;
+            order.push_back(std::make_pair(a > b ? a - b : b - a, it->first));
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<uint64_t, std::string> &l,
+        const std::pair<uint64_t, std::string> &r) {
+        return (l.first != r.first) ? l.first > r.first : l.second < r.second;
+    });
+
+    std::printf("# symbol|accesses A|accesses B|change|bytes A|bytes B|lines A|lines B|misses A|misses B|change|pattern A|pattern B\n");
+    print_row("(all)", total[0], total[1]);
+    for (size_t i = 0; i < order.size() && i < top; i++) {
+        print_row(order[i].second.c_str(), symbols[0][order[i].second], symbols[1][order[i].second]);
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * regina_dump -- prints records of a .mmtrd trace.
+ *
+ * Usage: regina_dump [-index] [-thread <n>] <trace.mmtrd> [first_record [last_record]]
+ *
+ * Only the chunks overlapping the requested record range are read. Record
+ * numbers count per thread, so the records of a container are only printed
+ * for the thread given with -thread.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "mmtrd_format.h"
+#include "mmtrd_reader.h"
+
+
+static void print_index(const MmtrdReader &reader) {
+    const std::vector<mmtrd_chunk_t> &chunks = reader.Chunks();
+    std::printf("%llu records in %llu chunks\n",
+        static_cast<unsigned long long>(reader.RecordCount()),
+        static_cast<unsigned long long>(chunks.size()));
+    for (size_t i = 0; i < chunks.size(); i++) {
+        const mmtrd_chunk_t &c = chunks[i];
+        std::printf("chunk %llu: thread %u%s offset %llu size %llu records %llu-%llu time %llu-%llu addr 0x%llx-0x%llx\n",
+            static_cast<unsigned long long>(i), c.thread_idx, (c.flags & MMTRD_CHUNK_DELTA) ? " delta" : "",
+            static_cast<unsigned long long>(c.offset), static_cast<unsigned long long>(c.size),
+            static_cast<unsigned long long>(c.first_record),
+            static_cast<unsigned long long>(c.first_record + c.record_count),
+            static_cast<unsigned long long>(c.ts_begin), static_cast<unsigned long long>(c.ts_end),
+            static_cast<unsigned long long>(c.min_addr), static_cast<unsigned long long>(c.max_addr));
+    }
+}
+
+
+static void print_record(const uint64_t number, const mmtrd_record_t &rec) {
+    if (rec.type == MMTRD_RECORD_MEM) {
+        std::printf("%llu MEM %s sym %llu of size %d to 0x%llx\n",
+            static_cast<unsigned long long>(number),
+            rec.subtype == MMTRD_MEM_WRITE ? "WRITE" : "READ",
+            static_cast<unsigned long long>(rec.sym), rec.size,
+            static_cast<unsigned long long>(rec.data));
+    } else {
+        const char *kind = rec.subtype == MMTRD_CALL ? "CALL" : (rec.subtype == MMTRD_CALL_IND ? "CALL IND" : "RET");
+        std::printf("%llu %s @ 0x%llx sym %llu to 0x%llx sym %llu\n",
+            static_cast<unsigned long long>(number), kind,
+            static_cast<unsigned long long>(rec.instr), static_cast<unsigned long long>(rec.sym),
+            static_cast<unsigned long long>(rec.target), static_cast<unsigned long long>(rec.target_sym));
+    }
+}
+
+
+int main(int argc, char **argv) {
+    bool index = false;
+    long thread = -1;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (std::strcmp(argv[arg], "-index") == 0) {
+            index = true;
+        } else if (std::strcmp(argv[arg], "-thread") == 0 && arg + 1 < argc) {
+            thread = std::strtol(argv[++arg], NULL, 0);
+        } else {
+            break;
+        }
+    }
+    if (arg >= argc || argv[arg][0] == '-') {
+        std::fprintf(stderr, "Usage: %s [-index] [-thread <n>] <trace.mmtrd> [first_record [last_record]]\n", argv[0]);
+        return 1;
+    }
+
+    MmtrdReader reader;
+    if (!reader.Open(argv[arg])) {
+        std::fprintf(stderr, "Cannot open %s\n", argv[arg]);
+        return 1;
+    }
+    arg++;
+
+    std::vector<uint32_t> threads;
+    reader.Threads(threads);
+    if (thread >= 0) {
+        reader.Select(static_cast<uint32_t>(thread));
+    } else if (threads.size() > 1 && !index) {
+        std::fprintf(stderr, "The trace holds %llu threads, choose one with -thread\n",
+            static_cast<unsigned long long>(threads.size()));
+        return 1;
+    }
+
+    if (index) {
+        print_index(reader);
+        return 0;
+    }
+
+    const uint64_t first = arg < argc ? std::strtoull(argv[arg++], NULL, 0) : 0;
+    const uint64_t last = arg < argc ? std::strtoull(argv[arg++], NULL, 0) : UINT64_MAX;
+
+    std::vector<unsigned char> data;
+    mmtrd_record_t rec = mmtrd_record_t();
+    for (size_t c = reader.FindChunk(first); c < reader.Chunks().size(); c++) {
+        const mmtrd_chunk_t &chunk = reader.Chunks()[c];
+        if (chunk.first_record > last) {
+            break;
+        }
+        if (!reader.ReadChunk(c, data)) {
+            std::fprintf(stderr, "Cannot read chunk %llu\n", static_cast<unsigned long long>(c));
+            return 1;
+        }
+
+        uint64_t number = chunk.first_record;
+        const unsigned char *p = data.data();
+        const unsigned char *end = p + data.size();
+        mmtrd_delta_t delta;
+        mmtrd_delta_init(delta);
+        size_t len;
+        while ((len = mmtrd_decode_next(p, end, chunk.flags, rec, delta)) > 0 && number <= last) {
+            if (number >= first) {
+                print_record(number, rec);
+            }
+            number++;
+            p += len;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * regina_extract -- splits a trace container into per-thread traces.
+ *
+ * Usage: regina_extract [-list] <regina.mmtrd> [thread...]
+ *
+ * Writes the stream of every given thread (default: all) as a standalone
+ * trace next to the container, <prefix>.N.mmtrd for <prefix>.mmtrd, the
+ * same files a run without container would have written. With -list, only
+ * prints the threads of the container.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mmtrd_format.h"
+#include "mmtrd_reader.h"
+
+
+static void list_threads(const MmtrdReader &reader) {
+    std::vector<uint32_t> threads;
+    reader.Threads(threads);
+    std::printf("# thread|chunks|records|bytes\n");
+    for (size_t t = 0; t < threads.size(); t++) {
+        uint64_t chunks = 0, records = 0, bytes = 0;
+        for (size_t c = 0; c < reader.Chunks().size(); c++) {
+            const mmtrd_chunk_t &chunk = reader.Chunks()[c];
+            if (chunk.thread_idx == threads[t]) {
+                chunks++;
+                records += chunk.record_count;
+                bytes += chunk.size;
+            }
+        }
+        std::printf("%u|%llu|%llu|%llu\n", threads[t], static_cast<unsigned long long>(chunks),
+            static_cast<unsigned long long>(records), static_cast<unsigned long long>(bytes));
+    }
+}
+
+
+/* Copies the chunks of one thread into a trace of their own, with index and footer. */
+static bool extract_thread(const char *path, const uint32_t thread, const std::string &out) {
+    MmtrdReader reader;
+    if (!reader.Open(path)) {
+        return false;
+    }
+    reader.Select(thread);
+    if (reader.Chunks().empty()) {
+        std::fprintf(stderr, "No chunks of thread %u\n", thread);
+        return false;
+    }
+
+    FILE *f = std::fopen(out.c_str(), "wb");
+    if (f == NULL) {
+        return false;
+    }
+    std::vector<mmtrd_chunk_t> index;
+    std::vector<unsigned char> data;
+    uint64_t offset = 0;
+    for (size_t c = 0; c < reader.Chunks().size(); c++) {
+        if (!reader.ReadChunk(c, data) || (!data.empty() && std::fwrite(data.data(), 1, data.size(), f) != data.size())) {
+            std::fclose(f);
+            return false;
+        }
+        index.push_back(reader.Chunks()[c]);
+        index.back().offset = offset;
+        offset += data.size();
+    }
+
+    mmtrd_footer_t footer;
+    std::memset(&footer, 0, sizeof(footer));
+    footer.index_offset = offset;
+    footer.chunk_count = index.size();
+    footer.record_count = reader.RecordCount();
+    footer.chunk_size = MMTRD_DEFAULT_CHUNK_SIZE;
+    footer.version = MMTRD_FORMAT_VERSION;
+    std::memcpy(footer.magic, MMTRD_FOOTER_MAGIC, sizeof(footer.magic));
+    std::fwrite(index.data(), sizeof(mmtrd_chunk_t), index.size(), f);
+    const bool ok = std::fwrite(&footer, sizeof(footer), 1, f) == 1;
+    return (std::fclose(f) == 0) && ok;
+}
+
+
+int main(int argc, char **argv) {
+    bool list = false;
+    int arg = 1;
+    if (arg < argc && std::strcmp(argv[arg], "-list") == 0) {
+        list = true;
+        arg++;
+    }
+    if (arg >= argc) {
+        std::fprintf(stderr, "Usage: %s [-list] <regina.mmtrd> [thread...]\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[arg++];
+
+    MmtrdReader reader;
+    if (!reader.Open(path)) {
+        std::fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    if (list) {
+        list_threads(reader);
+        return 0;
+    }
+
+    std::vector<uint32_t> threads;
+    if (arg < argc) {
+        for (; arg < argc; arg++) {
+            threads.push_back(static_cast<uint32_t>(std::strtoul(argv[arg], NULL, 0)));
+        }
+    } else {
+        reader.Threads(threads);
+    }
+    reader.Close();
+
+    std::string base(path);
+    if (base.size() > 6 && base.compare(base.size() - 6, 6, ".mmtrd") == 0) {
+        base.resize(base.size() - 6);
+    }
+    char suffix[32];
+    for (size_t t = 0; t < threads.size(); t++) {
+        std::snprintf(suffix, sizeof(suffix), ".%u.mmtrd", threads[t]);
+        if (!extract_thread(path, threads[t], base + suffix)) {
+            std::fprintf(stderr, "Cannot extract thread %u to %s%s\n", threads[t], base.c_str(), suffix);
+            return 1;
+        }
+    }
+    std::printf("%llu threads extracted\n", static_cast<unsigned long long>(threads.size()));
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * regina_shm -- reads the shared memory ring of a running regina client.
+ *
+ * Usage: regina_shm [-stats] <name>
+ *
+ * <name> is the value of -shm (with -shm_per_thread: <name>.<thread>). The
+ * ring is awaited if it does not exist yet. Records are printed like
+ * regina_dump does, with -stats only throughput and drops once a second.
+ * The ring is removed when the client has closed it and it is drained.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "mmtrd_format.h"
+#include "shm_ring.h"
+
+
+static void print_record(const uint32_t thread, const uint64_t number, const mmtrd_record_t &rec) {
+    if (rec.type == MMTRD_RECORD_MEM) {
+        std::printf("%u %llu MEM %s sym %llu of size %d to 0x%llx\n", thread,
+            static_cast<unsigned long long>(number),
+            rec.subtype == MMTRD_MEM_WRITE ? "WRITE" : "READ",
+            static_cast<unsigned long long>(rec.sym), rec.size,
+            static_cast<unsigned long long>(rec.data));
+    } else {
+        const char *kind = rec.subtype == MMTRD_CALL ? "CALL" : (rec.subtype == MMTRD_CALL_IND ? "CALL IND" : "RET");
+        std::printf("%u %llu %s @ 0x%llx sym %llu to 0x%llx sym %llu\n", thread,
+            static_cast<unsigned long long>(number), kind,
+            static_cast<unsigned long long>(rec.instr), static_cast<unsigned long long>(rec.sym),
+            static_cast<unsigned long long>(rec.target), static_cast<unsigned long long>(rec.target_sym));
+    }
+}
+
+
+int main(int argc, char **argv) {
+    bool stats = false;
+    int arg = 1;
+    if (arg < argc && std::strcmp(argv[arg], "-stats") == 0) {
+        stats = true;
+        arg++;
+    }
+    if (arg >= argc) {
+        std::fprintf(stderr, "Usage: %s [-stats] <name>\n", argv[0]);
+        return 1;
+    }
+    const char *name = argv[arg];
+
+    ShmRing ring;
+    while (!ring.Attach(name)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    const shm_ring_header_t *header = ring.Header();
+    std::fprintf(stderr, "attached to %s: %llu bytes, %s when full\n", name,
+        static_cast<unsigned long long>(header->capacity),
+        header->policy == SHM_RING_BLOCK ? "blocking" : "dropping");
+
+    shm_frame_t frame;
+    std::vector<unsigned char> payload;
+    mmtrd_record_t rec;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    auto last = std::chrono::steady_clock::now();
+
+    for (;;) {
+        // Check before reading, so nothing published before closing is missed.
+        const bool closed = ring.Closed();
+        if (!ring.Read(frame, payload)) {
+            if (closed) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } else if (frame.kind == SHM_FRAME_SYMBOLS) {
+            if (!stats) {
+                std::fwrite(payload.data(), 1, payload.size(), stdout);
+            }
+        } else {
+            records += frame.count;
+            bytes += frame.size;
+            if (!stats) {
+                uint64_t number = frame.first_record;
+                const unsigned char *p = payload.data();
+                const unsigned char *end = p + payload.size();
+                size_t len;
+                while ((len = mmtrd_decode(p, end, rec)) > 0) {
+                    print_record(frame.thread_idx, number++, rec);
+                    p += len;
+                }
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (stats && now - last >= std::chrono::seconds(1)) {
+            std::printf("%llu records/s %llu bytes/s, %llu records dropped in total\n",
+                static_cast<unsigned long long>(records), static_cast<unsigned long long>(bytes),
+                static_cast<unsigned long long>(header->dropped_records));
+            std::fflush(stdout);
+            records = bytes = 0;
+            last = now;
+        }
+    }
+
+    std::fprintf(stderr, "%s closed: %llu records published, %llu dropped in %llu frames\n", name,
+        static_cast<unsigned long long>(header->records),
+        static_cast<unsigned long long>(header->dropped_records),
+        static_cast<unsigned long long>(header->dropped_frames));
+    ring.Close();
+    ShmRing::Remove(name);
+    return 0;
+}
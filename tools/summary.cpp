@@ -0,0 +1,319 @@
+/*
+ * regina_summary -- aggregates the traces of a regina run for the viewer.
+ *
+ * Usage: regina_summary [-threads <n>] [-bucket <bytes>] [<run>]
+ *
+ * Reads the container regina.mmtrd (or the traces regina.N.mmtrd) and
+ * regina.0.mmtrd.txt from the run directory (default: the current one) and
+ * writes next to them
+ *   regina.summary.symbols.txt    accesses and calls per symbol
+ *   regina.summary.histogram.txt  accesses per address bucket (default 4 KiB)
+ *   regina.summary.calls.txt      call edges between symbols
+ *
+ * Every chunk of every trace is a task. The tasks are spread over the
+ * workers in contiguous blocks and idle workers steal from the others;
+ * each worker aggregates into its own partial, the partials are merged at
+ * the end.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "call_graph.h"
+#include "mmtrd_format.h"
+#include "mmtrd_reader.h"
+#include "symbol_table.h"
+#include "work_queue.h"
+
+
+typedef struct _summary_task_t {
+    size_t file;
+    size_t chunk;
+} summary_task_t;
+
+
+typedef struct _summary_symbol_t {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t calls;     //< calls made
+    uint64_t called;    //< calls received
+    uint64_t returns;
+
+    inline _summary_symbol_t(void) : reads(0), writes(0), bytes(0), calls(0), called(0), returns(0) { }
+
+    inline void Merge(const _summary_symbol_t &rhs) {
+        this->reads += rhs.reads;
+        this->writes += rhs.writes;
+        this->bytes += rhs.bytes;
+        this->calls += rhs.calls;
+        this->called += rhs.called;
+        this->returns += rhs.returns;
+    }
+} summary_symbol_t;
+
+
+typedef struct _summary_bucket_t {
+    uint64_t reads;
+    uint64_t writes;
+
+    inline _summary_bucket_t(void) : reads(0), writes(0) { }
+} summary_bucket_t;
+
+
+/* Aggregates of one worker; the call graph is keyed by symbol indices. */
+typedef struct _summary_partial_t {
+    uint64_t records;
+    std::unordered_map<uint64_t, summary_symbol_t> symbols;
+    std::unordered_map<uint64_t, summary_bucket_t> histogram;
+    CallGraph calls;
+
+    inline _summary_partial_t(void) : records(0) { }
+
+    inline void Merge(const _summary_partial_t &rhs) {
+        this->records += rhs.records;
+        for (auto it = rhs.symbols.begin(); it != rhs.symbols.end(); ++it) {
+            this->symbols[it->first].Merge(it->second);
+        }
+        for (auto it = rhs.histogram.begin(); it != rhs.histogram.end(); ++it) {
+            summary_bucket_t &b = this->histogram[it->first];
+            b.reads += it->second.reads;
+            b.writes += it->second.writes;
+        }
+        this->calls.Merge(rhs.calls);
+    }
+} summary_partial_t;
+
+
+static bool summarize_chunk(MmtrdReader &reader, const size_t chunk, const uint64_t bucket,
+    std::vector<unsigned char> &data, summary_partial_t &out) {
+    if (!reader.ReadChunk(chunk, data)) {
+        return false;
+    }
+    const uint32_t flags = reader.Chunks()[chunk].flags;
+    const unsigned char *p = data.data();
+    const unsigned char *end = p + data.size();
+    mmtrd_delta_t delta;
+    mmtrd_delta_init(delta);
+    mmtrd_record_t rec;
+    uint64_t lastSym = UINT64_MAX;
+    summary_symbol_t *sym = NULL;
+    size_t len;
+    while ((len = mmtrd_decode_next(p, end, flags, rec, delta)) > 0) {
+        p += len;
+        out.records++;
+        if (rec.sym != lastSym || sym == NULL) {
+            sym = &out.symbols[rec.sym];
+            lastSym = rec.sym;
+        }
+        if (rec.type == MMTRD_RECORD_MEM) {
+            summary_bucket_t &b = out.histogram[rec.data / bucket];
+            if (rec.subtype == MMTRD_MEM_WRITE) {
+                sym->writes++;
+                b.writes++;
+            } else {
+                sym->reads++;
+                b.reads++;
+            }
+            sym->bytes += rec.size;
+        } else if (rec.subtype == MMTRD_RET) {
+            sym->returns++;
+        } else {
+            sym->calls++;
+            out.symbols[rec.target_sym].called++;
+            out.calls.Add(rec.sym, rec.target_sym, rec.subtype == MMTRD_CALL_IND, 1);
+        }
+    }
+    return true;
+}
+
+
+static void worker_main(const size_t worker, const std::vector<std::string> &files, WorkQueues<summary_task_t> &queues,
+    const uint64_t bucket, summary_partial_t &out, bool &ok) {
+    // Each worker reads through its own file handles.
+    std::vector<std::unique_ptr<MmtrdReader>> readers(files.size());
+    std::vector<unsigned char> data;
+    summary_task_t task;
+    ok = true;
+    while (queues.Pop(worker, task)) {
+        if (!readers[task.file]) {
+            readers[task.file].reset(new MmtrdReader());
+            if (!readers[task.file]->Open(files[task.file].c_str())) {
+                ok = false;
+                continue;
+            }
+        }
+        ok &= summarize_chunk(*readers[task.file], task.chunk, bucket, data, out);
+    }
+}
+
+
+static std::string symbol_name(const std::vector<std::string> &names, const uint64_t idx) {
+    if (idx < names.size() && !names[idx].empty()) {
+        return names[idx];
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "#%llu", static_cast<unsigned long long>(idx));
+    return buf;
+}
+
+
+static bool write_summary(const std::string &dir, const std::vector<std::string> &names,
+    const summary_partial_t &total, const uint64_t bucket) {
+    FILE *f = std::fopen((dir + "regina.summary.symbols.txt").c_str(), "w");
+    if (f == NULL) {
+        return false;
+    }
+    std::vector<std::pair<uint64_t, const summary_symbol_t *>> symbols;
+    for (auto it = total.symbols.begin(); it != total.symbols.end(); ++it) {
+        symbols.push_back(std::make_pair(it->first, &it->second));
+    }
+    std::sort(symbols.begin(), symbols.end());
+    std::fprintf(f, "# symbol|name|reads|writes|bytes|calls|called|returns\n");
+    for (size_t i = 0; i < symbols.size(); i++) {
+        const summary_symbol_t &s = *symbols[i].second;
+        std::fprintf(f, "%llu|%s|%llu|%llu|%llu|%llu|%llu|%llu\n", static_cast<unsigned long long>(symbols[i].first),
+            symbol_name(names, symbols[i].first).c_str(),
+            static_cast<unsigned long long>(s.reads), static_cast<unsigned long long>(s.writes),
+            static_cast<unsigned long long>(s.bytes), static_cast<unsigned long long>(s.calls),
+            static_cast<unsigned long long>(s.called), static_cast<unsigned long long>(s.returns));
+    }
+    std::fclose(f);
+
+    f = std::fopen((dir + "regina.summary.histogram.txt").c_str(), "w");
+    if (f == NULL) {
+        return false;
+    }
+    std::vector<std::pair<uint64_t, summary_bucket_t>> buckets(total.histogram.begin(), total.histogram.end());
+    std::sort(buckets.begin(), buckets.end(), [](const std::pair<uint64_t, summary_bucket_t> &a,
+        const std::pair<uint64_t, summary_bucket_t> &b) {
+        return a.first < b.first;
+    });
+    std::fprintf(f, "# address|reads|writes (buckets of %llu bytes)\n", static_cast<unsigned long long>(bucket));
+    for (size_t i = 0; i < buckets.size(); i++) {
+        std::fprintf(f, "0x%llx|%llu|%llu\n", static_cast<unsigned long long>(buckets[i].first * bucket),
+            static_cast<unsigned long long>(buckets[i].second.reads),
+            static_cast<unsigned long long>(buckets[i].second.writes));
+    }
+    std::fclose(f);
+
+    f = std::fopen((dir + "regina.summary.calls.txt").c_str(), "w");
+    if (f == NULL) {
+        return false;
+    }
+    std::vector<CallGraph::edge_count_t> edges;
+    total.calls.Sorted(edges);
+    std::fprintf(f, "# caller|callee|count|kind\n");
+    for (size_t i = 0; i < edges.size(); i++) {
+        std::fprintf(f, "%s|%s|%llu|%s\n", symbol_name(names, edges[i].edge.caller).c_str(),
+            symbol_name(names, edges[i].edge.target).c_str(),
+            static_cast<unsigned long long>(edges[i].count), edges[i].indirect ? "ind" : "direct");
+    }
+    std::fclose(f);
+    return true;
+}
+
+
+int main(int argc, char **argv) {
+    size_t threads = std::thread::hardware_concurrency();
+    uint64_t bucket = 4096;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if (std::strcmp(argv[arg], "-threads") == 0) {
+            threads = static_cast<size_t>(std::strtoull(argv[arg + 1], NULL, 0));
+        } else if (std::strcmp(argv[arg], "-bucket") == 0) {
+            bucket = std::strtoull(argv[arg + 1], NULL, 0);
+        } else {
+            break;
+        }
+    }
+    if (arg + 1 < argc || (arg < argc && argv[arg][0] == '-') || bucket == 0) {
+        std::fprintf(stderr, "Usage: %s [-threads <n>] [-bucket <bytes>] [<run>]\n", argv[0]);
+        return 1;
+    }
+    const std::string dir = (arg < argc) ? std::string(argv[arg]) + "/" : std::string();
+    threads = (threads > 0) ? threads : 1;
+
+    std::vector<std::string> names;
+    if (!symbol_table_read((dir + "regina.0.mmtrd.txt").c_str(), names)) {
+        std::fprintf(stderr, "Cannot read %sregina.0.mmtrd.txt\n", dir.c_str());
+        return 1;
+    }
+
+    // One task per chunk, of the container or else of the traces of the
+    // threads, which are numbered without gaps.
+    std::vector<std::string> files;
+    std::vector<summary_task_t> tasks;
+    char filename[64];
+    for (int thread = -1; ; thread++) {
+        if (thread < 0) {
+            std::snprintf(filename, sizeof(filename), "regina.mmtrd");
+        } else {
+            std::snprintf(filename, sizeof(filename), "regina.%d.mmtrd", thread);
+        }
+        MmtrdReader reader;
+        if (!reader.Open((dir + filename).c_str())) {
+            if (thread < 0) {
+                continue;
+            }
+            break;
+        }
+        for (size_t c = 0; c < reader.Chunks().size(); c++) {
+            summary_task_t task;
+            task.file = files.size();
+            task.chunk = c;
+            tasks.push_back(task);
+        }
+        files.push_back(dir + filename);
+        if (thread < 0) {
+            break;
+        }
+    }
+    if (files.empty()) {
+        std::fprintf(stderr, "No traces in %s\n", dir.empty() ? "." : dir.c_str());
+        return 1;
+    }
+
+    // Contiguous blocks keep the reads of a worker sequential.
+    threads = std::min(threads, std::max(tasks.size(), static_cast<size_t>(1)));
+    WorkQueues<summary_task_t> queues(threads);
+    for (size_t i = 0; i < tasks.size(); i++) {
+        queues.Push(i * threads / tasks.size(), tasks[i]);
+    }
+
+    std::vector<summary_partial_t> partials(threads);
+    std::unique_ptr<bool[]> ok(new bool[threads]);
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < threads; w++) {
+        workers.push_back(std::thread(worker_main, w, std::cref(files), std::ref(queues), bucket,
+            std::ref(partials[w]), std::ref(ok[w])));
+    }
+    for (size_t w = 0; w < threads; w++) {
+        workers[w].join();
+    }
+    for (size_t w = 0; w < threads; w++) {
+        if (!ok[w]) {
+            std::fprintf(stderr, "Cannot read all traces\n");
+            return 1;
+        }
+    }
+
+    for (size_t w = 1; w < threads; w++) {
+        partials[0].Merge(partials[w]);
+    }
+    if (!write_summary(dir, names, partials[0], bucket)) {
+        std::fprintf(stderr, "Cannot write the summary to %s\n", dir.empty() ? "." : dir.c_str());
+        return 1;
+    }
+    std::printf("%llu records of %llu traces in %llu chunks, %llu symbols\n",
+        static_cast<unsigned long long>(partials[0].records), static_cast<unsigned long long>(files.size()),
+        static_cast<unsigned long long>(tasks.size()), static_cast<unsigned long long>(partials[0].symbols.size()));
+    return 0;
+}